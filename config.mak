@@ -56,6 +56,8 @@ SGXLKL_CFLAGS ?= -std=c11 -Wall -Werror -isystem ${SGX_LKL_MUSL}/src/internal/ -
 
 MUSL_CONFIGURE_OPTS ?=
 MUSL_CFLAGS ?= -fPIC -D__USE_GNU
+# System calls into LKL first try the in-enclave fast paths (src/lkl/syscall_fast.c)
+SGX_LKL_MUSL_LDFLAGS ?= -Wl,--wrap=lkl_syscall
 
 THIRD_PARTY_CFLAGS ?=
 
@@ -67,6 +69,11 @@ ifeq ($(RELEASE),true)
 	THIRD_PARTY_CFLAGS += -DSGXLKL_RELEASE
 endif
 
+# Collect and print per-lock contention statistics (see src/include/hybridlock.h)
+ifeq ($(LOCK_STATS),true)
+	MUSL_CFLAGS += -DSGXLKL_LOCK_STATS
+endif
+
 ifeq ($(DEBUG),true)
 	SGXLKL_CFLAGS += -g3 -ggdb3 -O0
 	MUSL_CONFIGURE_OPTS += --disable-optimize --enable-debug
@@ -174,6 +174,7 @@ class LthreadStats(gdb.Command):
         fxq_lts = 0
 
         schedq_lts = self.count_queue_elements('__scheduler_queue')
+        schedq_lts += self.count_queue_elements('__scheduler_queue_prio')
         syscall_req_lts = self.count_queue_elements('__syscall_queue')
         syscall_ret_lts = self.count_queue_elements('__return_queue')
 
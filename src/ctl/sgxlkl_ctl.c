@@ -37,7 +37,7 @@ static struct attestation_config attn_config = {
 
 static void usage(char *cmd, int exit_code) {
     printf(
-        "Usage: %s [attest|run|addpeer] --server=HOST:PORT [--app=<json-path>] \n"
+        "Usage: %s [attest|run|addpeer|threadstats] --server=HOST:PORT [--app=<json-path>] \n"
         "[--ias-sign-ca-cert=<pem-ca-cert-path] [--ias-spid=<SPID>]\n"
         "[--ias-server=<host:port>] [--ias-quote-type=<\"Unlinkable\"|\"Linkable\">]\n"
         "[--ias-skey=<ias-subscription-key>]\n"
@@ -52,6 +52,9 @@ static void usage(char *cmd, int exit_code) {
         " attest                      Receive quote/attestation report and verify it.\n"
         " run                         Send application run request.\n"
         " addpeer                     Adds a new Wireguard peer.\n"
+        " threadstats                 Print run time and host call statistics of\n"
+        "                             all user-level threads in the enclave\n"
+        "                             (requires SGXLKL_THREAD_STATS=1).\n"
         "\n"
         "General options\n"
         " -u, --usage                 Print this help text.\n"
@@ -154,6 +157,58 @@ static void do_addpeers(ProtobufCService *service, char *peer_key,
     free(req.peers);
 }
 
+static void handle_threadstats_response(const Sgxlkl__ThreadStatsResult *result,
+                                void *closure_data) {
+    if (result == NULL) {
+        sgxlkl_err("Error processing response to thread stats request.\n");
+        goto out;
+    }
+
+    switch(result->err) {
+        case SGXLKL__ERROR__SUCCESS:
+            printf("%-6s %-32s %14s %10s %10s %14s\n", "TID", "NAME", "RUN(us)", "RESUMES", "HOSTCALLS", "WAIT(us)");
+            for (size_t i = 0; i < result->n_threads; i++) {
+                Sgxlkl__ThreadStat *ts = result->threads[i];
+                uint64_t calls = 0, wait_ns = 0;
+                for (size_t j = 0; j < ts->n_hostcalls; j++) {
+                    calls += ts->hostcalls[j]->count;
+                    wait_ns += ts->hostcalls[j]->wait_ns;
+                }
+                printf("%-6d %-32s %14"PRIu64" %10"PRIu64" %10"PRIu64" %14"PRIu64"\n",
+                       ts->tid, ts->funcname, ts->run_ns / 1000, ts->resumes, calls, wait_ns / 1000);
+                for (size_t j = 0; j < ts->n_hostcalls; j++) {
+                    Sgxlkl__HostCallStat *hc = ts->hostcalls[j];
+                    printf("       syscall %-17u %14s %10s %10"PRIu64" %14"PRIu64"\n",
+                           hc->syscallno, "", "", hc->count, hc->wait_ns / 1000);
+                }
+            }
+            break;
+        case SGXLKL__ERROR__STATS_DISABLED:
+            sgxlkl_fail("Thread statistics are not available: %s\n", result->err_msg);
+            break;
+        case SGXLKL__ERROR__INTERNAL:
+            sgxlkl_fail("Failed to collect thread statistics due to internal server error: %s\n", result->err_msg);
+            break;
+        case SGXLKL__ERROR__NOT_PERMITTED:
+            sgxlkl_fail("Request not permitted: %s\n", result->err_msg);
+            break;
+        default:
+            sgxlkl_fail("Unknown error.\n");
+            break;
+    }
+
+out:
+    *(protobuf_c_boolean *)closure_data = 1;
+}
+
+static void do_threadstats(ProtobufCService *service) {
+    Sgxlkl__ThreadStatsRequest req = SGXLKL__THREAD_STATS_REQUEST__INIT;
+    protobuf_c_boolean is_done = 0;
+    sgxlkl__control__thread_stats(service, &req, handle_threadstats_response, &is_done);
+    while (!is_done)
+        protobuf_c_rpc_dispatch_run(protobuf_c_rpc_dispatch_default());
+}
+
 static void handle_attest_response(const Sgxlkl__AttestResult *result,
                                 void *closure_data) {
     if (result == NULL) {
@@ -437,6 +492,8 @@ int main(int argc, char**argv) {
         do_attest(service);
     else if (!strcmp(action, "run"))
         do_run(service, app_config_path);
+    else if (!strcmp(action, "threadstats"))
+        do_threadstats(service);
     else if (!strcmp(action, "addpeer")) {
         if (!peer_key) {
             fprintf(stderr, "No peer key specified via --key.\n");
@@ -17,7 +17,7 @@
 
 #include "lthread.h"
 #include "pthread_impl.h"
-#include "ticketlock.h"
+#include "hybridlock.h"
 
 #include "sgx_enclave_config.h"
 #include "sgx_hostcall_interface.h"
@@ -34,11 +34,21 @@ static size_t nthreads = 0;
 static uint8_t *freeslots;
 /* maps index into array of syscall slots S to lthread */
 static struct lthread **slotlthreads;
-static struct ticketlock slotslock;
+static struct hybridlock slotslock = HYBRIDLOCK_INITIALIZER("slotslock");
 
 struct mpmcq *__syscall_queue;
 struct mpmcq *__return_queue;
 
+static struct spscq *host_call_rings = NULL;
+static size_t num_host_call_rings = 0;
+static size_t next_host_call_ring = 0;
+
+#ifndef SGXLKL_HW
+/* In simulation mode there are no enclave exits, the enclave records the
+ * points at which it would exit in hardware mode itself. */
+static exit_prof_t *exit_prof = NULL;
+#endif
+
 void arena_new(Arena *a, size_t sz) {
     a->mem = host_syscall_SYS_mmap(0, sz, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
     if (a->mem < 0)
@@ -118,6 +128,11 @@ syscall_t *getsyscallslot(Arena **a) {
 int hostsyscallclient_init(enclave_config_t *encl) {
     always_sync = encl->wait_on_all_host_calls;
     exit_on_host_calls = encl->exit_on_host_calls;
+    host_call_rings = encl->host_call_rings;
+    num_host_call_rings = encl->num_host_call_rings;
+#ifndef SGXLKL_HW
+    exit_prof = encl->exit_prof;
+#endif
     S = encl->syscallpage;
     maxsyscalls = encl->maxsyscalls;
     slotlthreads = calloc(maxsyscalls, sizeof(*slotlthreads));
@@ -125,6 +140,25 @@ int hostsyscallclient_init(enclave_config_t *encl) {
     return 1;
 }
 
+/* Assigns a pair of dedicated host call rings to the calling ethread. Both are
+ * set to NULL if rings are disabled or all of them have been claimed. */
+void hostcall_rings_claim(struct spscq **syscall_ring, struct spscq **return_ring) {
+    size_t idx = __atomic_fetch_add(&next_host_call_ring, 1, __ATOMIC_SEQ_CST);
+    if (!host_call_rings || idx >= num_host_call_rings) {
+        *syscall_ring = NULL;
+        *return_ring = NULL;
+        return;
+    }
+    *syscall_ring = &host_call_rings[2 * idx];
+    *return_ring = &host_call_rings[2 * idx + 1];
+}
+
+void hostcall_may_block(void) {
+    struct lthread *lt = lthread_self();
+    if (lt)
+        lt->syscallflags |= SYSCALL_FLAG_MAY_BLOCK;
+}
+
 struct lthread *slottolthread(size_t s) {
     /* crash if trying to wake wrong lthread */
     if (s < maxsyscalls) {
@@ -134,10 +168,49 @@ struct lthread *slottolthread(size_t s) {
     return 0;
 }
 
+#ifndef SGXLKL_HW
+struct exit_prof_ring *exit_prof_sim_claim_ring(void) {
+    return exit_prof ? exit_prof_claim_ring(exit_prof) : NULL;
+}
+
+uint64_t exit_prof_sim_begin(void) {
+    return lthread_get_sched()->exit_prof_ring ? hostcall_tsc() : 0;
+}
+
+__attribute__((noinline))
+void exit_prof_sim_end(uint64_t reason, uint64_t arg, uint64_t start_tsc) {
+    exit_prof_ring_t *ring = lthread_get_sched()->exit_prof_ring;
+    if (ring && start_tsc)
+        exit_prof_add(ring, exit_prof->period, reason, arg, hostcall_tsc() - start_tsc,
+                      (uint64_t) __builtin_return_address(0));
+}
+#endif /* !SGXLKL_HW */
+
 static inline void submitsc(void *slot) {
+    union {size_t s; void *a;} u;
+    u.a = slot;
+    S[u.s].enqueue_tsc = hostcall_tsc();
     for(;!mpmc_enqueue(__syscall_queue, slot);){}
 }
 
+/* Submits a host call of a yielding lthread. Called on the scheduler of the
+ * current ethread, which is the only producer of its syscall ring. Falls back
+ * to the shared queue if the ring is full or not available. */
+static void submitsc_async(void *slot) {
+    struct lthread_sched *sch = lthread_get_sched();
+    struct spscq *ring = sch->syscall_ring;
+    union {size_t s; void *a;} u;
+    u.a = slot;
+    if (ring) {
+        S[u.s].enqueue_tsc = hostcall_tsc();
+        if (spsc_enqueue(ring, slot)) {
+            sch->ring_inflight++;
+            return;
+        }
+    }
+    submitsc(slot);
+}
+
 void threadswitch(syscall_t *sc) {
     /* can this be the same as current lthread? */
     /* post size_t inside void* field */
@@ -145,10 +218,20 @@ void threadswitch(syscall_t *sc) {
     union {size_t s; void *a;} slot;
     slot.s = sch->current_syscallslot;
     struct lthread *lt = sch->current_lthread;
+    /* syscallno is overwritten by the return value, remember it for stats */
+    size_t sysno = sc->syscallno;
+    int timed = lt && lt->stats && sysno < LTHREAD_STATS_MAX_SYSCALL;
+    uint64_t start_ns = timed ? lthread_stats_now() : 0;
+    if (lt) {
+        sc->flags = lt->syscallflags;
+        lt->syscallflags = 0;
+    } else {
+        sc->flags = 0;
+    }
     if (!always_sync && lt != NULL && !(lt->attr.state & BIT(LT_ST_PINNED)) ) {
         /* avoid race condition -- another worker can pick up this thread while it's running on
            current worker */
-        _lthread_yield_cb(lt, submitsc, slot.a);
+        _lthread_yield_cb(lt, submitsc_async, slot.a);
     } else {
         a_barrier();
         S[slot.s].status = 1;
@@ -170,6 +253,7 @@ void threadswitch(syscall_t *sc) {
         }
     }
 #else /* !SGXLKL_HW */
+        uint64_t exit_tsc = exit_on_host_calls ? exit_prof_sim_begin() : 0;
         /* syscall thread won't push anything into return queue if S[slot].status is 1, so there
            is no risk of race condition in this branch */
         submitsc(slot.a);
@@ -181,13 +265,18 @@ void threadswitch(syscall_t *sc) {
                Concurrency is hard. */
             a_spin();
         }
+        exit_prof_sim_end(SGXLKL_EXIT_SYSCALL, sysno, exit_tsc);
     }
 #endif
+    if (timed) {
+        lt->stats->hostcalls[sysno]++;
+        lt->stats->hostcall_ns[sysno] += lthread_stats_now() - start_ns;
+    }
 }
 
 size_t allocslot(struct lthread *lt) {
     size_t i;
-    ticket_lock(&slotslock);
+    hybrid_lock(&slotslock);
     while (nthreads >= maxsyscalls) {
         a_crash();
         /* sched_yield */
@@ -200,7 +289,7 @@ size_t allocslot(struct lthread *lt) {
             break;
         }
     }
-    ticket_unlock(&slotslock);
+    hybrid_unlock(&slotslock);
     return i;
 }
 
@@ -208,11 +297,11 @@ void freeslot(size_t slotno) {
     if (slotno > maxsyscalls) {
         return;
     }
-    ticket_lock(&slotslock);
+    hybrid_lock(&slotslock);
     slotlthreads[slotno] = 0;
     nthreads--;
     freeslots[slotno] = 0;
-    ticket_unlock(&slotslock);
+    hybrid_unlock(&slotslock);
 }
 
 /* Verifies host call return values of type ssize_t as used by the *write* and
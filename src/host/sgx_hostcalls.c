@@ -19,6 +19,7 @@
 #include <sys/mman.h>
 
 #include "atomic.h"
+#include "enclave_pager.h"
 #include "sgx_hostcall_interface.h"
 
 int host_syscall_SYS_close(int fd) {
@@ -37,10 +38,11 @@ int host_syscall_SYS_close(int fd) {
 int host_syscall_SYS_fstat(int fd, struct stat *buf) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len2;
     len2 = sizeof(*buf);
+    a = payload_arena(&payload, (syscall_t*) sc, a, len2);
     sc = arena_ensure(a, len2, (syscall_t*) sc);
     sc->syscallno = SYS_fstat;
     sc->arg1 = (uintptr_t)fd;
@@ -58,10 +60,11 @@ int host_syscall_SYS_fstat(int fd, struct stat *buf) {
 int host_syscall_SYS_poll(struct pollfd * fds, nfds_t nfds, int timeout) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len1;
     len1 = sizeof(*fds) * nfds;
+    a = payload_arena(&payload, (syscall_t*) sc, a, len1);
     sc = arena_ensure(a, len1, (syscall_t*) sc);
     sc->syscallno = SYS_poll;
     struct pollfd * val1;
@@ -94,7 +97,7 @@ int host_syscall_SYS_fdatasync(int fd) {
 int host_syscall_SYS_ioctl(int fd, unsigned long request, void * arg) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     void* val3 = arg;
     size_t len3 = 0;
     switch (request) {
@@ -130,6 +133,7 @@ int host_syscall_SYS_ioctl(int fd, unsigned long request, void * arg) {
     }
     sc = getsyscallslot(&a);
     if (len3 != 0) {
+        a = payload_arena(&payload, (syscall_t*) sc, a, len3);
         sc = arena_ensure(a, len3, (syscall_t*) sc);
         val3 = arena_alloc(a, len3);
         if (val3 != NULL && arg != NULL) memcpy(val3, arg, len3);
@@ -315,11 +319,29 @@ int host_syscall_SYS_mprotect(void * addr, size_t len, int prot) {
     return (int)__syscall_return_value;
 }
 
+int host_syscall_SYS_madvise(void * addr, size_t len, int advice) {
+    volatile syscall_t *sc;
+    volatile intptr_t __syscall_return_value;
+    Arena *a = NULL;
+    sc = getsyscallslot(&a);
+    sc->syscallno = SYS_madvise;
+    sc->arg1 = (uintptr_t)addr;
+    sc->arg2 = (uintptr_t)len;
+    sc->arg3 = (uintptr_t)advice;
+    threadswitch((syscall_t*) sc);
+    __syscall_return_value = (int)sc->ret_val;
+    sc->status = 0;
+    return (int)__syscall_return_value;
+}
+
 #ifndef SGXLKL_HW
 int host_syscall_SYS_rt_sigaction(int signum, struct sigaction * act, struct sigaction * oldact, unsigned long nsig) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
     Arena *a = NULL;
+    // SIGSEGV is handled by the enclave pager first if paging is enabled
+    if (signum == SIGSEGV && enclave_pager_sigaction((k_sigaction_t *) act, (k_sigaction_t *) oldact))
+        return 0;
     sc = getsyscallslot(&a);
     size_t len2;
     len2 = sizeof(k_sigaction_t);
@@ -374,12 +396,13 @@ int host_syscall_SYS_rt_sigpending(sigset_t * set, unsigned long nsig) {
 int host_syscall_SYS_rt_sigprocmask(int how, void * set, sigset_t * oldset, unsigned long nsig) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len2;
     len2 = nsig;
     size_t len3;
     len3 = nsig;
+    a = payload_arena(&payload, (syscall_t*) sc, a, len2 + len3);
     sc = arena_ensure(a, len2 + len3, (syscall_t*) sc);
     sc->syscallno = SYS_rt_sigprocmask;
     sc->arg1 = (uintptr_t)how;
@@ -480,12 +503,13 @@ int host_syscall_SYS_tkill(int tid, int sig) {
 int host_syscall_SYS_nanosleep(const struct timespec * req, struct timespec * rem) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len1;
     len1 = sizeof(*req);
     size_t len2;
     len2 = sizeof(*rem);
+    a = payload_arena(&payload, (syscall_t*) sc, a, len1 + len2);
     sc = arena_ensure(a, len1 + len2, (syscall_t*) sc);
     sc->syscallno = SYS_nanosleep;
     struct timespec * val1;
@@ -506,10 +530,11 @@ int host_syscall_SYS_nanosleep(const struct timespec * req, struct timespec * re
 int host_syscall_SYS_clock_getres(clockid_t clk_id, struct timespec * res) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len2;
     len2 = sizeof(*res);
+    a = payload_arena(&payload, (syscall_t*) sc, a, len2);
     sc = arena_ensure(a, len2, (syscall_t*) sc);
     sc->syscallno = SYS_clock_getres;
     sc->arg1 = (uintptr_t)clk_id;
@@ -527,10 +552,11 @@ int host_syscall_SYS_clock_getres(clockid_t clk_id, struct timespec * res) {
 int host_syscall_SYS_clock_gettime(clockid_t clk_id, struct timespec * tp) {
     volatile syscall_t *sc;
     volatile intptr_t __syscall_return_value;
-    Arena *a = NULL;
+    Arena *a = NULL, payload;
     sc = getsyscallslot(&a);
     size_t len2;
     len2 = sizeof(*tp);
+    a = payload_arena(&payload, (syscall_t*) sc, a, len2);
     sc = arena_ensure(a, len2, (syscall_t*) sc);
     sc->syscallno = SYS_clock_gettime;
     sc->arg1 = (uintptr_t)clk_id;
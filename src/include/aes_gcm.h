@@ -0,0 +1,36 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * AES-128-GCM using AES-NI and PCLMULQDQ, which every SGX-capable CPU
+ * provides. Used by the enclave itself, e.g. to seal pages that are evicted
+ * to untrusted memory, where no crypto library is available.
+ */
+
+#define AES_GCM_KEY_SIZE 16
+#define AES_GCM_IV_SIZE  12
+#define AES_GCM_TAG_SIZE 16
+
+typedef long long aes_gcm_block_t __attribute__((vector_size(16)));
+
+struct aes_gcm_ctx {
+    aes_gcm_block_t rk[11]; /* Round keys */
+    aes_gcm_block_t h;      /* Hash key, byte-reflected */
+};
+
+void aes_gcm_init(struct aes_gcm_ctx *ctx, const uint8_t key[AES_GCM_KEY_SIZE]);
+void aes_gcm_encrypt(const struct aes_gcm_ctx *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                     const void *in, void *out, size_t len, uint8_t tag[AES_GCM_TAG_SIZE]);
+/* Returns 0 if the tag is valid, -1 otherwise. in is read exactly once so that
+ * it can reside in untrusted memory. */
+int aes_gcm_decrypt(const struct aes_gcm_ctx *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                    const void *in, void *out, size_t len, const uint8_t tag[AES_GCM_TAG_SIZE]);
+
+#endif /* AES_GCM_H */
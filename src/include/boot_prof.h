@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef BOOT_PROF_H
+#define BOOT_PROF_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Boot phase profiler
+ *
+ * Phases of sgx-lkl-run and of the enclave boot are recorded in a single table
+ * in untrusted memory, which sgx-lkl-run writes to a JSON report on exit.
+ * Timestamps are CLOCK_MONOTONIC nanoseconds. The enclave only records phases
+ * if clock_gettime is served by the vDSO, so that both sides use the same
+ * clock and recording a phase does not cause host calls.
+ */
+
+#define BOOT_PROF_MAX_PHASES 64
+#define BOOT_PROF_NAME_LEN 32
+
+typedef struct boot_prof_phase {
+    char name[BOOT_PROF_NAME_LEN];
+    int enclave;            /* Recorded inside the enclave */
+    uint64_t start_ns;
+    uint64_t end_ns;        /* 0 while the phase is running */
+} boot_prof_phase_t;
+
+typedef struct boot_prof {
+    uint64_t start_ns;      /* Start of sgx-lkl-run */
+    volatile int num_phases;
+    boot_prof_phase_t phases[BOOT_PROF_MAX_PHASES];
+} boot_prof_t;
+
+static inline uint64_t boot_prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Starts a phase at start_ns. Returns its index, or -1 if prof is NULL or the
+ * table is full. */
+static inline int boot_prof_begin_at(boot_prof_t *prof, const char *name, int enclave, uint64_t start_ns) {
+    if (!prof)
+        return -1;
+
+    /* The host can modify the table at any time, check the index after
+     * claiming it. */
+    int idx = __atomic_fetch_add(&prof->num_phases, 1, __ATOMIC_SEQ_CST);
+    if (idx < 0 || idx >= BOOT_PROF_MAX_PHASES)
+        return -1;
+
+    boot_prof_phase_t *phase = &prof->phases[idx];
+    strncpy(phase->name, name, BOOT_PROF_NAME_LEN - 1);
+    phase->name[BOOT_PROF_NAME_LEN - 1] = 0;
+    phase->enclave = enclave;
+    phase->start_ns = start_ns;
+    return idx;
+}
+
+static inline int boot_prof_begin(boot_prof_t *prof, const char *name, int enclave) {
+    return boot_prof_begin_at(prof, name, enclave, boot_prof_now());
+}
+
+static inline void boot_prof_end(boot_prof_t *prof, int idx) {
+    if (prof && idx >= 0 && idx < BOOT_PROF_MAX_PHASES)
+        __atomic_store_n(&prof->phases[idx].end_ns, boot_prof_now(), __ATOMIC_RELEASE);
+}
+
+#endif /* BOOT_PROF_H */
@@ -10,6 +10,8 @@
 #define ENCLAVE_MMAP_FILES_SHARED  2
 
 void enclave_mman_init(void *base, size_t num_pages, int _mmap_files);
+void enclave_mman_range(void **base, void **end);
+void enclave_mman_huge_pages(void);
 void* enclave_mmap(void *addr, size_t length, int mmap_fixed);
 int enclave_munmap(void *addr, size_t length);
 void* enclave_mremap(void *old_addr, size_t old_length, void *new_addr, size_t new_length, int mremap_fixed);
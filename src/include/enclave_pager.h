@@ -0,0 +1,68 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef ENCLAVE_PAGER_H
+#define ENCLAVE_PAGER_H
+
+#include <stddef.h>
+
+#include "sgx_enclave_config.h"
+
+/*
+ * Enclave-managed paging of anonymous memory
+ *
+ * Anonymous read/write mappings are divided into fixed-size chunks
+ * (SGXLKL_PAGER_CHUNK_SIZE). Cold chunks are encrypted with AES-GCM and
+ * evicted to untrusted host memory (SGXLKL_PAGER_SWAP_SIZE), after which their
+ * pages are inaccessible. The first access to an evicted chunk causes a
+ * SIGSEGV, upon which the chunk is decrypted, verified and made accessible
+ * again. Each eviction uses a fresh IV derived from the chunk index and a
+ * per-chunk version counter, and the authentication tags never leave the
+ * enclave, so that the host cannot replay or swap evicted chunks.
+ *
+ * Chunks are evicted when requested by the application via
+ * madvise(MADV_PAGEOUT/MADV_COLD), and, if SGXLKL_PAGER_RESIDENT_SIZE is set,
+ * in clock order whenever the amount of resident pageable memory exceeds the
+ * limit. madvise(MADV_WILLNEED) pages chunks in ahead of time.
+ *
+ * Only chunks that are completely covered by a single anonymous read/write
+ * mapping are paged. Stacks (MAP_STACK/MAP_GROWSDOWN) and chunks whose
+ * protection is changed are never paged.
+ *
+ * Paging is experimental and only supported in simulation mode. In hardware
+ * mode, the EPC pages of evicted chunks would remain committed on SGX1, and
+ * every protection change would require an enclave exit. It relies on the libc
+ * routing SYS_mprotect and SYS_madvise to syscall_SYS_mprotect and
+ * syscall_SYS_madvise.
+ */
+
+#ifdef SGXLKL_HW
+static inline void enclave_pager_init(enclave_config_t *encl) {}
+static inline void enclave_pager_map(void *addr, size_t len, int prot, int flags) {}
+static inline void enclave_pager_unmap(void *addr, size_t len) {}
+static inline void enclave_pager_protect(void *addr, size_t len, int prot) {}
+static inline int enclave_pager_advise(void *addr, size_t len, int advice) { return 0; }
+#else
+void enclave_pager_init(enclave_config_t *encl);
+
+/* Registers a new anonymous mapping */
+void enclave_pager_map(void *addr, size_t len, int prot, int flags);
+/* Discards paging state of a range that is unmapped or replaced */
+void enclave_pager_unmap(void *addr, size_t len);
+/* Pages in a range and stops paging it if prot is not read/write */
+void enclave_pager_protect(void *addr, size_t len, int prot);
+/* Applies a madvise hint, returns 0 on success or a negative errno */
+int enclave_pager_advise(void *addr, size_t len, int advice);
+
+/* Handles a fault at addr. Returns 0 if the faulting access can be retried,
+ * -1 if the fault is not related to paging. */
+int enclave_pager_fault(void *addr);
+
+struct k_sigaction;
+/* Interposes on SIGSEGV handler registrations of the application while the
+ * pager's own handler is installed. Returns 0 if the pager is disabled. */
+int enclave_pager_sigaction(const struct k_sigaction *act, struct k_sigaction *oldact);
+#endif /* SGXLKL_HW */
+
+#endif /* ENCLAVE_PAGER_H */
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef EXIT_PROF_H
+#define EXIT_PROF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Enclave exit profiler
+ *
+ * Every enclave thread owns a ring buffer of exit records that lives in
+ * untrusted memory. There is a single writer per ring (the host thread
+ * driving the enclave thread in hardware mode, or the enclave thread itself
+ * in simulation mode), so records are added without locks. When a ring is
+ * full the oldest records are overwritten; the per-reason totals are always
+ * complete.
+ */
+
+/* Records per ring, must be a power of 2 */
+#define EXIT_PROF_RING_SIZE 16384
+#define EXIT_PROF_MAX_REASON 16
+
+/* Pseudo exit reason for asynchronous exits forwarded as signals. Regular
+ * exit reasons are the SGXLKL_EXIT_* values. */
+#define EXIT_PROF_REASON_SIGNAL (EXIT_PROF_MAX_REASON - 1)
+
+typedef struct exit_prof_record {
+    uint64_t reason;    /* SGXLKL_EXIT_* or EXIT_PROF_REASON_SIGNAL */
+    uint64_t arg;       /* Syscall number (SYSCALL), sleep time in ns (SLEEP),
+                           CPUID leaf (CPUID) or signal number (signals) */
+    uint64_t cycles;    /* TSC cycles spent outside the enclave */
+    uint64_t ret_addr;  /* In-enclave return address, 0 if unknown */
+} exit_prof_record_t;
+
+typedef struct exit_prof_ring {
+    volatile uint64_t head;                 /* Total number of sampled exits */
+    uint64_t seen;                          /* Total number of exits */
+    uint64_t count[EXIT_PROF_MAX_REASON];
+    uint64_t cycles[EXIT_PROF_MAX_REASON];
+    exit_prof_record_t recs[EXIT_PROF_RING_SIZE];
+} exit_prof_ring_t;
+
+typedef struct exit_prof {
+    uint64_t period;            /* Sample every period-th exit */
+    size_t num_rings;
+    volatile int next_ring;     /* Next unclaimed ring */
+    exit_prof_ring_t *rings;
+} exit_prof_t;
+
+/* Claims a ring for the calling thread. Returns NULL if none is left. */
+static inline exit_prof_ring_t *exit_prof_claim_ring(exit_prof_t *prof) {
+    int idx = __atomic_fetch_add(&prof->next_ring, 1, __ATOMIC_SEQ_CST);
+    return idx < prof->num_rings ? &prof->rings[idx] : NULL;
+}
+
+static inline void exit_prof_add(exit_prof_ring_t *ring, uint64_t period,
+                                 uint64_t reason, uint64_t arg,
+                                 uint64_t cycles, uint64_t ret_addr) {
+    if (reason >= EXIT_PROF_MAX_REASON)
+        reason = EXIT_PROF_MAX_REASON - 1;
+    ring->count[reason]++;
+    ring->cycles[reason] += cycles;
+
+    if (ring->seen++ % period)
+        return;
+
+    exit_prof_record_t *rec = &ring->recs[ring->head & (EXIT_PROF_RING_SIZE - 1)];
+    rec->reason = reason;
+    rec->arg = arg;
+    rec->cycles = cycles;
+    rec->ret_addr = ret_addr;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* EXIT_PROF_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef HYBRIDLOCK_H
+#define HYBRIDLOCK_H
+
+#include <stdint.h>
+
+#include "atomic.h"
+
+/*
+ * Lthread-aware queue lock
+ *
+ * Waiters queue up in FIFO order as in an MCS lock (K42 variant, so that only
+ * waiters need a queue node) and each of them spins on its own node. A waiting
+ * lthread spins for HYBRIDLOCK_SPINS iterations and then yields to the
+ * scheduler until the lock is handed to it, so that a lock holder that is
+ * descheduled or waits for a host call does not keep other ethreads busy.
+ * Waiters that are not lthreads (scheduler context) or are pinned always spin.
+ *
+ * Build with LOCK_STATS=true to collect per-lock acquisition, contention and
+ * hold time statistics, which are printed on exit.
+ */
+
+#define HYBRIDLOCK_SPINS 1000
+
+struct hybridlock_node {
+    struct hybridlock_node *volatile next;
+    volatile int state;
+    struct lthread *lt;
+};
+
+#ifdef SGXLKL_LOCK_STATS
+struct hybridlock_stats {
+    const char *name;
+    struct hybridlock *next_lock; /* List of all locks that have been used */
+    volatile int registered;
+    uint64_t acquired;
+    uint64_t contended;
+    uint64_t parked;
+    uint64_t hold_cycles;
+    uint64_t max_hold_cycles;
+    uint64_t acquire_tsc;
+};
+#endif /* SGXLKL_LOCK_STATS */
+
+struct hybridlock {
+    /* Head of the waiter queue, handed the lock on release */
+    struct hybridlock_node *volatile next;
+    /* Last waiter, the lock itself if held without waiters, NULL if free */
+    struct hybridlock_node *volatile tail;
+#if DEBUG
+    struct lthread *lt; // Thread that is holding the lock.
+#endif /* DEBUG */
+#ifdef SGXLKL_LOCK_STATS
+    struct hybridlock_stats stats;
+#endif /* SGXLKL_LOCK_STATS */
+};
+
+#ifdef SGXLKL_LOCK_STATS
+#define HYBRIDLOCK_INITIALIZER(n) { .stats = { .name = (n) } }
+#else
+#define HYBRIDLOCK_INITIALIZER(n) { 0 }
+#endif /* SGXLKL_LOCK_STATS */
+
+void hybrid_lock(struct hybridlock *l);
+void hybrid_unlock(struct hybridlock *l);
+int hybrid_trylock(struct hybridlock *l);
+
+#ifdef SGXLKL_LOCK_STATS
+void hybrid_lock_stats_print(void);
+#endif /* SGXLKL_LOCK_STATS */
+
+#endif /* HYBRIDLOCK_H */
@@ -10,5 +10,10 @@
 extern struct lkl_dev_blk_ops sgxlkl_dev_plaintext_blk_ops;
 extern struct lkl_dev_blk_ops sgxlkl_dev_cipher_blk_ops;
 
+struct enclave_disk_config;
+
+/* Starts reading ahead the prefetch extents of a read-only disk, if any */
+void sgxlkl_disk_prefetch_start(struct enclave_disk_config *disk);
+
 #endif
 
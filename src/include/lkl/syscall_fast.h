@@ -0,0 +1,23 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef _LKL_SYSCALL_FAST_H
+#define _LKL_SYSCALL_FAST_H
+
+#include "sgx_enclave_config.h"
+
+/* Enables the fast paths once LKL has been started */
+void syscall_fast_init(enclave_config_t *encl);
+
+/*
+ * Services trivial system calls inside the enclave without entering LKL. n is
+ * the LKL system call number. Returns 1 and stores the result in *ret if the
+ * call has been handled, or 0 if it must be passed on to LKL.
+ */
+int syscall_fast(long n, long params[6], long *ret);
+
+/* Replaces lkl_syscall at link time (--wrap=lkl_syscall) */
+long __wrap_lkl_syscall(long n, long *params);
+
+#endif /* _LKL_SYSCALL_FAST_H */
@@ -50,6 +50,16 @@
 #define CLOCK_LTHREAD CLOCK_REALTIME
 
 struct mpmcq __scheduler_queue;
+/* Runnable lthreads of the LTHREAD_PRIO_KERNEL class */
+struct mpmcq __scheduler_queue_prio;
+
+/* Scheduling classes. Runnable lthreads of the kernel class (LKL kernel, I/O
+ * and timer threads) are always scheduled before application threads, up to
+ * LTHREAD_PRIO_BURST times in a row per ethread while application threads are
+ * waiting. */
+#define LTHREAD_PRIO_NORMAL 0
+#define LTHREAD_PRIO_KERNEL 1
+#define LTHREAD_PRIO_BURST  16
 
 typedef void *(*lthread_func)(void *);
 
@@ -62,7 +72,9 @@ struct cpu_ctx {
     void     *ebx;
     void     *r1;
     void     *r2;
-    void     *r3;
+    uint32_t mxcsr;     /* SSE control/status register */
+    uint16_t fpucw;     /* x87 control word */
+    uint16_t pad;
     void     *r4;
     void     *r5;
 };
@@ -117,19 +129,49 @@ struct futex_q {
     uint64_t futex_deadline;
     clock_t clock;
     struct lthread *futex_lt;
+    uint32_t futex_flags;       /* FUTEX_Q_* flags, see futex.c */
+    uint32_t futex_requeue_key; /* PI futex of a FUTEX_WAIT_REQUEUE_PI waiter */
 
     SLIST_ENTRY(futex_q) entries;
 };
 
+/* Upper bound (exclusive) on syscall numbers tracked per lthread */
+#define LTHREAD_STATS_MAX_SYSCALL 512
+
+/*
+ * Per-lthread CPU and host call accounting. Only allocated if thread
+ * statistics have been enabled (see lthread_stats_enable) before the lthread
+ * was created. All times are in nanoseconds.
+ */
+struct lthread_stats {
+    struct lthread *lt;
+    uint64_t run_ns;                                    /* time spent running */
+    uint64_t resumes;                                   /* num of resumes */
+    uint64_t hostcalls[LTHREAD_STATS_MAX_SYSCALL];      /* host calls by syscall number */
+    uint64_t hostcall_ns[LTHREAD_STATS_MAX_SYSCALL];    /* time spent waiting on host calls */
+    SLIST_ENTRY(lthread_stats) entries;
+};
+
+/* Snapshot of the statistics of a single lthread */
+struct lthread_stats_entry {
+    int tid;
+    char funcname[64];
+    struct lthread_stats stats;
+};
+
 struct lthread {
     struct cpu_ctx          ctx;            /* cpu ctx info */
     lthread_func            fun;            /* func lthread is running */
     void                    *arg;           /* func args passed to func */
     size_t                  syscall;        /* slot for syscalls */
     Arena                   syscallarena;   /* syscall buffer arena */
+    uintptr_t               syscallflags;   /* flags for next syscall */
+    int                     prio;           /* LTHREAD_PRIO_* */
     struct lthread_attr     attr;           /* various attributes */
     struct __ptcb           *cancelbuf;     /* cancellation buffer */
     int                     tid;            /* lthread id */
+    long                    lkl_tid;        /* cached LKL thread id, 0 if unknown */
+    int                     in_fast_clock;  /* in clock_gettime fast path */
     char                    funcname[64];   /* optional func name */
     struct lthread          *lt_join;       /* lthread we want to join on */
     void                    **lt_exit_ptr;  /* exit ptr for lthread_join */
@@ -152,6 +194,7 @@ struct lthread {
     void                    (*yield_cb)(void*);
     void                    *yield_cbarg;
     struct futex_q fq;
+    struct lthread_stats    *stats;         /* NULL if stats are disabled */
     struct {
         volatile void *volatile head;
         long off;
@@ -181,6 +224,11 @@ struct lthread_sched {
     struct lthread      *current_lthread;
     size_t              current_syscallslot;
     Arena               *current_arena;
+    struct exit_prof_ring *exit_prof_ring; /* Simulation mode only */
+    /* Dedicated host call rings of this ethread, NULL if not used */
+    struct spscq        *syscall_ring;
+    struct spscq        *return_ring;
+    size_t              ring_inflight;  /* Host calls pending on the rings */
 };
 
 typedef struct lthread *lthread_t;
@@ -189,6 +237,9 @@ extern "C" {
 #endif
 
     void    lthread_sched_global_init(size_t sleepspins, size_t sleeptime_ns, size_t futex_wake_spins);
+    void    lthread_park_enable(ethread_park_t *park, size_t nethreads, size_t min_active, size_t wake_threshold);
+    void    _lthread_schedqueue_inc(void);
+    void    __schedqueue_inc(void);
     int     lthread_create(struct lthread **new_lt, struct lthread_attr *attrp, void *lthread_func, void *arg);
     void    lthread_cancel(struct lthread *lt);
     void    lthread_run(void);
@@ -201,14 +252,27 @@ extern "C" {
     int     lthread_init(size_t size);
     struct lthread *lthread_current();
     void    lthread_set_funcname(struct lthread *lt, const char *f);
+    void    lthread_set_prio(struct lthread *lt, int prio);
     uint64_t lthread_id();
     struct lthread* lthread_self(void);
     int     lthread_setcancelstate(int, int*);
     void    lthread_set_expired(struct lthread *lt);
+    void    lthread_stats_enable(void);
+    int     lthread_stats_enabled(void);
+    int     lthread_stats_collect(struct lthread_stats_entry **entries, size_t *n);
+
+    static inline uint64_t lthread_stats_now(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
 
     static inline void __scheduler_enqueue(struct lthread *lt) {
         if (!lt) {a_crash();}
-        for (;!mpmc_enqueue(&__scheduler_queue, lt);) a_spin();
+        /* Fall back to the regular queue if the priority queue is full */
+        if (lt->prio == LTHREAD_PRIO_NORMAL || !mpmc_enqueue(&__scheduler_queue_prio, lt))
+            for (;!mpmc_enqueue(&__scheduler_queue, lt);) a_spin();
+        _lthread_schedqueue_inc();
     }
 
 #ifdef __cplusplus
@@ -6,6 +6,9 @@
 #include <stdlib.h>
 #include <elf.h>
 #include "mpmc_queue.h"
+#include "spsc_queue.h"
+#include "boot_prof.h"
+#include "exit_prof.h"
 #include "time.h"
 
 #ifdef SGXLKL_HW
@@ -19,6 +22,22 @@
 #define SGXLKL_HW_MODE  0
 #define SGXLKL_SIM_MODE 1
 
+/* Size of the inline argument area of a syscall slot. Chosen so that a slot
+ * spans exactly four cache lines. */
+#define SYSCALL_PAYLOAD_SIZE 176
+
+/* Host call may block for a long time, e.g. wait on a file descriptor without
+ * timeout. Such calls are executed by a separate pool of host threads so that
+ * they do not stall other host calls. */
+#define SYSCALL_FLAG_MAY_BLOCK 1
+
+/* Size of the huge pages that back enclave memory in simulation mode if
+ * SGXLKL_HUGEPAGES is set. Large mappings are aligned to it. */
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* Memory of the LKL kernel unless configured explicitly */
+#define KERNEL_MEM_DEFAULT (32UL * 1024 * 1024)
+
 typedef struct {
     uintptr_t arg1;
     uintptr_t arg2;
@@ -31,11 +50,42 @@ typedef struct {
         uintptr_t ret_val; // Set at response time
     };
     uintptr_t status;
+    uint64_t enqueue_tsc; // TSC at submission time, 0 if unavailable
+    uintptr_t flags; // SYSCALL_FLAG_* set by the enclave at request time
+    // Inline storage for small marshalled host call arguments
+    unsigned char payload[SYSCALL_PAYLOAD_SIZE] __attribute__((aligned(8)));
 } syscall_t __attribute__((aligned(64)));
 
+/* CPUID leaf as reported by the host. The subleaf is only relevant for leaves
+ * with CPUID_LEAF_INDEXED set. */
+#define CPUID_CACHE_MAX_LEAVES 256
+#define CPUID_LEAF_INDEXED 1
+
+typedef struct {
+    uint32_t leaf;
+    uint32_t subleaf;
+    uint32_t flags;
+    uint32_t regs[4]; /* eax, ebx, ecx, edx */
+} cpuid_leaf_t;
+
+/* TSC calibration provided by the host. Lets the enclave derive TSC values
+ * for internal timestamps from the vDSO monotonic clock without leaving the
+ * enclave. */
+typedef struct {
+    uint64_t tsc_ref;       /* TSC at ns_ref */
+    uint64_t ns_ref;        /* CLOCK_MONOTONIC time in ns */
+    uint64_t cycles_per_ns; /* 32.32 fixed point, 0 if not calibrated */
+} tsc_info_t;
+
 /* Maximum path length of mount points for secondary disks */
 #define SGXLKL_DISK_MNT_MAX_PATH_LEN 255
 
+/* Byte range of a disk image */
+typedef struct enclave_disk_extent {
+    uint64_t offset;
+    uint64_t len;
+} enclave_disk_extent_t;
+
 typedef struct enclave_disk_config {
     /* Provided by sgx-lkl-run at runtime. */
     int fd;
@@ -49,10 +99,17 @@ typedef struct enclave_disk_config {
     int ro;                 // Read-only?
     char *key;              // Encryption key
     size_t key_len;         // Key length
+    int volume_key;         // Key is the raw volume key, not a passphrase
     char *roothash;         // Root hash (for dm-verity)
     size_t roothash_offset; // Merkle tree offset (for dm-verity)
+    size_t verity_block_size; // dm-verity block size, 0 if unspecified
+    /* Provided by sgx-lkl-run for read-only disks with a prefetch file. */
+    enclave_disk_extent_t *prefetch; // Extents to read ahead, in access order
+    size_t num_prefetch;
+    size_t prefetch_window; // Max. bytes of prefetched data held at a time
     /* Used at runtime */
     int mounted;            // Has been mounted
+    struct disk_prefetch *prefetch_state;
     int wait_on_io; // SGX-LKL: Set to 1 to busy wait for I/O request to finish
                     // rather than yield.
 } enclave_disk_config_t;
@@ -80,6 +137,14 @@ typedef struct attestation_info {
 } attestation_info_t;
 #endif
 
+/* Host futex on which idle ethreads park (see SGXLKL_ETHREADS_MIN). The
+ * enclave bumps futex before requesting a wakeup by setting wake, the host
+ * syscall threads then wake a single parked ethread. */
+typedef struct {
+    volatile int futex;
+    volatile int wake;
+} ethread_park_t;
+
 /* Untrusted config provided by the user */
 typedef struct enclave_config {
     void *syscallpage;
@@ -90,9 +155,18 @@ typedef struct enclave_config {
     size_t stacksize;
     struct mpmcq *syscallq;
     struct mpmcq *returnq;
+    /* Dedicated host call rings, a submission and a completion queue per
+     * ethread (NULL if disabled) */
+    struct spscq *host_call_rings;
+    size_t num_host_call_rings;
     size_t num_disks;
     enclave_disk_config_t *disks; /* Array of disk configurations, length = num_disks */
+    size_t kernel_mem; /* Memory reserved for the LKL kernel, 0 = derived from the heap size */
+    int fast_syscalls; /* Answer trivial syscalls in the enclave without entering LKL */
+    size_t verity_cache_size; /* Size of the cache of verified dm-verity hash blocks, 0 = kernel default */
+    size_t disk_crypto_threads; /* Threads for asynchronous disk encryption, 0 = synchronous */
     int mmap_files; /* ENCLAVE_MMAP_FILES_{NONE, SHARED, or PRIVATE} */
+    int huge_pages; /* Heap is backed by huge pages (simulation mode only) */
     int net_fd;
     int net_pipe_fds[2]; /* Used by virtio net backend to cause POLLHUP */
     struct in_addr net_ip4;
@@ -111,9 +185,20 @@ typedef struct enclave_config {
     void *(*ifn)(struct enclave_config *);
     size_t espins;
     size_t esleep;
+    size_t ethreads;
+    /* Parking of idle ethreads, NULL if all ethreads stay active */
+    ethread_park_t *ethread_park;
+    size_t ethreads_min;
+    size_t ethreads_wake_threshold;
     long sysconf_nproc_conf;
     long sysconf_nproc_onln;
     struct timespec clock_res[8];
+    /* Untrusted backing store for chunks evicted by the enclave pager (NULL
+     * if paging is disabled) */
+    void *pager_swap;
+    size_t pager_swap_size;
+    size_t pager_chunk_size;
+    size_t pager_resident_size;
     void *shm_common;
     void *shm_enc_to_out;
     void *shm_out_to_enc;
@@ -139,6 +224,9 @@ typedef struct enclave_config {
      * generated report. */
     attestation_info_t *att_info;
     uint64_t report_nonce;
+    cpuid_leaf_t *cpuid_cache; /* Copied into the enclave at startup */
+    size_t cpuid_cache_len;
+    tsc_info_t tsc_info;
 #else
     void (*sim_exit_handler) (int);
 #endif
@@ -146,6 +234,9 @@ typedef struct enclave_config {
     int wait_on_io_host_calls;
     int wait_on_all_host_calls;
     int exit_on_host_calls;
+    int thread_stats; /* Record per-lthread run time/host call statistics */
+    exit_prof_t *exit_prof; /* Enclave exit profiler, NULL if disabled */
+    boot_prof_t *boot_prof; /* Boot phase profiler, NULL if disabled */
 } enclave_config_t;
 
 enum SlotState { DONE, WRITTEN };
@@ -207,6 +298,7 @@ typedef enum { ACTIVE = 0, OUTSIDE = 1, UNUSED = 2, AVAILABLE = 3 } thread_state
 #define SGXLKL_EXIT_CPUID              4
 #define SGXLKL_EXIT_DORESUME           5
 #define SGXLKL_EXIT_REPORT             6
+#define SGXLKL_EXIT_PARK               7
 
 /* Error codes */
 #define SGXLKL_UNEXPECTED_CALLID       1
@@ -255,6 +347,8 @@ void     set_eh_handling(uint64_t val);
 
 void ecall_cpuid(gprsgx_t *regs);
 void ecall_rdtsc(gprsgx_t *regs, uint64_t ts);
+void enclave_rdtsc_enable(void);
+uint64_t enclave_rdtsc(void);
 
 void ereport(void *target, char *report_data, char *report);
 
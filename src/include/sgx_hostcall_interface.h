@@ -15,12 +15,29 @@ struct Arena
 typedef struct Arena Arena;
 
 int hostsyscallclient_init(enclave_config_t *encl);
+void hostcall_rings_claim(struct spscq **syscall_ring, struct spscq **return_ring);
 syscall_t *getsyscallslot(Arena **a);
 size_t allocslot(struct lthread *lt);
 void freeslot(size_t slotno);
 void threadswitch(syscall_t *sc);
 struct lthread *slottolthread(size_t s);
 
+/* Marks the next host call of the calling lthread as potentially blocking for
+ * a long time (see SYSCALL_FLAG_MAY_BLOCK). Only needed for calls that the
+ * host cannot classify by their system call number and arguments alone. */
+void hostcall_may_block(void);
+
+/* Returns an arena backed by the payload area of the syscall slot if sz bytes
+ * of host call arguments fit into it, and a otherwise. */
+static inline Arena *payload_arena(Arena *payload, syscall_t *sc, Arena *a, size_t sz) {
+    if (sz > SYSCALL_PAYLOAD_SIZE)
+        return a;
+    payload->mem = sc->payload;
+    payload->size = SYSCALL_PAYLOAD_SIZE;
+    payload->allocated = 0;
+    return payload;
+}
+
 void arena_new(Arena *, size_t);
 syscall_t *arena_ensure(Arena *, size_t, syscall_t *);
 void *arena_alloc(Arena *, size_t);
@@ -33,5 +50,26 @@ void deepcopyiovec(struct iovec *dst, const struct iovec *src);
 
 void verify_ssize_ret(ssize_t ret, size_t count);
 
+/* TSC value used to measure host call queueing times on the host side and
+ * lock hold times */
+static inline uint64_t hostcall_tsc(void) {
+#ifdef SGXLKL_HW
+    /* RDTSC causes an enclave exit on SGX1, use the estimated TSC (0 if
+     * unavailable) */
+    return enclave_rdtsc();
+#else
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+#ifndef SGXLKL_HW
+/* Exit profiling in simulation mode, see exit_prof.h */
+struct exit_prof_ring *exit_prof_sim_claim_ring(void);
+uint64_t exit_prof_sim_begin(void);
+void exit_prof_sim_end(uint64_t reason, uint64_t arg, uint64_t start_tsc);
+#endif
+
 #endif /* SGX_HOSTCALL_INTERFACE_H */
 
@@ -28,6 +28,7 @@ pid_t host_syscall_SYS_gettid(void);
 int host_syscall_SYS_ioctl(int fd, unsigned long request, void *arg);
 void *host_syscall_SYS_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 int host_syscall_SYS_mprotect(void *addr, size_t len, int prot);
+int host_syscall_SYS_madvise(void *addr, size_t len, int advice);
 void *host_syscall_SYS_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address);
 int host_syscall_SYS_munmap(void *addr, size_t length);
 int host_syscall_SYS_msync(void *addr, size_t length, int flags);
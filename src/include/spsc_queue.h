@@ -0,0 +1,41 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+
+/*
+ * Bounded single-producer/single-consumer queue.
+ *
+ * Used for dedicated host call rings between one enclave thread and one host
+ * syscall thread. Every cell occupies its own cache line so that producer and
+ * consumer do not false-share neighbouring cells, and each side caches the
+ * other side's position to avoid touching its cache line on every operation.
+ * The capacity is a compile-time constant so that a queue in untrusted memory
+ * cannot make the enclave write outside of it.
+ */
+
+#define SPSCQ_SIZE 64 /* Must be a power of 2 */
+
+struct spsc_cell {
+    void *data;
+} __attribute__((aligned(64)));
+
+struct spscq {
+    size_t head;        /* Next cell to dequeue, written by the consumer */
+    size_t tail_cache;  /* Consumer's copy of tail */
+    char pad0[48];
+    size_t tail;        /* Next cell to enqueue, written by the producer */
+    size_t head_cache;  /* Producer's copy of head */
+    char pad1[48];
+    struct spsc_cell cells[SPSCQ_SIZE];
+} __attribute__((aligned(64)));
+
+void newspscq(struct spscq *q);
+int spsc_enqueue(struct spscq *q, void *data);
+int spsc_dequeue(struct spscq *q, void **data);
+
+#endif /* SPSC_QUEUE_H */
@@ -2,12 +2,16 @@
  * Copyright 2016, 2017, 2018 Imperial College London
  */
 #include "lkl/disk.h"
+#include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "syscall.h"
 
 #include "sgx_enclave_config.h"
+#include "sgxlkl_debug.h"
 #include "sgxlkl_util.h"
 
 extern size_t num_disks;
@@ -32,6 +36,258 @@ static int fd_get_capacity(struct lkl_disk disk, unsigned long long *res) {
     return -1;
 }
 
+/*
+ * Boot-time prefetching
+ *
+ * sgx-lkl-run passes the extents listed in the prefetch file of a read-only
+ * disk image (see 'sgx-lkl-disk prefetch'). A prefetch lthread reads them in
+ * the recorded access order with one large host read per extent, ahead of
+ * the application. Reads that fall entirely within a prefetched extent are
+ * then served from enclave memory instead of causing a host call each. This
+ * is raw disk data, which dm-verity/dm-crypt check and decrypt as usual.
+ *
+ * At most prefetch_window bytes are held at a time. An extent is freed once
+ * all of it has been read, or once reads have moved on to extents much later
+ * in the access order. Prefetching stops and all loaded extents are freed
+ * once no read has been served from them for PREFETCH_IDLE_TIMEOUT seconds,
+ * e.g. because the image has changed since the prefetch file was recorded.
+ */
+
+#define PREFETCH_MAX_EXTENT (16 * 1024 * 1024)
+/* Loaded extents this far before the latest extent that was read from are
+ * freed */
+#define PREFETCH_MAX_LAG 64
+/* Seconds without a prefetch hit after which prefetching is stopped */
+#define PREFETCH_IDLE_TIMEOUT 10
+
+enum prefetch_state {
+    PREFETCH_PENDING,
+    PREFETCH_LOADING,
+    PREFETCH_LOADED,
+    PREFETCH_DONE,
+};
+
+struct prefetch_extent {
+    uint64_t offset;
+    uint64_t len;
+    char *data;
+    uint64_t served;            // Bytes read from data so far
+    enum prefetch_state state;
+};
+
+struct disk_prefetch {
+    int fd;
+    size_t num_extents;
+    struct prefetch_extent *extents;    // In access order
+    struct prefetch_extent **sorted;    // Sorted by offset
+    size_t window;
+    size_t loaded;                      // Bytes of loaded extents
+    size_t stale;                       // Extents before this are not needed anymore
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void prefetch_free(struct disk_prefetch *pf, struct prefetch_extent *e) {
+    free(e->data);
+    e->data = NULL;
+    e->state = PREFETCH_DONE;
+    pf->loaded -= e->len;
+    pthread_cond_signal(&pf->cond);
+}
+
+/* Drops all loaded extents and stops prefetching. Called with pf->lock
+ * held by the prefetch thread, so no extent is being loaded. */
+static void prefetch_stop(struct disk_prefetch *pf) {
+    for (size_t i = 0; i < pf->num_extents; i++) {
+        if (pf->extents[i].state == PREFETCH_LOADED)
+            prefetch_free(pf, &pf->extents[i]);
+    }
+    pf->stale = pf->num_extents;
+}
+
+/* Waits on pf->cond with pf->lock held. Every read served from prefetched
+ * data signals pf->cond, so a timeout means prefetching is idle. Returns 1 in
+ * that case. */
+static int prefetch_wait(struct disk_prefetch *pf) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += PREFETCH_IDLE_TIMEOUT;
+    return pthread_cond_timedwait(&pf->cond, &pf->lock, &deadline) == ETIMEDOUT;
+}
+
+static int prefetch_read_extent(int fd, char *addr, size_t len, off_t off) {
+    while (len > 0) {
+        ssize_t ret = host_syscall_SYS_pread64(fd, addr, len, off);
+        if (ret <= 0)
+            return -1;
+        addr += ret;
+        len -= ret;
+        off += ret;
+    }
+    return 0;
+}
+
+static void *prefetch_thread(void *arg) {
+    struct disk_prefetch *pf = arg;
+    size_t num_loaded = 0, bytes_loaded = 0;
+
+    for (size_t i = 0; i < pf->num_extents; i++) {
+        struct prefetch_extent *e = &pf->extents[i];
+
+        pthread_mutex_lock(&pf->lock);
+        while (pf->loaded && pf->loaded + e->len > pf->window && i >= pf->stale) {
+            if (prefetch_wait(pf))
+                prefetch_stop(pf);
+        }
+        // Skip extents that are not needed anymore
+        if (i < pf->stale) {
+            e->state = PREFETCH_DONE;
+            pthread_mutex_unlock(&pf->lock);
+            continue;
+        }
+        e->state = PREFETCH_LOADING;
+        pf->loaded += e->len;
+        pthread_mutex_unlock(&pf->lock);
+
+        char *data = malloc(e->len);
+        int err = !data || prefetch_read_extent(pf->fd, data, e->len, e->offset);
+
+        pthread_mutex_lock(&pf->lock);
+        // Extents that became stale while being loaded are dropped right away,
+        // as prefetch_copy only frees loaded extents
+        if (!err && i >= pf->stale) {
+            e->data = data;
+            e->state = PREFETCH_LOADED;
+            num_loaded++;
+            bytes_loaded += e->len;
+        } else {
+            free(data);
+            e->state = PREFETCH_DONE;
+            pf->loaded -= e->len;
+        }
+        pthread_mutex_unlock(&pf->lock);
+    }
+
+    // Do not hold on to extents that are never read
+    pthread_mutex_lock(&pf->lock);
+    while (pf->loaded) {
+        if (prefetch_wait(pf))
+            prefetch_stop(pf);
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    SGXLKL_VERBOSE("Prefetched %zu of %zu extents (%zu bytes) of disk %d\n",
+                   num_loaded, pf->num_extents, bytes_loaded, pf->fd);
+    return NULL;
+}
+
+/* Serves a read from prefetched data. Returns 0 on success, -1 if the range
+ * has not been prefetched. */
+static int prefetch_copy(struct disk_prefetch *pf, char *addr, size_t len, off_t off) {
+    pthread_mutex_lock(&pf->lock);
+
+    // Find the extent with the highest offset <= off
+    size_t lo = 0, hi = pf->num_extents;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pf->sorted[mid]->offset <= off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    struct prefetch_extent *e = lo ? pf->sorted[lo - 1] : NULL;
+    if (!e || e->state != PREFETCH_LOADED || off + len > e->offset + e->len) {
+        pthread_mutex_unlock(&pf->lock);
+        return -1;
+    }
+
+    memcpy(addr, e->data + (off - e->offset), len);
+
+    size_t idx = e - pf->extents;
+    while (pf->stale + PREFETCH_MAX_LAG < idx) {
+        struct prefetch_extent *old = &pf->extents[pf->stale++];
+        if (old->state == PREFETCH_LOADED)
+            prefetch_free(pf, old);
+    }
+    pthread_cond_signal(&pf->cond);
+
+    e->served += len;
+    if (e->served >= e->len)
+        prefetch_free(pf, e);
+
+    pthread_mutex_unlock(&pf->lock);
+    return 0;
+}
+
+static int prefetch_extent_cmp(const void *a, const void *b) {
+    const struct prefetch_extent *ea = *(struct prefetch_extent **) a;
+    const struct prefetch_extent *eb = *(struct prefetch_extent **) b;
+    return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+void sgxlkl_disk_prefetch_start(struct enclave_disk_config *disk) {
+    if (!disk->num_prefetch || !disk->ro || disk->fd == -1)
+        return;
+
+#ifdef SGXLKL_HW
+    // The extent list is provided by the host and must not point into the
+    // enclave.
+    if (disk->num_prefetch > SIZE_MAX / sizeof(*disk->prefetch) ||
+        in_enclave_range(disk->prefetch, disk->num_prefetch * sizeof(*disk->prefetch))) {
+        sgxlkl_warn("Invalid prefetch extents for disk %s, prefetching disabled.\n", disk->mnt);
+        return;
+    }
+#endif
+
+    struct disk_prefetch *pf = calloc(1, sizeof(*pf));
+    if (!pf || !(pf->extents = calloc(disk->num_prefetch, sizeof(*pf->extents))) ||
+               !(pf->sorted = calloc(disk->num_prefetch, sizeof(*pf->sorted)))) {
+        sgxlkl_warn("Failed to allocate memory for prefetching disk %s.\n", disk->mnt);
+        goto fail;
+    }
+
+    // Copy the extents into the enclave and drop invalid ones
+    size_t n = 0;
+    for (size_t i = 0; i < disk->num_prefetch; i++) {
+        enclave_disk_extent_t ext = disk->prefetch[i];
+        if (!ext.len || ext.len > PREFETCH_MAX_EXTENT || ext.offset % 512 ||
+            ext.offset > disk->capacity || ext.len > disk->capacity - ext.offset)
+            continue;
+        pf->extents[n].offset = ext.offset;
+        pf->extents[n].len = ext.len;
+        pf->sorted[n] = &pf->extents[n];
+        n++;
+    }
+    if (!n)
+        goto fail;
+
+    qsort(pf->sorted, n, sizeof(*pf->sorted), prefetch_extent_cmp);
+    pf->fd = disk->fd;
+    pf->num_extents = n;
+    pf->window = disk->prefetch_window;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+
+    pthread_t pt;
+    if (pthread_create(&pt, NULL, prefetch_thread, pf)) {
+        sgxlkl_warn("Failed to start prefetch thread for disk %s.\n", disk->mnt);
+        goto fail;
+    }
+    pthread_detach(pt);
+
+    disk->prefetch_state = pf;
+    SGXLKL_VERBOSE("Prefetching %zu extents of disk %s\n", n, disk->mnt);
+    return;
+
+fail:
+    if (pf) {
+        free(pf->extents);
+        free(pf->sorted);
+        free(pf);
+    }
+}
+
 // Reads and write requests sent to the following functions are always sector-
 // aligned (on 512 bytes). Unaligned requests are fixed by the virtio backend.
 
@@ -41,16 +297,23 @@ static int do_plain_rw(ssize_t (*fn)(), struct lkl_disk disk, struct lkl_blk_req
     int len;
     int i;
     int ret = 0;
+    struct enclave_disk_config *disk_config = get_disk_config(disk.fd);
+    struct disk_prefetch *pf = disk_config && fn == &host_syscall_SYS_pread64 ? disk_config->prefetch_state : NULL;
     for (i = 0; i < req->count; i++) {
         addr = req->buf[i].iov_base;
         len = req->buf[i].iov_len;
 
+        if (pf && !prefetch_copy(pf, addr, len, off)) {
+            off += len;
+            ret = len;
+            continue;
+        }
+
         struct lthread *lt = lthread_self();
         // Remember old state of lthread
         int lt_old_state = lt->attr.state;
         // Pin lthread
-        struct enclave_disk_config *disk_config;
-        if ((disk_config = get_disk_config(disk.fd)) != NULL && disk_config->wait_on_io)
+        if (disk_config != NULL && disk_config->wait_on_io)
             lt->attr.state = lt->attr.state | BIT(LT_ST_PINNED);
 
         do {
@@ -0,0 +1,742 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ *
+ * AES-NI accelerated xts(aes) and SHA-NI accelerated sha256 for LKL.
+ *
+ * LKL is built without an architecture, so the kernel crypto API only offers
+ * the generic C implementations, which dominate the cost of dm-crypt and
+ * dm-verity/dm-integrity inside the enclave. This file is copied into LKL's
+ * crypto directory at build time and registers drivers with a higher priority
+ * than the generic ones if the CPU supports the required instructions.
+ *
+ * The instructions are emitted with inline assembly, as LKL does not build the
+ * x86 assembly implementations. LKL has no kernel_fpu_begin/end: kernel
+ * threads are lthreads that only switch at function calls, where all vector
+ * registers are caller-saved, and the lthread scheduler preserves the
+ * floating-point control state across switches.
+ *
+ * LKL has a single CPU, so dm-crypt's kcryptd work items are processed one at a
+ * time and all encryption is serialised on the lthread holding the CPU. An
+ * asynchronous variant of xts(aes) therefore hands requests to a pool of host
+ * lthreads (sgxlkl_crypto.threads), which the lthread scheduler spreads over
+ * all ethreads. The workers only touch the request's data and keys and never
+ * enter the kernel, so they run without the LKL CPU. Completed requests are
+ * passed back through an interrupt, whose handler completes them in kernel
+ * context.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/scatterlist.h>
+#include <linux/string.h>
+#include <linux/version.h>
+#include <crypto/aes.h>
+#include <crypto/xts.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_base.h>
+#include <crypto/internal/hash.h>
+#include <crypto/internal/skcipher.h>
+#include <asm/host_ops.h>
+
+typedef long long block_t __attribute__((vector_size(16)));
+typedef int block32_t __attribute__((vector_size(16)));
+
+#define AESENC(x, k)     __asm__("aesenc %1, %0" : "+x"(x) : "x"(k))
+#define AESENCLAST(x, k) __asm__("aesenclast %1, %0" : "+x"(x) : "x"(k))
+#define AESDEC(x, k)     __asm__("aesdec %1, %0" : "+x"(x) : "x"(k))
+#define AESDECLAST(x, k) __asm__("aesdeclast %1, %0" : "+x"(x) : "x"(k))
+
+static inline block_t load(const void *p)
+{
+	block_t b;
+
+	memcpy(&b, p, sizeof(b));
+	return b;
+}
+
+static inline void store(void *p, block_t b)
+{
+	memcpy(p, &b, sizeof(b));
+}
+
+/* Round keys in the layout of struct crypto_aes_ctx, which is also the one
+ * expected by AESENC/AESDEC (decryption keys in equivalent inverse cipher
+ * order). */
+struct aesni_key {
+	block_t rk[AES_MAX_KEYLENGTH / 16];
+	int rounds;
+};
+
+static inline block_t aesni_encrypt(const struct aesni_key *key, block_t x)
+{
+	int i;
+
+	x ^= key->rk[0];
+	for (i = 1; i < key->rounds; i++)
+		AESENC(x, key->rk[i]);
+	AESENCLAST(x, key->rk[key->rounds]);
+	return x;
+}
+
+/* Processes four independent blocks at once to hide the latency of
+ * AESENC/AESDEC */
+static inline void aesni_crypt4(const struct aesni_key *key, block_t x[4],
+				int enc)
+{
+	block_t a = x[0] ^ key->rk[0], b = x[1] ^ key->rk[0];
+	block_t c = x[2] ^ key->rk[0], d = x[3] ^ key->rk[0];
+	int i;
+
+	if (enc) {
+		for (i = 1; i < key->rounds; i++) {
+			AESENC(a, key->rk[i]);
+			AESENC(b, key->rk[i]);
+			AESENC(c, key->rk[i]);
+			AESENC(d, key->rk[i]);
+		}
+		AESENCLAST(a, key->rk[key->rounds]);
+		AESENCLAST(b, key->rk[key->rounds]);
+		AESENCLAST(c, key->rk[key->rounds]);
+		AESENCLAST(d, key->rk[key->rounds]);
+	} else {
+		for (i = 1; i < key->rounds; i++) {
+			AESDEC(a, key->rk[i]);
+			AESDEC(b, key->rk[i]);
+			AESDEC(c, key->rk[i]);
+			AESDEC(d, key->rk[i]);
+		}
+		AESDECLAST(a, key->rk[key->rounds]);
+		AESDECLAST(b, key->rk[key->rounds]);
+		AESDECLAST(c, key->rk[key->rounds]);
+		AESDECLAST(d, key->rk[key->rounds]);
+	}
+	x[0] = a; x[1] = b; x[2] = c; x[3] = d;
+}
+
+static inline block_t aesni_crypt1(const struct aesni_key *key, block_t x,
+				   int enc)
+{
+	int i;
+
+	if (enc)
+		return aesni_encrypt(key, x);
+	x ^= key->rk[0];
+	for (i = 1; i < key->rounds; i++)
+		AESDEC(x, key->rk[i]);
+	AESDECLAST(x, key->rk[key->rounds]);
+	return x;
+}
+
+/* Multiplies the tweak by x in GF(2^128), little-endian as per IEEE 1619 */
+static inline block_t xts_next_tweak(block_t t)
+{
+	unsigned long long lo = t[0], hi = t[1];
+	unsigned long long carry = hi >> 63;
+
+	hi = (hi << 1) | (lo >> 63);
+	lo = (lo << 1) ^ (carry * 0x87);
+	return (block_t) { (long long) lo, (long long) hi };
+}
+
+/* Encrypts or decrypts len bytes (a multiple of the block size) in XTS mode,
+ * starting at and advancing the given (encrypted) tweak */
+static void aesni_xts_crypt(const struct aesni_key *key, u8 *dst,
+			    const u8 *src, unsigned int len, block_t *tweak,
+			    int enc)
+{
+	block_t t = *tweak, x[4], tw[4];
+	int j;
+
+	for (; len >= 4 * AES_BLOCK_SIZE; len -= 4 * AES_BLOCK_SIZE) {
+		for (j = 0; j < 4; j++) {
+			tw[j] = t;
+			x[j] = load(src + 16 * j) ^ t;
+			t = xts_next_tweak(t);
+		}
+		aesni_crypt4(key, x, enc);
+		for (j = 0; j < 4; j++)
+			store(dst + 16 * j, x[j] ^ tw[j]);
+		src += 4 * AES_BLOCK_SIZE;
+		dst += 4 * AES_BLOCK_SIZE;
+	}
+
+	for (; len >= AES_BLOCK_SIZE; len -= AES_BLOCK_SIZE) {
+		store(dst, aesni_crypt1(key, load(src) ^ t, enc) ^ t);
+		t = xts_next_tweak(t);
+		src += AES_BLOCK_SIZE;
+		dst += AES_BLOCK_SIZE;
+	}
+
+	*tweak = t;
+}
+
+#define PSHUFB(x, m)       __asm__("pshufb %1, %0" : "+x"(x) : "x"(m))
+#define PSHUFD(x, imm)     ({ block_t _r; \
+	__asm__("pshufd %2, %1, %0" : "=x"(_r) : "x"(x), "i"(imm)); _r; })
+#define PALIGNR(a, b, imm) ({ block_t _r = (a); \
+	__asm__("palignr %2, %1, %0" : "+x"(_r) : "x"(b), "i"(imm)); _r; })
+#define PBLENDW(a, b, imm) ({ block_t _r = (a); \
+	__asm__("pblendw %2, %1, %0" : "+x"(_r) : "x"(b), "i"(imm)); _r; })
+#define SHA256RNDS2(a, b, k) \
+	__asm__("sha256rnds2 %2, %1, %0" : "+x"(a) : "x"(b), "Yz"(k))
+#define SHA256MSG1(a, b)   __asm__("sha256msg1 %1, %0" : "+x"(a) : "x"(b))
+#define SHA256MSG2(a, b)   __asm__("sha256msg2 %1, %0" : "+x"(a) : "x"(b))
+#define ADD32(a, b)        ((block_t) ((block32_t) (a) + (block32_t) (b)))
+
+static const u32 sha256_k[64] __aligned(16) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/*
+ * Four rounds of SHA-256 using message words w0. w1..w3 hold the following
+ * message words. Message schedule updates are interleaved as in Intel's
+ * reference implementation: msg2 completes the words four groups ahead, msg1
+ * starts those eight groups ahead.
+ */
+#define SHA256_ROUNDS4(g, w0, w1, w2, w3) do {				\
+	block_t _m = ADD32(w0, load(&sha256_k[4 * (g)]));		\
+	SHA256RNDS2(state1, state0, _m);				\
+	if ((g) >= 3 && (g) <= 14) {					\
+		w1 = ADD32(w1, PALIGNR(w0, w3, 4));			\
+		SHA256MSG2(w1, w0);					\
+	}								\
+	_m = PSHUFD(_m, 0x0e);						\
+	SHA256RNDS2(state0, state1, _m);				\
+	if ((g) >= 1 && (g) <= 12)					\
+		SHA256MSG1(w3, w0);					\
+} while (0)
+
+static void sha256_ni_blocks(struct sha256_state *sst, const u8 *data,
+			     int blocks)
+{
+	const block_t mask = { 0x0405060700010203LL, 0x0c0d0e0f08090a0bLL };
+	block_t state0, state1, tmp, save0, save1;
+	block_t w0, w1, w2, w3;
+
+	/* Rearrange the state from ABCD/EFGH into ABEF/CDGH */
+	tmp = PSHUFD(load(&sst->state[0]), 0xb1);
+	state1 = PSHUFD(load(&sst->state[4]), 0x1b);
+	state0 = PALIGNR(tmp, state1, 8);
+	state1 = PBLENDW(state1, tmp, 0xf0);
+
+	for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE) {
+		save0 = state0;
+		save1 = state1;
+
+		w0 = load(data);
+		PSHUFB(w0, mask);
+		w1 = load(data + 16);
+		PSHUFB(w1, mask);
+		w2 = load(data + 32);
+		PSHUFB(w2, mask);
+		w3 = load(data + 48);
+		PSHUFB(w3, mask);
+
+		SHA256_ROUNDS4(0, w0, w1, w2, w3);
+		SHA256_ROUNDS4(1, w1, w2, w3, w0);
+		SHA256_ROUNDS4(2, w2, w3, w0, w1);
+		SHA256_ROUNDS4(3, w3, w0, w1, w2);
+		SHA256_ROUNDS4(4, w0, w1, w2, w3);
+		SHA256_ROUNDS4(5, w1, w2, w3, w0);
+		SHA256_ROUNDS4(6, w2, w3, w0, w1);
+		SHA256_ROUNDS4(7, w3, w0, w1, w2);
+		SHA256_ROUNDS4(8, w0, w1, w2, w3);
+		SHA256_ROUNDS4(9, w1, w2, w3, w0);
+		SHA256_ROUNDS4(10, w2, w3, w0, w1);
+		SHA256_ROUNDS4(11, w3, w0, w1, w2);
+		SHA256_ROUNDS4(12, w0, w1, w2, w3);
+		SHA256_ROUNDS4(13, w1, w2, w3, w0);
+		SHA256_ROUNDS4(14, w2, w3, w0, w1);
+		SHA256_ROUNDS4(15, w3, w0, w1, w2);
+
+		state0 = ADD32(state0, save0);
+		state1 = ADD32(state1, save1);
+	}
+
+	/* Back from ABEF/CDGH to ABCD/EFGH */
+	tmp = PSHUFD(state0, 0x1b);
+	state1 = PSHUFD(state1, 0xb1);
+	store(&sst->state[0], PBLENDW(tmp, state1, 0xf0));
+	store(&sst->state[4], PALIGNR(state1, tmp, 8));
+}
+
+/* Crypto API glue */
+
+struct aesni_xts_ctx {
+	struct aesni_key crypt_enc;
+	struct aesni_key crypt_dec;
+	struct aesni_key tweak;
+};
+
+/* Transform and request contexts are only CRYPTO_MINALIGN aligned, while the
+ * round keys and tweaks are accessed as 16-byte vectors. The contexts are
+ * over-allocated and aligned on use, as in the x86 AES-NI glue code. */
+#define AESNI_ALIGN		16
+#define AESNI_ALIGN_EXTRA	((AESNI_ALIGN - 1) & ~(CRYPTO_MINALIGN - 1))
+#define XTS_AES_CTX_SIZE	(sizeof(struct aesni_xts_ctx) + AESNI_ALIGN_EXTRA)
+
+static inline struct aesni_xts_ctx *aesni_xts_ctx(struct crypto_skcipher *tfm)
+{
+	return PTR_ALIGN(crypto_skcipher_ctx(tfm), AESNI_ALIGN);
+}
+
+static void aesni_copy_key(struct aesni_key *key, const u32 *rk,
+			   unsigned int key_len)
+{
+	key->rounds = 6 + key_len / 4;
+	memcpy(key->rk, rk, (key->rounds + 1) * AES_BLOCK_SIZE);
+}
+
+static int aesni_expand_key(struct aesni_key *enc, struct aesni_key *dec,
+			    const u8 *in_key, unsigned int key_len)
+{
+	struct crypto_aes_ctx aes;
+	int err;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	err = aes_expandkey(&aes, in_key, key_len);
+#else
+	err = crypto_aes_expand_key(&aes, in_key, key_len);
+#endif
+	if (err)
+		return err;
+
+	aesni_copy_key(enc, aes.key_enc, key_len);
+	if (dec)
+		aesni_copy_key(dec, aes.key_dec, key_len);
+	memzero_explicit(&aes, sizeof(aes));
+	return 0;
+}
+
+static int xts_aesni_setkey(struct crypto_skcipher *tfm, const u8 *key,
+			    unsigned int keylen)
+{
+	struct aesni_xts_ctx *ctx = aesni_xts_ctx(tfm);
+	int err;
+
+	err = xts_verify_key(tfm, key, keylen);
+	if (err)
+		return err;
+
+	keylen /= 2;
+	err = aesni_expand_key(&ctx->crypt_enc, &ctx->crypt_dec, key, keylen);
+	if (err)
+		return err;
+	/* The tweak is encrypted in both directions */
+	return aesni_expand_key(&ctx->tweak, NULL, key + keylen, keylen);
+}
+
+static int xts_aesni_crypt(struct skcipher_request *req, int enc)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct aesni_xts_ctx *ctx = aesni_xts_ctx(tfm);
+	struct skcipher_walk walk;
+	block_t tweak;
+	unsigned int nbytes;
+	int err;
+
+	/* Ciphertext stealing is not supported, dm-crypt always passes whole
+	 * sectors */
+	if (req->cryptlen < AES_BLOCK_SIZE || req->cryptlen % AES_BLOCK_SIZE)
+		return -EINVAL;
+
+	err = skcipher_walk_virt(&walk, req, false);
+	if (!walk.nbytes)
+		return err;
+
+	tweak = aesni_encrypt(&ctx->tweak, load(walk.iv));
+	while ((nbytes = walk.nbytes)) {
+		unsigned int n = nbytes & ~(AES_BLOCK_SIZE - 1);
+
+		aesni_xts_crypt(enc ? &ctx->crypt_enc : &ctx->crypt_dec,
+				walk.dst.virt.addr, walk.src.virt.addr, n,
+				&tweak, enc);
+		err = skcipher_walk_done(&walk, nbytes - n);
+	}
+	return err;
+}
+
+static int xts_aesni_encrypt(struct skcipher_request *req)
+{
+	return xts_aesni_crypt(req, 1);
+}
+
+static int xts_aesni_decrypt(struct skcipher_request *req)
+{
+	return xts_aesni_crypt(req, 0);
+}
+
+static struct skcipher_alg xts_aesni_alg = {
+	.base = {
+		.cra_name		= "xts(aes)",
+		.cra_driver_name	= "xts-aes-sgxlkl-aesni",
+		.cra_priority		= 401,
+		.cra_blocksize		= AES_BLOCK_SIZE,
+		.cra_ctxsize		= XTS_AES_CTX_SIZE,
+		.cra_alignmask		= 0,
+		.cra_module		= THIS_MODULE,
+	},
+	.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+	.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+	.ivsize		= AES_BLOCK_SIZE,
+	.walksize	= AES_BLOCK_SIZE,
+	.setkey		= xts_aesni_setkey,
+	.encrypt	= xts_aesni_encrypt,
+	.decrypt	= xts_aesni_decrypt,
+};
+
+/* Asynchronous xts(aes) processed by a pool of host lthreads */
+
+#define SGXLKL_CRYPTO_MAX_THREADS 64
+
+struct xts_aesni_job {
+	struct xts_aesni_job *next;
+	struct skcipher_request *req;
+	const struct aesni_key *key;
+	u8 *dst;
+	const u8 *src;
+	unsigned int len;
+	int enc;
+	block_t tweak;
+};
+
+static inline struct xts_aesni_job *xts_aesni_job(struct skcipher_request *req)
+{
+	return PTR_ALIGN(skcipher_request_ctx(req), AESNI_ALIGN);
+}
+
+static struct {
+	struct lkl_mutex *lock;	/* Protects the job lists */
+	struct lkl_sem *work;	/* Counts queued jobs */
+	struct xts_aesni_job *head, *tail, *done;
+	int irq;
+	unsigned int nr_threads;
+} pool;
+
+static unsigned int threads;
+static DEFINE_MUTEX(threads_lock);
+
+static void crypto_worker(void *arg)
+{
+	struct xts_aesni_job *job;
+
+	for (;;) {
+		lkl_ops->sem_down(pool.work);
+
+		lkl_ops->mutex_lock(pool.lock);
+		job = pool.head;
+		pool.head = job->next;
+		if (!pool.head)
+			pool.tail = NULL;
+		lkl_ops->mutex_unlock(pool.lock);
+
+		aesni_xts_crypt(job->key, job->dst, job->src, job->len,
+				&job->tweak, job->enc);
+
+		lkl_ops->mutex_lock(pool.lock);
+		job->next = pool.done;
+		pool.done = job;
+		lkl_ops->mutex_unlock(pool.lock);
+		lkl_trigger_irq(pool.irq);
+	}
+}
+
+/* Starts workers until the requested number is running. Workers are never
+ * stopped. */
+static void start_workers(void)
+{
+	mutex_lock(&threads_lock);
+	while (pool.nr_threads < threads) {
+		if (!lkl_ops->thread_create(crypto_worker, NULL)) {
+			pr_warn("sgxlkl-crypto: failed to start crypto thread\n");
+			threads = pool.nr_threads;
+			break;
+		}
+		WRITE_ONCE(pool.nr_threads, pool.nr_threads + 1);
+	}
+	mutex_unlock(&threads_lock);
+}
+
+static irqreturn_t crypto_irq(int irq, void *dev_id)
+{
+	struct xts_aesni_job *job, *next;
+
+	lkl_ops->mutex_lock(pool.lock);
+	job = pool.done;
+	pool.done = NULL;
+	lkl_ops->mutex_unlock(pool.lock);
+
+	for (; job; job = next) {
+		next = job->next;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+		skcipher_request_complete(job->req, 0);
+#else
+		job->req->base.complete(&job->req->base, 0);
+#endif
+	}
+	return IRQ_HANDLED;
+}
+
+static int threads_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int n;
+	int err;
+
+	err = kstrtouint(val, 0, &n);
+	if (err)
+		return err;
+	threads = min_t(unsigned int, max(n, threads), SGXLKL_CRYPTO_MAX_THREADS);
+	/* When set on the command line, the workers are started at init */
+	if (pool.work)
+		start_workers();
+	return 0;
+}
+
+static const struct kernel_param_ops threads_ops = {
+	.set = threads_set,
+	.get = param_get_uint,
+};
+module_param_cb(threads, &threads_ops, &threads, 0644);
+MODULE_PARM_DESC(threads, "Number of threads processing xts(aes) requests asynchronously (can only be increased)");
+
+static int xts_aesni_async_init(struct crypto_skcipher *tfm)
+{
+	crypto_skcipher_set_reqsize(tfm, sizeof(struct xts_aesni_job) +
+				       AESNI_ALIGN_EXTRA);
+	return 0;
+}
+
+static int xts_aesni_async_crypt(struct skcipher_request *req, int enc)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct aesni_xts_ctx *ctx = aesni_xts_ctx(tfm);
+	struct xts_aesni_job *job = xts_aesni_job(req);
+
+	/* dm-crypt passes each sector as a single scatterlist entry. Other
+	 * requests, and all requests while no workers are running, are
+	 * processed synchronously. LKL has no highmem, so sg_virt() is valid
+	 * for all pages. */
+	if (!READ_ONCE(pool.nr_threads) ||
+	    req->cryptlen < AES_BLOCK_SIZE || req->cryptlen % AES_BLOCK_SIZE ||
+	    req->src->length < req->cryptlen ||
+	    req->dst->length < req->cryptlen)
+		return xts_aesni_crypt(req, enc);
+
+	job->next = NULL;
+	job->req = req;
+	job->key = enc ? &ctx->crypt_enc : &ctx->crypt_dec;
+	job->dst = sg_virt(req->dst);
+	job->src = sg_virt(req->src);
+	job->len = req->cryptlen;
+	job->enc = enc;
+	job->tweak = aesni_encrypt(&ctx->tweak, load(req->iv));
+
+	lkl_ops->mutex_lock(pool.lock);
+	if (pool.tail)
+		pool.tail->next = job;
+	else
+		pool.head = job;
+	pool.tail = job;
+	lkl_ops->mutex_unlock(pool.lock);
+	lkl_ops->sem_up(pool.work);
+
+	return -EINPROGRESS;
+}
+
+static int xts_aesni_async_encrypt(struct skcipher_request *req)
+{
+	return xts_aesni_async_crypt(req, 1);
+}
+
+static int xts_aesni_async_decrypt(struct skcipher_request *req)
+{
+	return xts_aesni_async_crypt(req, 0);
+}
+
+static struct skcipher_alg xts_aesni_async_alg = {
+	.base = {
+		.cra_name		= "xts(aes)",
+		.cra_driver_name	= "xts-aes-sgxlkl-aesni-async",
+		.cra_priority		= 402,
+		.cra_flags		= CRYPTO_ALG_ASYNC,
+		.cra_blocksize		= AES_BLOCK_SIZE,
+		.cra_ctxsize		= XTS_AES_CTX_SIZE,
+		.cra_alignmask		= 0,
+		.cra_module		= THIS_MODULE,
+	},
+	.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+	.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+	.ivsize		= AES_BLOCK_SIZE,
+	.walksize	= AES_BLOCK_SIZE,
+	.setkey		= xts_aesni_setkey,
+	.init		= xts_aesni_async_init,
+	.encrypt	= xts_aesni_async_encrypt,
+	.decrypt	= xts_aesni_async_decrypt,
+};
+
+static int xts_aesni_async_register(void)
+{
+	int err = -ENOMEM;
+
+	pool.lock = lkl_ops->mutex_alloc(0);
+	pool.work = lkl_ops->sem_alloc(0);
+	if (!pool.lock || !pool.work)
+		goto err_free;
+
+	pool.irq = lkl_get_free_irq("sgxlkl-crypto");
+	if (pool.irq < 0) {
+		err = pool.irq;
+		goto err_free;
+	}
+	err = request_irq(pool.irq, crypto_irq, 0, "sgxlkl-crypto", NULL);
+	if (err)
+		goto err_put_irq;
+
+	err = crypto_register_skcipher(&xts_aesni_async_alg);
+	if (err)
+		goto err_free_irq;
+
+	start_workers();
+	return 0;
+
+err_free_irq:
+	free_irq(pool.irq, NULL);
+err_put_irq:
+	lkl_put_irq(pool.irq, "sgxlkl-crypto");
+err_free:
+	if (pool.work)
+		lkl_ops->sem_free(pool.work);
+	if (pool.lock)
+		lkl_ops->mutex_free(pool.lock);
+	pool.work = NULL;
+	pool.lock = NULL;
+	return err;
+}
+
+static int sha256_ni_update(struct shash_desc *desc, const u8 *data,
+			    unsigned int len)
+{
+	return sha256_base_do_update(desc, data, len, sha256_ni_blocks);
+}
+
+static int sha256_ni_finup(struct shash_desc *desc, const u8 *data,
+			   unsigned int len, u8 *out)
+{
+	if (len)
+		sha256_base_do_update(desc, data, len, sha256_ni_blocks);
+	sha256_base_do_finalize(desc, sha256_ni_blocks);
+	return sha256_base_finish(desc, out);
+}
+
+static int sha256_ni_final(struct shash_desc *desc, u8 *out)
+{
+	return sha256_ni_finup(desc, NULL, 0, out);
+}
+
+static struct shash_alg sha256_ni_alg = {
+	.digestsize	= SHA256_DIGEST_SIZE,
+	.init		= sha256_base_init,
+	.update		= sha256_ni_update,
+	.final		= sha256_ni_final,
+	.finup		= sha256_ni_finup,
+	.descsize	= sizeof(struct sha256_state),
+	.base		= {
+		.cra_name		= "sha256",
+		.cra_driver_name	= "sha256-sgxlkl-ni",
+		.cra_priority		= 250,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static void sgxlkl_cpuid(unsigned int leaf, unsigned int subleaf,
+			unsigned int regs[4])
+{
+	/* Emulated by the enclave in hardware mode */
+	__asm__ volatile("cpuid"
+			 : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+			 : "a"(leaf), "c"(subleaf));
+}
+
+static bool has_aesni, has_aesni_async, has_sha_ni;
+
+static int __init sgxlkl_crypto_init(void)
+{
+	unsigned int regs[4], max_leaf, ecx1;
+	int err;
+
+	sgxlkl_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1)
+		return 0;
+	sgxlkl_cpuid(1, 0, regs);
+	ecx1 = regs[2];
+
+	/* SSSE3 (pshufb) and SSE4.1 (pblendw) are required by both */
+	if ((ecx1 & (1 << 9)) && (ecx1 & (1 << 19))) {
+		has_aesni = ecx1 & (1 << 25);
+		if (max_leaf >= 7) {
+			sgxlkl_cpuid(7, 0, regs);
+			has_sha_ni = regs[1] & (1 << 29);
+		}
+	}
+
+	if (has_aesni) {
+		err = crypto_register_skcipher(&xts_aesni_alg);
+		if (err)
+			return err;
+		/* Optional, the synchronous driver is used otherwise */
+		has_aesni_async = !xts_aesni_async_register();
+	}
+	if (has_sha_ni) {
+		err = crypto_register_shash(&sha256_ni_alg);
+		if (err) {
+			if (has_aesni_async)
+				crypto_unregister_skcipher(&xts_aesni_async_alg);
+			if (has_aesni)
+				crypto_unregister_skcipher(&xts_aesni_alg);
+			return err;
+		}
+	}
+	pr_info("sgxlkl-crypto: AES-NI %s, SHA-NI %s, %u crypto threads\n",
+		has_aesni ? "enabled" : "unavailable",
+		has_sha_ni ? "enabled" : "unavailable", pool.nr_threads);
+	return 0;
+}
+
+static void __exit sgxlkl_crypto_exit(void)
+{
+	if (has_sha_ni)
+		crypto_unregister_shash(&sha256_ni_alg);
+	if (has_aesni_async)
+		crypto_unregister_skcipher(&xts_aesni_async_alg);
+	if (has_aesni)
+		crypto_unregister_skcipher(&xts_aesni_alg);
+}
+
+module_init(sgxlkl_crypto_init);
+module_exit(sgxlkl_crypto_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("AES-NI/SHA-NI accelerated crypto for SGX-LKL");
+MODULE_ALIAS_CRYPTO("xts(aes)");
+MODULE_ALIAS_CRYPTO("sha256");
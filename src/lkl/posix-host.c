@@ -21,6 +21,7 @@
 #include <lkl_host.h>
 #include "lkl/iomem.h"
 #include "lkl/jmp_buf.h"
+#include "lthread.h"
 
 /* Let's see if the host has semaphore.h */
 #include <unistd.h>
@@ -194,9 +195,28 @@ static void mutex_free(struct lkl_mutex *_mutex) {
     free(_mutex);
 }
 
+/*
+ * Creates an lthread in the LTHREAD_PRIO_KERNEL class. New lthreads inherit the
+ * class of their creator, so the creator temporarily joins the kernel class.
+ * This way the new lthread is never enqueued as an application thread, not
+ * even before pthread_create returns.
+ */
+static int kernel_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg) {
+    struct lthread *self = lthread_self();
+    int prio = self ? self->prio : LTHREAD_PRIO_NORMAL;
+    if (self)
+        lthread_set_prio(self, LTHREAD_PRIO_KERNEL);
+    int ret = pthread_create(thread, NULL, fn, arg);
+    if (self)
+        lthread_set_prio(self, prio);
+    else if (!ret)
+        lthread_set_prio((struct lthread *) *thread, LTHREAD_PRIO_KERNEL);
+    return ret;
+}
+
 static lkl_thread_t thread_create(void (*fn)(void *), void *arg) {
     pthread_t thread;
-    if (WARN_PTHREAD(pthread_create(&thread, NULL, (void* (*)(void *))fn, arg)))
+    if (WARN_PTHREAD(kernel_thread_create(&thread, (void* (*)(void *))fn, arg)))
         return 0;
     else
         return (lkl_thread_t) thread;
@@ -366,7 +386,7 @@ static int timer_set_oneshot(void *_timer, unsigned long ns) {
     timer->next_delay_ns = 0;
     pthread_mutex_init(&timer->mtx,NULL);
     pthread_cond_init(&timer->cv,NULL);
-    res = pthread_create(&(timer->thread), NULL, &timer_callback,
+    res = kernel_thread_create(&(timer->thread), &timer_callback,
         (void*)timer);
 
     if (res != 0) {
@@ -25,9 +25,15 @@
 #include "lkl/disk.h"
 #include "lkl/posix-host.h"
 #include "lkl/setup.h"
+#include "lkl/syscall_fast.h"
 #include "lkl/virtio_net.h"
+#include "lthread.h"
 #include "pthread.h"
+#include "boot_prof.h"
 #include "enclave_cmd.h"
+#include "enclave_mem.h"
+#include "enclave_pager.h"
+#include "hybridlock.h"
 #include "sgx_enclave_config.h"
 #include "sgxlkl_debug.h"
 #include "sgxlkl_util.h"
@@ -52,6 +58,17 @@ extern struct timespec sgxlkl_app_starttime;
 size_t num_disks = 0;
 struct enclave_disk_config *disks;
 
+/* Boot phase profiler, NULL if disabled or if the vDSO is not available */
+static boot_prof_t *boot_prof = NULL;
+
+static int boot_phase_begin(const char *name) {
+    return boot_prof_begin(boot_prof, name, 1);
+}
+
+static void boot_phase_end(int idx) {
+    boot_prof_end(boot_prof, idx);
+}
+
 static void lkl_add_disks(struct enclave_disk_config *disks, size_t num_disks) {
     for (size_t i = 0; i < num_disks; ++i) {
         if (disks[i].fd == -1)
@@ -271,9 +288,11 @@ static int lkl_mount_blockdev(const char* dev_str, const char* mnt_point,
 
     err = lkl_sys_access("/mnt", LKL_S_IRWXO);
     if (err < 0) {
+        // Disks may be mounted concurrently, so /mnt may have been created in
+        // the meantime.
         if (err == -LKL_ENOENT)
             err = lkl_sys_mkdir("/mnt", 0700);
-        if (err < 0)
+        if (err < 0 && err != -LKL_EEXIST)
             goto fail;
     }
 
@@ -301,19 +320,70 @@ fail:
     return err;
 }
 
+/*
+ * Besides ext4, disks can hold the read-only compressed file systems erofs and
+ * squashfs. The file system type is detected from the superblock of the
+ * activated device.
+ */
+#define EXT4_SUPER_MAGIC_OFFSET  (1024 + 0x38)
+#define EXT4_SUPER_MAGIC         0xEF53
+#define EROFS_SUPER_MAGIC_OFFSET 1024
+#define EROFS_SUPER_MAGIC        0xE0F5E1E2
+#define SQUASHFS_MAGIC_OFFSET    0
+#define SQUASHFS_MAGIC           0x73717368
+
+static const char* lkl_disk_fs_type(const char *dev_str) {
+    unsigned char sb[2048];
+    const char *fs_type = "ext4";
+    uint32_t magic32;
+    uint16_t magic16;
+
+    int fd = lkl_sys_open(dev_str, LKL_O_RDONLY, 0);
+    if (fd < 0)
+        return fs_type;
+
+    if (lkl_sys_pread64(fd, (char *) sb, sizeof(sb), 0) == sizeof(sb)) {
+        memcpy(&magic16, sb + EXT4_SUPER_MAGIC_OFFSET, sizeof(magic16));
+        memcpy(&magic32, sb + EROFS_SUPER_MAGIC_OFFSET, sizeof(magic32));
+        if (magic16 == EXT4_SUPER_MAGIC) {
+            fs_type = "ext4";
+        } else if (magic32 == EROFS_SUPER_MAGIC) {
+            fs_type = "erofs";
+        } else {
+            memcpy(&magic32, sb + SQUASHFS_MAGIC_OFFSET, sizeof(magic32));
+            if (magic32 == SQUASHFS_MAGIC)
+                fs_type = "squashfs";
+        }
+    }
+
+    lkl_sys_close(fd);
+    return fs_type;
+}
+
 struct lkl_crypt_device {
     char *disk_path;
     int readonly;
     struct enclave_disk_config *disk_config;
     char *crypt_name;
+    int concurrent; // Other disks are activated at the same time
 };
 
+/*
+ * libcryptsetup and libdevmapper keep global state, e.g. libdevmapper's list
+ * of pending device node operations, and are not safe to call from several
+ * threads at once. Disks that are activated concurrently therefore take turns,
+ * except for deriving the volume key from a passphrase, which is by far the
+ * slowest step and only touches the disk's own crypt_device.
+ */
+static pthread_mutex_t cryptsetup_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd) {
     int err;
 
     char* disk_path = lkl_cd->disk_path;
 
     struct crypt_device *cd;
+    pthread_mutex_lock(&cryptsetup_lock);
     err = crypt_init(&cd, disk_path);
     if (err != 0) {
         fprintf(stderr, "Error: crypt_init(): %s (%d)\n", strerror(err), err);
@@ -325,6 +395,7 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd) {
         fprintf(stderr, "Error: crypt_load(): %s (%d)\n", strerror(err), err);
         exit(err);
     }
+    pthread_mutex_unlock(&cryptsetup_lock);
 
     char *key_outside = lkl_cd->disk_config->key;
     lkl_cd->disk_config->key = (char *) lkl_sys_mmap(NULL, lkl_cd->disk_config->key_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
@@ -334,16 +405,50 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd) {
     }
     memcpy(lkl_cd->disk_config->key, key_outside, lkl_cd->disk_config->key_len);
 
-    err = crypt_activate_by_passphrase(cd, lkl_cd->crypt_name, CRYPT_ANY_SLOT, lkl_cd->disk_config->key, lkl_cd->disk_config->key_len, lkl_cd->readonly ? CRYPT_ACTIVATE_READONLY : 0);
+    uint32_t activate_flags = lkl_cd->readonly ? CRYPT_ACTIVATE_READONLY : 0;
+    if (lkl_cd->disk_config->volume_key) {
+        // The volume key is only checked against the digest in the LUKS
+        // header, which avoids running the key slot's deliberately slow key
+        // derivation function.
+        pthread_mutex_lock(&cryptsetup_lock);
+        err = crypt_activate_by_volume_key(cd, lkl_cd->crypt_name, lkl_cd->disk_config->key, lkl_cd->disk_config->key_len, activate_flags);
+        pthread_mutex_unlock(&cryptsetup_lock);
+    } else if (lkl_cd->concurrent) {
+        // Run the key derivation function without holding cryptsetup_lock so
+        // that the key slots of several disks are opened in parallel.
+        size_t volume_key_len = crypt_get_volume_key_size(cd);
+        char *volume_key = (char *) lkl_sys_mmap(NULL, volume_key_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if ((int64_t) volume_key <= 0) {
+            fprintf(stderr, "Error: Unable to allocate memory for disk volume key inside the enclave: %s\n", lkl_strerror((int) volume_key));
+            exit(EXIT_FAILURE);
+        }
+
+        err = crypt_volume_key_get(cd, CRYPT_ANY_SLOT, volume_key, &volume_key_len, lkl_cd->disk_config->key, lkl_cd->disk_config->key_len);
+        if (err >= 0) {
+            pthread_mutex_lock(&cryptsetup_lock);
+            err = crypt_activate_by_volume_key(cd, lkl_cd->crypt_name, volume_key, volume_key_len, activate_flags);
+            pthread_mutex_unlock(&cryptsetup_lock);
+        }
+
+        memset(volume_key, 0, volume_key_len);
+        lkl_sys_munmap((unsigned long) volume_key, volume_key_len);
+    } else {
+        pthread_mutex_lock(&cryptsetup_lock);
+        err = crypt_activate_by_passphrase(cd, lkl_cd->crypt_name, CRYPT_ANY_SLOT, lkl_cd->disk_config->key, lkl_cd->disk_config->key_len, activate_flags);
+        pthread_mutex_unlock(&cryptsetup_lock);
+    }
     if (err == -1) {
-        fprintf(stderr, "Error: Unable to activate encrypted disk. Please ensure you have provided the correct passphrase/keyfile!\n");
+        fprintf(stderr, "Error: Unable to activate encrypted disk. Please ensure you have provided the correct %s!\n",
+                lkl_cd->disk_config->volume_key ? "volume key" : "passphrase/keyfile");
         exit(err);
     } else if (err != 0) {
         fprintf(stderr, "Error: Unable to activate encrypted disk due to unknown error (error code: %d)\n", err);
         exit(err);
     }
 
+    pthread_mutex_lock(&cryptsetup_lock);
     crypt_free(cd);
+    pthread_mutex_unlock(&cryptsetup_lock);
 
     // The key is only needed during activation, so don't keep it around
     // afterwards and free up space.
@@ -366,6 +471,8 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd) {
     char* disk_path = lkl_cd->disk_path;
 
     struct crypt_device *cd;
+    // dm-verity activation is quick, so hold cryptsetup_lock throughout.
+    pthread_mutex_lock(&cryptsetup_lock);
     // cryptsetup!
     err = crypt_init(&cd, disk_path);
     if (err != 0) {
@@ -378,14 +485,20 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd) {
      * stored on the disk image following the actual data blocks. The offset that
      * signifies both the end of the data region as well as the start of the hash
      * region has to be provided to SGX-LKL.
+     *
+     * Larger blocks result in a smaller and shallower tree and fewer hash
+     * computations per read, so sgx-lkl-disk uses 4 KiB blocks by default.
      */
+    size_t block_size = lkl_cd->disk_config->verity_block_size;
+    if (!block_size)
+        block_size = 4096;
     struct crypt_params_verity verity_params = {
         .data_device = disk_path,
         .hash_device = disk_path,
         .hash_area_offset = lkl_cd->disk_config->roothash_offset,
-        .data_size = lkl_cd->disk_config->roothash_offset / 512, // In blocks, divide by block size
-        .data_block_size = 512,
-        .hash_block_size = 512,
+        .data_size = lkl_cd->disk_config->roothash_offset / block_size, // In blocks, divide by block size
+        .data_block_size = block_size,
+        .hash_block_size = block_size,
     };
 
     err = crypt_load(cd, CRYPT_VERITY, &verity_params);
@@ -394,6 +507,23 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd) {
         exit(err);
     }
 
+    /*
+     * The block sizes are read from the verity superblock. They are bound by
+     * the root hash, so a mismatch is not a security issue, but it likely means
+     * that the image was created with an older version of sgx-lkl-disk.
+     */
+    struct crypt_params_verity verity_info;
+    if (!crypt_get_verity_info(cd, &verity_info)) {
+        SGXLKL_VERBOSE("dm-verity: data block size %u, hash block size %u\n",
+                       verity_info.data_block_size, verity_info.hash_block_size);
+        if (lkl_cd->disk_config->verity_block_size &&
+            verity_info.data_block_size != lkl_cd->disk_config->verity_block_size)
+            sgxlkl_warn("dm-verity block size of %s is %u bytes, expected %lu bytes. "
+                        "Disk images created with 4096-byte blocks are faster to read.\n",
+                        lkl_cd->disk_config->mnt, verity_info.data_block_size,
+                        lkl_cd->disk_config->verity_block_size);
+    }
+
     char* volume_hash_bytes = NULL;
     ssize_t hash_size = crypt_get_volume_key_size(cd);
     if (hex_to_bytes(lkl_cd->disk_config->roothash, &volume_hash_bytes) != hash_size) {
@@ -408,12 +538,13 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd) {
     }
 
     crypt_free(cd);
+    pthread_mutex_unlock(&cryptsetup_lock);
     free(volume_hash_bytes);
 
     return NULL;
 }
 
-static void lkl_run_in_kernel_stack(void *(*start_routine) (void *), void* arg) {
+static pthread_t lkl_start_in_kernel_stack(void *(*start_routine) (void *), void* arg) {
     int err;
 
     /*
@@ -442,13 +573,23 @@ static void lkl_run_in_kernel_stack(void *(*start_routine) (void *), void* arg)
         exit(err);
     }
 
-    err = pthread_join(pt, NULL);
+    return pt;
+}
+
+static void lkl_join_thread(pthread_t pt) {
+    int err = pthread_join(pt, NULL);
     if (err < 0) {
         fprintf(stderr, "Error: pthread_join()=%s (%d)\n", strerror(err), err);
         exit(err);
     }
 }
 
+static uint64_t lkl_elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
 static void lkl_mount_virtual() {
     lkl_mount_devtmpfs("/dev");
     lkl_prepare_rootfs("/proc", 0700);
@@ -471,31 +612,56 @@ static void lkl_set_working_dir(char* path) {
     exit(1);
 }
 
-static void lkl_mount_disk(struct enclave_disk_config *disk, char device, const char* mnt_point) {
+/*
+ * Disks are activated and mounted concurrently. All device-mapper targets are
+ * set up in parallel, before the root disk is pivoted to. Secondary disks are
+ * then mounted in parallel, each once the disks that are mounted at a parent
+ * directory of its mount point have been mounted.
+ */
+struct lkl_disk_mount {
+    struct enclave_disk_config *disk;
+    char device;
+    const char *mnt_point;
+    int concurrent;
+    int activate;                           // Needs dm-verity/dm-crypt setup
+    char dev_str[sizeof "/dev/mapper/verityX"]; // Device to mount
+    pthread_t thread;
+    uint64_t activate_ms;
+    uint64_t mount_ms;
+};
+
+static pthread_mutex_t disk_mount_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t disk_mount_cond = PTHREAD_COND_INITIALIZER;
+static struct lkl_disk_mount *disk_mounts;
+static size_t num_disk_mounts;
+
+static void* lkl_activate_disk_thread(struct lkl_disk_mount *dm) {
+    struct enclave_disk_config *disk = dm->disk;
     char dev_str_raw[] = {"/dev/vdX"};
     char dev_str_enc[] = {"/dev/mapper/cryptX"};
     char dev_str_verity[] = {"/dev/mapper/verityX"};
     const size_t offset_dev_str_crypt_name = sizeof "/dev/mapper/" - 1;
 
-    dev_str_raw[sizeof dev_str_raw - 2] = device;
-    char *dev_str = dev_str_raw;
+    char phase_name[] = {"disk_activate_vdX"};
+    phase_name[sizeof phase_name - 2] = dm->device;
+    int phase = boot_phase_begin(phase_name);
 
-    int lkl_trace_syscall_bak = sgxlkl_trace_syscall;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    if (sgxlkl_trace_syscall && (disk->roothash || disk->enc)) {
-        sgxlkl_trace_syscall = 0;
-        SGXLKL_VERBOSE("Disk encryption/integrity enabled: Temporarily disabling tracing.\n");
-    }
+    dev_str_raw[sizeof dev_str_raw - 2] = dm->device;
+    char *dev_str = dev_str_raw;
 
     struct lkl_crypt_device lkl_cd;
     lkl_cd.disk_path = dev_str;
     lkl_cd.readonly = disk->ro;
     lkl_cd.disk_config = disk;
+    lkl_cd.concurrent = dm->concurrent;
 
     if (disk->roothash != NULL) {
-        dev_str_verity[sizeof dev_str_verity - 2] = device;
+        dev_str_verity[sizeof dev_str_verity - 2] = dm->device;
         lkl_cd.crypt_name = dev_str_verity + offset_dev_str_crypt_name;
-        lkl_run_in_kernel_stack((void * (*)(void *)) &lkl_activate_verity_disk_thread, (void *) &lkl_cd);
+        lkl_activate_verity_disk_thread(&lkl_cd);
 
         // We now want to mount the verified volume
         dev_str = dev_str_verity;
@@ -505,31 +671,93 @@ static void lkl_mount_disk(struct enclave_disk_config *disk, char device, const
         lkl_cd.readonly = 1;
     }
     if (disk->enc) {
-        dev_str_enc[sizeof dev_str_enc - 2] = device;
+        dev_str_enc[sizeof dev_str_enc - 2] = dm->device;
         lkl_cd.crypt_name = dev_str_enc + offset_dev_str_crypt_name;
-        lkl_run_in_kernel_stack((void * (*)(void *)) &lkl_activate_crypto_disk_thread, (void *) &lkl_cd);
+        lkl_activate_crypto_disk_thread(&lkl_cd);
 
         // We now want to mount the decrypted volume
         dev_str = dev_str_enc;
     }
 
-    if ((lkl_trace_syscall_bak && !sgxlkl_trace_syscall)) {
-        SGXLKL_VERBOSE("Devicemapper setup complete: reenabling lkl_strace\n");
-        sgxlkl_trace_syscall = lkl_trace_syscall_bak;
+    strncpy(dm->dev_str, dev_str, sizeof(dm->dev_str));
+    dm->activate_ms = lkl_elapsed_ms(&start);
+    boot_phase_end(phase);
+
+    return NULL;
+}
+
+static void lkl_mount_disk(struct lkl_disk_mount *dm) {
+    char phase_name[] = {"disk_mount_vdX"};
+    phase_name[sizeof phase_name - 2] = dm->device;
+    int phase = boot_phase_begin(phase_name);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const char *fs_type = lkl_disk_fs_type(dm->dev_str);
+    if (strcmp(fs_type, "ext4") && !dm->disk->ro) {
+        sgxlkl_warn("Disk %s contains a read-only %s file system, mounting it read-only.\n",
+                    dm->disk->mnt, fs_type);
+        dm->disk->ro = 1;
     }
 
-    const int err = lkl_mount_blockdev(dev_str, mnt_point, "ext4", disk->ro ? LKL_MS_RDONLY : 0, NULL);
+    const int err = lkl_mount_blockdev(dm->dev_str, dm->mnt_point, fs_type, dm->disk->ro ? LKL_MS_RDONLY : 0, NULL);
     if (err < 0)
         sgxlkl_fail("Error: lkl_mount_blockdev()=%s (%d)\n", lkl_strerror(err), err);
-    disk->mounted = 1;
+
+    dm->mount_ms = lkl_elapsed_ms(&start);
+    boot_phase_end(phase);
+    SGXLKL_VERBOSE("Mounted %s disk %s at %s (activation: %lu ms, mount: %lu ms)\n",
+                   fs_type, dm->dev_str, dm->disk->mnt, dm->activate_ms, dm->mount_ms);
+}
+
+/* Returns whether mnt_point is located strictly below parent */
+static int lkl_is_parent_mnt(const char *parent, const char *mnt_point) {
+    size_t len = strlen(parent);
+    while (len > 0 && parent[len - 1] == '/')
+        len--;
+
+    if (strncmp(parent, mnt_point, len) || mnt_point[len] != '/')
+        return 0;
+
+    // Ignore trailing slashes, e.g. /data/ is not below /data
+    return strspn(mnt_point + len, "/") < strlen(mnt_point + len);
+}
+
+static void* lkl_mount_disk_thread(struct lkl_disk_mount *dm) {
+    pthread_mutex_lock(&disk_mount_lock);
+    for (size_t i = 0; i < num_disk_mounts; i++) {
+        struct lkl_disk_mount *other = &disk_mounts[i];
+        if (other != dm && lkl_is_parent_mnt(other->disk->mnt, dm->disk->mnt)) {
+            while (!other->disk->mounted)
+                pthread_cond_wait(&disk_mount_cond, &disk_mount_lock);
+        }
+    }
+    pthread_mutex_unlock(&disk_mount_lock);
+
+    lkl_mount_disk(dm);
+
+    pthread_mutex_lock(&disk_mount_lock);
+    dm->disk->mounted = 1;
+    pthread_cond_broadcast(&disk_mount_cond);
+    pthread_mutex_unlock(&disk_mount_lock);
+
+    return NULL;
 }
 
-static void lkl_mount_root_disk(struct enclave_disk_config *disk) {
+static void lkl_mount_root_disk(struct lkl_disk_mount *root) {
     int err = 0;
-    char mnt_point[] = {"/mnt/vda"};
     char new_dev_str[] = {"/mnt/vda/dev/"};
 
-    lkl_mount_disk(disk, 'a', mnt_point);
+    lkl_mount_disk(root);
+    root->disk->mounted = 1;
+
+    // The other disks' device-mapper nodes are created in /dev/mapper of the
+    // current root, so wait for them before pivoting.
+    for (size_t i = 1; i < num_disk_mounts; i++) {
+        if (disk_mounts[i].activate)
+            lkl_join_thread(disk_mounts[i].thread);
+    }
 
     /* set up /dev in the new root */
     lkl_prepare_rootfs(new_dev_str, 0700);
@@ -543,17 +771,17 @@ static void lkl_mount_root_disk(struct enclave_disk_config *disk) {
     lkl_sys_umount("/dev", 0);
 
     /* pivot */
-    err = lkl_sys_chroot(mnt_point);
+    err = lkl_sys_chroot(root->mnt_point);
     if (err != 0) {
         fprintf(stderr, "Error: lkl_sys_chroot(%s): %s\n",
-            mnt_point, lkl_strerror(err));
+            root->mnt_point, lkl_strerror(err));
         exit(err);
     }
 
     err = lkl_sys_chdir("/");
     if (err != 0) {
         fprintf(stderr, "Error: lkl_sys_chdir(%s): %s\n",
-            mnt_point, lkl_strerror(err));
+            root->mnt_point, lkl_strerror(err));
         exit(err);
     }
 
@@ -583,9 +811,21 @@ void lkl_mount_disks(struct enclave_disk_config* _disks, size_t _num_disks, cons
     // (Decryption keys are copied in lkl_activate_crypto_thread)
     disks = (struct enclave_disk_config*) malloc(sizeof(struct enclave_disk_config) * num_disks);
     memcpy(disks, _disks, sizeof(struct enclave_disk_config) * num_disks);
+    for (size_t i = 0; i < num_disks; ++i) {
+        disks[i].mounted = 0;
+        disks[i].prefetch_state = NULL;
+    }
+
+    int phase = boot_phase_begin("disks");
 
     lkl_add_disks(disks, num_disks);
 
+    // Only the default block device ops serve reads from prefetched data
+    if (lkl_dev_blk_ops.request == sgxlkl_dev_blk_ops.request) {
+        for (size_t i = 0; i < num_disks; ++i)
+            sgxlkl_disk_prefetch_start(&disks[i]);
+    }
+
     // Find root disk
     enclave_disk_config_t *root_disk = NULL;
     for (size_t i = 0; i < num_disks; ++i) {
@@ -599,10 +839,16 @@ void lkl_mount_disks(struct enclave_disk_config* _disks, size_t _num_disks, cons
         sgxlkl_fail("No root disk (mount point '/') provided.\n");
     }
 
-    lkl_mount_root_disk(root_disk);
+    // The root disk always comes first
+    disk_mounts = calloc(num_disks, sizeof(*disk_mounts));
+    if (!disk_mounts)
+        sgxlkl_fail("Failed to allocate memory for disk mounts.\n");
+    disk_mounts[0].disk = root_disk;
+    disk_mounts[0].device = 'a';
+    disk_mounts[0].mnt_point = "/mnt/vda";
+    num_disk_mounts = 1;
 
-    char dev_path[] = { "/dev/vdXX" };
-    size_t dev_path_len = strlen(dev_path);
+    int too_many_disks = 0;
     for (size_t i = 0; i < num_disks; ++i) {
         if (root_disk == &disks[i] || disks[i].fd == -1)
             continue;
@@ -611,11 +857,65 @@ void lkl_mount_disks(struct enclave_disk_config* _disks, size_t _num_disks, cons
         // support for more than 26 disks.
         if ('a' + i > 'z') {
             fprintf(stderr, "Error: Too many disks (maximum is 26). Failed to mount disk %d at %s.\n", i, disks[i].mnt);
-            // Adjust number to number of mounted disks.
-            num_disks = 26;
-            return;
+            too_many_disks = 1;
+            break;
+        }
+        disk_mounts[num_disk_mounts].disk = &disks[i];
+        disk_mounts[num_disk_mounts].device = 'a' + i;
+        disk_mounts[num_disk_mounts].mnt_point = disks[i].mnt;
+        num_disk_mounts++;
+    }
+
+    size_t num_activate = 0;
+    for (size_t i = 0; i < num_disk_mounts; i++) {
+        struct lkl_disk_mount *dm = &disk_mounts[i];
+        dm->activate = dm->disk->roothash || dm->disk->enc;
+        num_activate += dm->activate;
+    }
+
+    int lkl_trace_syscall_bak = sgxlkl_trace_syscall;
+
+    if (sgxlkl_trace_syscall && num_activate) {
+        sgxlkl_trace_syscall = 0;
+        SGXLKL_VERBOSE("Disk encryption/integrity enabled: Temporarily disabling tracing.\n");
+    }
+
+    for (size_t i = 0; i < num_disk_mounts; i++) {
+        struct lkl_disk_mount *dm = &disk_mounts[i];
+        if (dm->activate) {
+            dm->concurrent = num_activate > 1;
+            dm->thread = lkl_start_in_kernel_stack((void * (*)(void *)) &lkl_activate_disk_thread, (void *) dm);
+        } else {
+            snprintf(dm->dev_str, sizeof(dm->dev_str), "/dev/vd%c", dm->device);
+        }
+    }
+
+    if (disk_mounts[0].activate)
+        lkl_join_thread(disk_mounts[0].thread);
+
+    lkl_mount_root_disk(&disk_mounts[0]);
+
+    if ((lkl_trace_syscall_bak && !sgxlkl_trace_syscall)) {
+        SGXLKL_VERBOSE("Devicemapper setup complete: reenabling lkl_strace\n");
+        sgxlkl_trace_syscall = lkl_trace_syscall_bak;
+    }
+
+    for (size_t i = 1; i < num_disk_mounts; i++) {
+        int err = pthread_create(&disk_mounts[i].thread, NULL, (void * (*)(void *)) &lkl_mount_disk_thread, &disk_mounts[i]);
+        if (err < 0) {
+            fprintf(stderr, "Error: pthread_create()=%s (%d)\n", strerror(err), err);
+            exit(err);
         }
-        lkl_mount_disk(&disks[i], 'a' + i, disks[i].mnt);
+    }
+    for (size_t i = 1; i < num_disk_mounts; i++)
+        lkl_join_thread(disk_mounts[i].thread);
+
+    boot_phase_end(phase);
+
+    if (too_many_disks) {
+        // Adjust number to number of mounted disks.
+        num_disks = 26;
+        return;
     }
 
     if (cwd) {
@@ -781,6 +1081,73 @@ out:
         free(pool_info);
 }
 
+static int set_module_param(const char *module, const char *param, size_t val) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/module/%s/parameters/%s", module, param);
+
+    SGXLKL_VERBOSE("Setting %s.%s=%zu\n", module, param, val);
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    int err = fprintf(f, "%zu", val) < 0;
+    err |= fclose(f) != 0; // The value is only written on flush
+    return err ? -1 : 0;
+}
+
+/*
+ * LKL allocates all kernel memory (page cache, socket buffers, dentry and
+ * inode caches, ...) from a single region of the enclave heap that is reserved
+ * at boot and sized by the mem= kernel parameter. Unless the command line
+ * already sets it, use SGXLKL_KERNEL_MEM or the default size.
+ */
+static char* lkl_build_cmdline(enclave_config_t *encl) {
+    const char *cmdline = encl->kernel_cmd ? encl->kernel_cmd : "";
+
+    for (const char *p = strstr(cmdline, "mem="); p; p = strstr(p + 1, "mem=")) {
+        if (p == cmdline || p[-1] == ' ')
+            return (char *) cmdline;
+    }
+
+    size_t kernel_mem = encl->kernel_mem ? encl->kernel_mem : KERNEL_MEM_DEFAULT;
+    if (encl->kernel_mem && kernel_mem > encl->heapsize / 2) {
+        sgxlkl_warn("Kernel memory of %lu MB exceeds half of the enclave heap, reducing it to %lu MB.\n",
+                    kernel_mem / 1024 / 1024, encl->heapsize / 2 / 1024 / 1024);
+        kernel_mem = encl->heapsize / 2;
+    }
+    SGXLKL_VERBOSE("Kernel memory: %lu MB of %lu MB enclave heap\n",
+                   kernel_mem / 1024 / 1024, encl->heapsize / 1024 / 1024);
+
+    size_t len = strlen(cmdline) + sizeof "mem=18446744073709551615 ";
+    char *buf = malloc(len);
+    if (!buf)
+        sgxlkl_fail("Failed to allocate memory for kernel command line\n");
+    snprintf(buf, len, "mem=%lu %s", kernel_mem, cmdline);
+    return buf;
+}
+
+/*
+ * dm-verity reads hash blocks through dm-bufio and only hashes a block the
+ * first time it is read. Verified blocks then remain in dm-bufio's cache, which
+ * lives in enclave memory, so that reads whose path through the Merkle tree is
+ * cached only need to hash the data block itself. The kernel limits the cache
+ * to a small fraction of its memory by default.
+ */
+static void init_verity_cache(enclave_config_t *encl) {
+    if (encl->verity_cache_size &&
+        set_module_param("dm_bufio", "max_cache_size_bytes", encl->verity_cache_size))
+        sgxlkl_warn("Failed to set dm-verity hash cache size.\n");
+}
+
+/*
+ * Starts the threads that process dm-crypt's requests outside of the LKL CPU
+ * (see src/lkl/override/crypto/sgxlkl_crypto.c).
+ */
+static void init_disk_crypto_threads(enclave_config_t *encl) {
+    if (encl->disk_crypto_threads &&
+        set_module_param("sgxlkl_crypto", "threads", encl->disk_crypto_threads))
+        sgxlkl_warn("Failed to start disk encryption threads, AES-NI may not be available.\n");
+}
+
 void lkl_start_init(enclave_config_t* encl) {
     size_t i;
 
@@ -810,6 +1177,37 @@ void lkl_start_init(enclave_config_t* encl) {
     if (getenv_bool("SGXLKL_TRACE_THREAD", 0))
         sgxlkl_trace_thread = 1;
 
+    // Per-lthread statistics rely on clock_gettime not causing host calls
+    // itself, i.e. on the vDSO being available.
+    if (encl->thread_stats) {
+        if (encl->vvar)
+            lthread_stats_enable();
+        else
+            sgxlkl_warn("SGXLKL_THREAD_STATS requires SGXLKL_GETTIME_VDSO=1. Thread statistics disabled.\n");
+    }
+
+    // Boot phases are recorded with the host's clock, which is only read
+    // without host calls if the vDSO is available.
+    if (encl->boot_prof) {
+        if (encl->vvar)
+            boot_prof = encl->boot_prof;
+        else
+            sgxlkl_warn("SGXLKL_BOOT_PROFILE requires SGXLKL_GETTIME_VDSO=1. Enclave boot phases will not be recorded.\n");
+    }
+
+    if (encl->ethread_park)
+        lthread_park_enable(encl->ethread_park, encl->ethreads, encl->ethreads_min, encl->ethreads_wake_threshold);
+
+    if (encl->huge_pages)
+        enclave_mman_huge_pages();
+
+#ifdef SGXLKL_HW
+    // The TSC estimate for host call timestamps is only used once
+    // clock_gettime is served by the vDSO.
+    if (encl->vvar)
+        enclave_rdtsc_enable();
+#endif
+
     if (encl->hostnet)
         sgxlkl_use_host_network = 1;
 
@@ -824,7 +1222,7 @@ void lkl_start_init(enclave_config_t* encl) {
         net_dev_id = lkl_prestart_net(encl);
 
     // Start kernel threads (synchronous, doesn't return before kernel is ready)
-    const char *lkl_cmdline = encl->kernel_cmd;
+    const char *lkl_cmdline = lkl_build_cmdline(encl);
     SGXLKL_VERBOSE("Kernel command line: \"%s\"\n", lkl_cmdline);
 
     for (i = 0; i < num_disks; ++i) {
@@ -832,12 +1230,19 @@ void lkl_start_init(enclave_config_t* encl) {
         SGXLKL_VERBOSE("Disk %zu: Disk is writable: %s\n", i, (!disks[i].ro ? "YES" : "no"));
     }
 
+    int phase = boot_phase_begin("lkl_start_kernel");
     long res = lkl_start_kernel(&lkl_host_ops, lkl_cmdline);
     if (res < 0) {
         fprintf(stderr, "Error: could not start LKL kernel, %s\n",
             lkl_strerror(res));
         exit(res);
     }
+    boot_phase_end(phase);
+
+    // Paging starts only once LKL has allocated its kernel memory, which must
+    // never be evicted.
+    if (encl->pager_swap)
+        enclave_pager_init(encl);
 
     // Open dummy files to use LKL's 0/1/2 file descriptors
     // (otherwise they will be assigned to the app's first fopen()s
@@ -852,9 +1257,16 @@ void lkl_start_init(enclave_config_t* encl) {
     }
 
     // Now that our kernel is ready to handle syscalls, mount root
+    phase = boot_phase_begin("mount_virtual");
     lkl_mount_virtual();
+    boot_phase_end(phase);
 
+    phase = boot_phase_begin("init_random");
     init_random();
+    boot_phase_end(phase);
+
+    init_verity_cache(encl);
+    init_disk_crypto_threads(encl);
 
     // Set environment variable to export SHMEM address to the application.
     // Note: Due to how putenv() works, we need to allocate the environment
@@ -875,14 +1287,23 @@ void lkl_start_init(enclave_config_t* encl) {
     do_sysctl(encl);
 
     // Set interface status/IP/routes
-    if (!sgxlkl_use_host_network)
+    if (!sgxlkl_use_host_network) {
+        phase = boot_phase_begin("network");
         lkl_poststart_net(encl, net_dev_id);
+        boot_phase_end(phase);
+    }
 
     // Set up wireguard
+    phase = boot_phase_begin("wireguard");
     init_wireguard(encl);
+    boot_phase_end(phase);
 
     // Set hostname (provided through SGXLKL_HOSTNAME)
     sethostname(encl->hostname, strlen(encl->hostname));
+
+    // Enable the syscall fast paths last, setting the hostname above would
+    // otherwise invalidate the cached utsname right away.
+    syscall_fast_init(encl);
 }
 
 /* Requires starttime to be higher or equal to endtime */
@@ -903,6 +1324,13 @@ int timespec_diff(struct timespec *starttime, struct timespec *endtime, struct t
 }
 
 void lkl_exit() {
+    // The libc start code takes sgxlkl_app_starttime right before calling the
+    // application's main function.
+    if (boot_prof && sgxlkl_app_starttime.tv_sec) {
+        uint64_t app_start_ns = sgxlkl_app_starttime.tv_sec * 1000000000ULL + sgxlkl_app_starttime.tv_nsec;
+        boot_phase_end(boot_prof_begin_at(boot_prof, "app", 1, app_start_ns));
+    }
+
     if (getenv("SGXLKL_PRINT_APP_RUNTIME")) {
         struct timespec endtime, runtime;
         clock_gettime(CLOCK_MONOTONIC, &endtime);
@@ -910,6 +1338,10 @@ void lkl_exit() {
         printf("Application runtime: %lld.%.9lds\n", runtime.tv_sec, runtime.tv_nsec);
     }
 
+#ifdef SGXLKL_LOCK_STATS
+    hybrid_lock_stats_print();
+#endif /* SGXLKL_LOCK_STATS */
+
     // Stop attestation/remote control server
     enclave_cmd_servers_stop();
 
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include <lkl.h>
+#include "lkl/syscall_fast.h"
+#include "lthread.h"
+#include "lthread_int.h"
+#include "sgxlkl_debug.h"
+
+/*
+ * Fast paths for trivial system calls
+ *
+ * Every system call that enters LKL takes the LKL CPU lock, which becomes
+ * contended under load even for calls that only return state that never or
+ * rarely changes. The system calls below are answered inside the enclave
+ * instead:
+ *
+ *  - getpid, gettid, get[e]uid, get[e]gid and uname are passed on to LKL once
+ *    and then answered from the cached result (gettid per lthread).
+ *  - clock_gettime is answered from the vDSO for the clocks it supports.
+ *  - sched_yield yields the calling lthread.
+ *  - getrandom is answered with RDRAND.
+ *
+ * Cached credentials and the cached utsname are dropped for good once the
+ * application makes a system call that may change them, after which the
+ * corresponding calls are passed on to LKL again.
+ *
+ * sgx-lkl-musl is linked with --wrap=lkl_syscall (see SGX_LKL_MUSL_LDFLAGS in
+ * config.mak), so that all system calls into LKL go through
+ * __wrap_lkl_syscall. Calls from this file use __real_lkl_syscall directly.
+ */
+
+#ifndef GRND_NONBLOCK
+#define GRND_NONBLOCK 0x0001
+#define GRND_RANDOM   0x0002
+#endif
+
+#define RDRAND_RETRIES 10
+
+enum { CACHE_EMPTY, CACHE_FILLING, CACHE_VALID };
+
+enum { ID_UID, ID_EUID, ID_GID, ID_EGID, ID_MAX };
+
+struct cached_id {
+    int state;
+    long val;
+};
+
+long __real_lkl_syscall(long n, long *params);
+
+static int fast_enabled = 0;
+static int fast_clock = 0;
+
+static struct cached_id cached_pid;
+static struct cached_id cached_ids[ID_MAX];
+static int creds_changed = 0;
+
+static struct utsname cached_uts;
+static int cached_uts_state = CACHE_EMPTY;
+static int uts_changed = 0;
+
+void syscall_fast_init(enclave_config_t *encl) {
+    if (!encl->fast_syscalls)
+        return;
+
+    // Without the vDSO, clock_gettime itself would end up in LKL.
+    fast_clock = encl->vvar != NULL;
+    __atomic_store_n(&fast_enabled, 1, __ATOMIC_RELEASE);
+}
+
+static long lkl_call0(long lkl_n) {
+    long params[6] = {0};
+    return __real_lkl_syscall(lkl_n, params);
+}
+
+/* Returns the cached result of the parameterless LKL system call lkl_n, and
+ * caches it on first use. Results are only cached if *invalid is unset. */
+static long cached_call(struct cached_id *c, long lkl_n, int *invalid) {
+    if (__atomic_load_n(&c->state, __ATOMIC_ACQUIRE) == CACHE_VALID)
+        return c->val;
+
+    long val = lkl_call0(lkl_n);
+    if (val >= 0 && !(invalid && __atomic_load_n(invalid, __ATOMIC_ACQUIRE))) {
+        int expected = CACHE_EMPTY;
+        if (__atomic_compare_exchange_n(&c->state, &expected, CACHE_FILLING, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            c->val = val;
+            __atomic_store_n(&c->state, CACHE_VALID, __ATOMIC_RELEASE);
+        }
+    }
+    return val;
+}
+
+static int fast_getid(int id, long lkl_n, long *ret) {
+    if (__atomic_load_n(&creds_changed, __ATOMIC_ACQUIRE))
+        return 0;
+
+    *ret = cached_call(&cached_ids[id], lkl_n, &creds_changed);
+    return 1;
+}
+
+static int fast_gettid(long *ret) {
+    struct lthread *lt = lthread_self();
+    if (!lt)
+        return 0;
+
+    if (!lt->lkl_tid) {
+        long tid = lkl_call0(__lkl__NR_gettid);
+        if (tid <= 0) {
+            *ret = tid;
+            return 1;
+        }
+        lt->lkl_tid = tid;
+    }
+    *ret = lt->lkl_tid;
+    return 1;
+}
+
+static int fast_uname(struct utsname *buf, long *ret) {
+    if (__atomic_load_n(&uts_changed, __ATOMIC_ACQUIRE))
+        return 0;
+
+    if (__atomic_load_n(&cached_uts_state, __ATOMIC_ACQUIRE) != CACHE_VALID) {
+        long params[6] = {(long) buf};
+        *ret = __real_lkl_syscall(__lkl__NR_uname, params);
+        if (*ret == 0 && !__atomic_load_n(&uts_changed, __ATOMIC_ACQUIRE)) {
+            int expected = CACHE_EMPTY;
+            if (__atomic_compare_exchange_n(&cached_uts_state, &expected, CACHE_FILLING, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                memcpy(&cached_uts, buf, sizeof(cached_uts));
+                __atomic_store_n(&cached_uts_state, CACHE_VALID, __ATOMIC_RELEASE);
+            }
+        }
+        return 1;
+    }
+
+    memcpy(buf, &cached_uts, sizeof(*buf));
+    *ret = 0;
+    return 1;
+}
+
+static int fast_clock_gettime(clockid_t clk, struct timespec *tp, long *ret) {
+    struct lthread *lt;
+
+    switch (clk) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+    case CLOCK_REALTIME_COARSE:
+    case CLOCK_MONOTONIC_COARSE:
+        lt = lthread_self();
+        // musl falls back to the system call if the vDSO fails, which must
+        // go to LKL rather than back into this fast path.
+        if (!fast_clock || !lt || lt->in_fast_clock)
+            return 0;
+        lt->in_fast_clock = 1;
+        *ret = clock_gettime(clk, tp) ? -errno : 0;
+        lt->in_fast_clock = 0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void yield_enqueue(void *lt) {
+    __scheduler_enqueue(lt);
+}
+
+static int fast_sched_yield(long *ret) {
+    struct lthread *lt = lthread_self();
+    if (!lt)
+        return 0;
+
+    // Only make the lthread runnable again once it has been switched out, so
+    // that no other ethread can resume it while it is still running here.
+    _lthread_yield_cb(lt, yield_enqueue, lt);
+    *ret = 0;
+    return 1;
+}
+
+static int rdrand64(uint64_t *val) {
+    unsigned char ok;
+    for (int i = 0; i < RDRAND_RETRIES; i++) {
+        __asm__ volatile ("rdrand %0; setc %1" : "=r" (*val), "=qm" (ok));
+        if (ok)
+            return 1;
+    }
+    return 0;
+}
+
+static int fast_getrandom(char *buf, size_t len, unsigned int flags, long *ret) {
+    if (flags & ~(GRND_NONBLOCK | GRND_RANDOM))
+        return 0;
+    if (len && (!buf || (uintptr_t) buf + len < (uintptr_t) buf)) {
+        *ret = -EFAULT;
+        return 1;
+    }
+
+    size_t done = 0;
+    uint64_t rd;
+    while (done < len) {
+        if (!rdrand64(&rd))
+            break;
+        size_t n = len - done < sizeof(rd) ? len - done : sizeof(rd);
+        memcpy(buf + done, &rd, n);
+        done += n;
+    }
+
+    // Let LKL deal with the unlikely case of RDRAND being exhausted.
+    if (!done && len)
+        return 0;
+
+    *ret = done;
+    return 1;
+}
+
+int syscall_fast(long n, long params[6], long *ret) {
+    if (!__atomic_load_n(&fast_enabled, __ATOMIC_ACQUIRE))
+        return 0;
+
+    int handled;
+
+    switch (n) {
+    case __lkl__NR_getpid:
+        *ret = cached_call(&cached_pid, n, NULL);
+        handled = 1;
+        break;
+    case __lkl__NR_gettid:
+        handled = fast_gettid(ret);
+        break;
+    case __lkl__NR_getuid:
+        handled = fast_getid(ID_UID, n, ret);
+        break;
+    case __lkl__NR_geteuid:
+        handled = fast_getid(ID_EUID, n, ret);
+        break;
+    case __lkl__NR_getgid:
+        handled = fast_getid(ID_GID, n, ret);
+        break;
+    case __lkl__NR_getegid:
+        handled = fast_getid(ID_EGID, n, ret);
+        break;
+    case __lkl__NR_uname:
+        handled = fast_uname((struct utsname *) params[0], ret);
+        break;
+    case __lkl__NR_clock_gettime:
+        handled = fast_clock_gettime((clockid_t) params[0], (struct timespec *) params[1], ret);
+        break;
+    case __lkl__NR_sched_yield:
+        handled = fast_sched_yield(ret);
+        break;
+    case __lkl__NR_getrandom:
+        handled = fast_getrandom((char *) params[0], (size_t) params[1], (unsigned int) params[2], ret);
+        break;
+
+    // Calls that invalidate cached state are always passed on to LKL.
+    case __lkl__NR_setuid:
+    case __lkl__NR_setgid:
+    case __lkl__NR_setreuid:
+    case __lkl__NR_setregid:
+    case __lkl__NR_setresuid:
+    case __lkl__NR_setresgid:
+    case __lkl__NR_setfsuid:
+    case __lkl__NR_setfsgid:
+        __atomic_store_n(&creds_changed, 1, __ATOMIC_RELEASE);
+        return 0;
+    case __lkl__NR_sethostname:
+    case __lkl__NR_setdomainname:
+        __atomic_store_n(&uts_changed, 1, __ATOMIC_RELEASE);
+        return 0;
+    default:
+        return 0;
+    }
+
+    if (handled)
+        log_sgxlkl_syscall(SGXLKL_INTERNAL_SYSCALL, n, *ret, 6, params[0], params[1],
+                           params[2], params[3], params[4], params[5]);
+    return handled;
+}
+
+long __wrap_lkl_syscall(long n, long *params) {
+    long ret;
+    if (syscall_fast(n, params, &ret))
+        return ret;
+    return __real_lkl_syscall(n, params);
+}
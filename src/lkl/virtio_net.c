@@ -149,6 +149,8 @@ static int sgxlkl_fd_net_poll(struct lkl_netdev *nd) {
         pfds[0].events |= POLLOUT;
 
     do {
+        /* Waits for network I/O without timeout */
+        hostcall_may_block();
         ret = host_syscall_SYS_poll(pfds, 2, -1);
     } while (ret == -EINTR);
 
@@ -37,69 +37,90 @@ struct sgxlkl_config_elem {
 
 static struct sgxlkl_config_elem sgxlkl_config[] = {
  /*  0 */ {"SGXLKL_APP_CONFIG",               "app_config",               TYPE_JSON, {.def_char = NULL}, 0},
- /*  1 */ {"SGXLKL_CMDLINE",                  "cmdline",                  TYPE_CHAR, {.def_char = ""}, 0},
- /*  2 */ {"SGXLKL_CWD",                      "cwd",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_CWD}, 0},
- /*  3 */ {"SGXLKL_DEBUGMOUNT",               "debugmount",               TYPE_CHAR, {.def_char = NULL}, 0},
- /*  4 */ {"SGXLKL_ESPINS",                   "espins",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_ESPINS, ULONG_MAX}}, 0},
- /*  5 */ {"SGXLKL_ESLEEP",                   "esleep",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_ESLEEP, ULONG_MAX}}, 0},
- /*  6 */ {"SGXLKL_ETHREADS",                 "ethreads",                 TYPE_UINT, {.def_uint = {1, MAX_SGXLKL_ETHREADS}}, 0},
- /*  7 */ {"SGXLKL_ETHREADS_AFFINITY",        "ethreads_affinity",        TYPE_CHAR, {.def_char = NULL}, 0},
- /*  8 */ {"SGXLKL_EXIT_ON_HOST_CALLS",       "exit_on_host_calls",       TYPE_BOOL, {.def_bool = 0}, 0},
- /*  9 */ {"SGXLKL_GETTIME_VDSO",             "gettime_vdso",             TYPE_BOOL, {.def_bool = 1}, 0},
- /* 10 */ {"SGXLKL_GW4",                      "gw4",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_GW4}, 0},
- /* 11 */ {"SGXLKL_HD",                       "hd",                       TYPE_CHAR, {.def_char = NULL}, 0},
- /* 12 */ {"SGXLKL_HD_KEY",                   "hd_key",                   TYPE_CHAR, {.def_char = NULL}, 0},
- /* 13 */ {"SGXLKL_HD_RO",                    "hd_readonly",              TYPE_BOOL, {.def_bool = 0}, 0},
- /* 14 */ {"SGXLKL_HDS",                      "hds",                      TYPE_CHAR, {.def_char = ""}, 0},
- /* 15 */ {"SGXLKL_HD_VERITY",                "hd_verity",                TYPE_CHAR, {.def_char = NULL}, 0},
- /* 16 */ {"SGXLKL_HD_VERITY_OFFSET",         "hd_verity_offset",         TYPE_CHAR, {.def_char = NULL}, 0}, //TODO: Change to uint64
- /* 17 */ {"SGXLKL_HEAP",                     "heap",                     TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_HEAP_SIZE, ULONG_MAX}}, 0},
- /* 18 */ {"SGXLKL_HOSTNAME",                 "hostname",                 TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_HOSTNAME}, 0},
- /* 19 */ {"SGXLKL_HOSTNET",                  "hostnet",                  TYPE_BOOL, {.def_bool = 0}, 0},
- /* 20 */ {"SGXLKL_IAS_QUOTE_TYPE",           "ias_quote_type",           TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IAS_QUOTE_TYPE}, 0},
- /* 21 */ {"SGXLKL_IAS_SERVER",               "ias_server",               TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IAS_SERVER}, 0},
- /* 22 */ {"SGXLKL_IAS_SPID",                 "ias_spid",                 TYPE_CHAR, {.def_char = NULL}, 0},
- /* 23 */ {"SGXLKL_IAS_SUBSCRIPT_KEY",        "ias_subscription_key",     TYPE_CHAR, {.def_char = NULL}, 0},
- /* 24 */ {"SGXLKL_IP4",                      "ip4",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IP4}, 0},
- /* 25 */ {"SGXLKL_KERNEL_VERBOSE",           "kernel_verbose",           TYPE_BOOL, {.def_bool = 0}, 0},
- /* 26 */ {"SGXLKL_KEY",                      "key",                      TYPE_CHAR, {.def_char = NULL}, 0},
- /* 27 */ {"SGXLKL_MASK4",                    "mask4",                    TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_MASK4, 32}}, 0},
- /* 28 */ {"SGXLKL_MAX_USER_THREADS",         "max_user_threads",         TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_MAX_USER_THREADS, MAX_SGXLKL_MAX_USER_THREADS}}, 0},
- /* 29 */ {"SGXLKL_MMAP_FILES",               "mmap_files",               TYPE_CHAR, {.def_char = "None"}, 0},
- /* 30 */ {"SGXLKL_NON_PIE",                  "non_pie",                  TYPE_BOOL, {.def_bool = 0}, 0},
- /* 31 */ {"SGXLKL_PRINT_APP_RUNTIME",        "print_app_runtime",        TYPE_BOOL, {.def_bool = 0}, 0},
- /* 32 */ {"SGXLKL_PRINT_HOST_SYSCALL_STATS", "print_host_syscall_stats", TYPE_BOOL, {.def_bool = 0}, 0},
- /* 33 */ {"SGXLKL_REAL_TIME_PRIO",           "real_time_prio",           TYPE_BOOL, {.def_bool = 0}, 0},
- /* 34 */ {"SGXLKL_REMOTE_ATTEST_PORT",       "remote_attest_port",       TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_REMOTE_ATTEST_PORT, USHRT_MAX}}, 0},
- /* 35 */ {"SGXLKL_REMOTE_CMD_PORT",          "remote_cmd_port",          TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_REMOTE_CMD_PORT, USHRT_MAX}}, 0},
- /* 36 */ {"SGXLKL_REMOTE_CMD_ETH0",          "remote_cmd_eth0",          TYPE_BOOL, {.def_bool = 0}, 0},
- /* 37 */ {"SGXLKL_REMOTE_CONFIG",            "remote_config",            TYPE_BOOL, {.def_bool = 0}, 0},
- /* 38 */ {"SGXLKL_REPORT_NONCE",             "report_nonce",             TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
- /* 39 */ {"SGXLKL_SHMEM_FILE",               "shmem_file",               TYPE_CHAR, {.def_char = NULL}, 0},
- /* 40 */ {"SGXLKL_SHMEM_SIZE",               "shmem_size",               TYPE_UINT, {.def_uint = {0, 1024 * 1024 * 1024}}, 0},
- /* 41 */ {"SGXLKL_SIGPIPE",                  "sigpipe",                  TYPE_BOOL, {.def_bool = 0}, 0},
- /* 42 */ {"SGXLKL_SSLEEP",                   "ssleep",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_SSLEEP, ULONG_MAX}}, 0},
- /* 43 */ {"SGXLKL_SSPINS",                   "sspins",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_SSPINS, ULONG_MAX}}, 0},
- /* 44 */ {"SGXLKL_STACK_SIZE",               "stack_size",               TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_STACK_SIZE, ULONG_MAX}}, 0},
- /* 45 */ {"SGXLKL_STHREADS",                 "sthreads",                 TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_STHREADS, MAX_SGXLKL_STHREADS}}, 0},
- /* 46 */ {"SGXLKL_STHREADS_AFFINITY",        "sthreads_affinity",        TYPE_CHAR, {.def_char = NULL}, 0},
- /* 47 */ {"SGXLKL_SYSCTL",                   "sysctl",                   TYPE_CHAR, {.def_char = NULL}, 0},
- /* 48 */ {"SGXLKL_TAP",                      "tap",                      TYPE_CHAR, {.def_char = NULL}, 0},
- /* 49 */ {"SGXLKL_TAP_MTU",                  "tap_mtu",                  TYPE_UINT, {.def_uint = {0, INT_MAX}}, 0},
- /* 50 */ {"SGXLKL_TAP_OFFLOAD",              "tap_offload",              TYPE_BOOL, {.def_bool = 0}, 0},
- /* 51 */ {"SGXLKL_TRACE_HOST_SYSCALL",       "trace_host_syscall",       TYPE_BOOL, {.def_bool = 0}, 0},
- /* 52 */ {"SGXLKL_TRACE_INTERNAL_SYSCALL",   "trace_internal_syscall",   TYPE_BOOL, {.def_bool = 0}, 0},
- /* 53 */ {"SGXLKL_TRACE_LKL_SYSCALL",        "trace_lkl_syscall",        TYPE_BOOL, {.def_bool = 0}, 0},
- /* 54 */ {"SGXLKL_TRACE_MMAP",               "trace_mmap",               TYPE_BOOL, {.def_bool = 0}, 0},
- /* 55 */ {"SGXLKL_TRACE_SYSCALL",            "trace_syscall",            TYPE_BOOL, {.def_bool = 0}, 0},
- /* 56 */ {"SGXLKL_TRACE_THREAD",             "trace_thread",             TYPE_BOOL, {.def_bool = 0}, 0},
- /* 57 */ {"SGXLKL_VERBOSE",                  "verbose",                  TYPE_BOOL, {.def_bool = 0}, 0},
- /* 58 */ {"SGXLKL_WAIT_ON_HOST_CALLS",       "wait_on_host_calls",       TYPE_BOOL, {.def_bool = 0}, 0},
- /* 59 */ {"SGXLKL_WAIT_ON_IO_HOST_CALLS",    "wait_on_io_host_calls",    TYPE_BOOL, {.def_bool = 0}, 0},
- /* 60 */ {"SGXLKL_WG_IP",                    "wg_ip",                    TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_WG_IP}, 0},
- /* 61 */ {"SGXLKL_WG_PORT",                  "wg_port",                  TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_WG_PORT, USHRT_MAX}}, 0},
- /* 62 */ {"SGXLKL_WG_KEY",                   "wg_key",                   TYPE_CHAR, {.def_char = NULL}, 0},
- /* 63 */ {"SGXLKL_WG_PEERS",                 "wg_peers",                 TYPE_CHAR, {.def_char = ""}, 0},
+ /*  1 */ {"SGXLKL_BLOCKING_STHREADS",        "blocking_sthreads",        TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_BLOCKING_STHREADS, MAX_SGXLKL_STHREADS}}, 0},
+ /*  2 */ {"SGXLKL_BOOT_PROFILE",             "boot_profile",             TYPE_CHAR, {.def_char = NULL}, 0},
+ /*  3 */ {"SGXLKL_CMDLINE",                  "cmdline",                  TYPE_CHAR, {.def_char = ""}, 0},
+ /*  4 */ {"SGXLKL_CWD",                      "cwd",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_CWD}, 0},
+ /*  5 */ {"SGXLKL_DEBUGMOUNT",               "debugmount",               TYPE_CHAR, {.def_char = NULL}, 0},
+ /*  6 */ {"SGXLKL_ESPINS",                   "espins",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_ESPINS, ULONG_MAX}}, 0},
+ /*  7 */ {"SGXLKL_ESLEEP",                   "esleep",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_ESLEEP, ULONG_MAX}}, 0},
+ /*  8 */ {"SGXLKL_ETHREADS",                 "ethreads",                 TYPE_UINT, {.def_uint = {1, MAX_SGXLKL_ETHREADS}}, 0},
+ /*  9 */ {"SGXLKL_ETHREADS_AFFINITY",        "ethreads_affinity",        TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 10 */ {"SGXLKL_ETHREADS_MIN",             "ethreads_min",             TYPE_UINT, {.def_uint = {0, MAX_SGXLKL_ETHREADS}}, 0},
+ /* 11 */ {"SGXLKL_ETHREADS_WAKE_THRESHOLD",  "ethreads_wake_threshold",  TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_ETHREADS_WAKE_THRESHOLD, ULONG_MAX}}, 0},
+ /* 12 */ {"SGXLKL_EXIT_ON_HOST_CALLS",       "exit_on_host_calls",       TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 13 */ {"SGXLKL_EXIT_PROFILE",             "exit_profile",             TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 14 */ {"SGXLKL_EXIT_PROFILE_PERIOD",      "exit_profile_period",      TYPE_UINT, {.def_uint = {1, ULONG_MAX}}, 0},
+ /* 15 */ {"SGXLKL_FAST_SYSCALLS",            "fast_syscalls",            TYPE_BOOL, {.def_bool = 1}, 0},
+ /* 16 */ {"SGXLKL_GETTIME_VDSO",             "gettime_vdso",             TYPE_BOOL, {.def_bool = 1}, 0},
+ /* 17 */ {"SGXLKL_GW4",                      "gw4",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_GW4}, 0},
+ /* 18 */ {"SGXLKL_HD",                       "hd",                       TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 19 */ {"SGXLKL_HD_CRYPTO_THREADS",        "hd_crypto_threads",        TYPE_UINT, {.def_uint = {0, 64}}, 0},
+ /* 20 */ {"SGXLKL_HD_KEY",                   "hd_key",                   TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 21 */ {"SGXLKL_HD_KEY_IS_VOLUME_KEY",     "hd_key_is_volume_key",     TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 22 */ {"SGXLKL_HD_PREFETCH",              "hd_prefetch",              TYPE_BOOL, {.def_bool = 1}, 0},
+ /* 23 */ {"SGXLKL_HD_PREFETCH_WINDOW",       "hd_prefetch_window",       TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_HD_PREFETCH_WINDOW, ULONG_MAX}}, 0},
+ /* 24 */ {"SGXLKL_HD_RO",                    "hd_readonly",              TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 25 */ {"SGXLKL_HDS",                      "hds",                      TYPE_CHAR, {.def_char = ""}, 0},
+ /* 26 */ {"SGXLKL_HD_TRACE",                 "hd_trace",                 TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 27 */ {"SGXLKL_HD_VERITY",                "hd_verity",                TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 28 */ {"SGXLKL_HD_VERITY_BLOCK_SIZE",     "hd_verity_block_size",     TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_HD_VERITY_BLOCK_SIZE, 4096}}, 0},
+ /* 29 */ {"SGXLKL_HD_VERITY_CACHE_SIZE",     "hd_verity_cache_size",     TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
+ /* 30 */ {"SGXLKL_HD_VERITY_OFFSET",         "hd_verity_offset",         TYPE_CHAR, {.def_char = NULL}, 0}, //TODO: Change to uint64
+ /* 31 */ {"SGXLKL_HEAP",                     "heap",                     TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_HEAP_SIZE, ULONG_MAX}}, 0},
+ /* 32 */ {"SGXLKL_HOSTNAME",                 "hostname",                 TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_HOSTNAME}, 0},
+ /* 33 */ {"SGXLKL_HOSTNET",                  "hostnet",                  TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 34 */ {"SGXLKL_HOST_CALL_RINGS",          "host_call_rings",          TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 35 */ {"SGXLKL_HUGEPAGES",                "hugepages",                TYPE_UINT, {.def_uint = {0, 2}}, 0},
+ /* 36 */ {"SGXLKL_IAS_QUOTE_TYPE",           "ias_quote_type",           TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IAS_QUOTE_TYPE}, 0},
+ /* 37 */ {"SGXLKL_IAS_SERVER",               "ias_server",               TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IAS_SERVER}, 0},
+ /* 38 */ {"SGXLKL_IAS_SPID",                 "ias_spid",                 TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 39 */ {"SGXLKL_IAS_SUBSCRIPT_KEY",        "ias_subscription_key",     TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 40 */ {"SGXLKL_IP4",                      "ip4",                      TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_IP4}, 0},
+ /* 41 */ {"SGXLKL_KERNEL_MEM",               "kernel_mem",               TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
+ /* 42 */ {"SGXLKL_KERNEL_VERBOSE",           "kernel_verbose",           TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 43 */ {"SGXLKL_KEY",                      "key",                      TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 44 */ {"SGXLKL_MASK4",                    "mask4",                    TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_MASK4, 32}}, 0},
+ /* 45 */ {"SGXLKL_MAX_USER_THREADS",         "max_user_threads",         TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_MAX_USER_THREADS, MAX_SGXLKL_MAX_USER_THREADS}}, 0},
+ /* 46 */ {"SGXLKL_MMAP_FILES",               "mmap_files",               TYPE_CHAR, {.def_char = "None"}, 0},
+ /* 47 */ {"SGXLKL_NON_PIE",                  "non_pie",                  TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 48 */ {"SGXLKL_PAGER_CHUNK_SIZE",         "pager_chunk_size",         TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_PAGER_CHUNK_SIZE, ULONG_MAX}}, 0},
+ /* 49 */ {"SGXLKL_PAGER_RESIDENT_SIZE",      "pager_resident_size",      TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
+ /* 50 */ {"SGXLKL_PAGER_SWAP_SIZE",          "pager_swap_size",          TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
+ /* 51 */ {"SGXLKL_PRINT_APP_RUNTIME",        "print_app_runtime",        TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 52 */ {"SGXLKL_PRINT_HOST_SYSCALL_STATS", "print_host_syscall_stats", TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 53 */ {"SGXLKL_REAL_TIME_PRIO",           "real_time_prio",           TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 54 */ {"SGXLKL_REMOTE_ATTEST_PORT",       "remote_attest_port",       TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_REMOTE_ATTEST_PORT, USHRT_MAX}}, 0},
+ /* 55 */ {"SGXLKL_REMOTE_CMD_PORT",          "remote_cmd_port",          TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_REMOTE_CMD_PORT, USHRT_MAX}}, 0},
+ /* 56 */ {"SGXLKL_REMOTE_CMD_ETH0",          "remote_cmd_eth0",          TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 57 */ {"SGXLKL_REMOTE_CONFIG",            "remote_config",            TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 58 */ {"SGXLKL_REPORT_NONCE",             "report_nonce",             TYPE_UINT, {.def_uint = {0, ULONG_MAX}}, 0},
+ /* 59 */ {"SGXLKL_SHMEM_FILE",               "shmem_file",               TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 60 */ {"SGXLKL_SHMEM_SIZE",               "shmem_size",               TYPE_UINT, {.def_uint = {0, 1024 * 1024 * 1024}}, 0},
+ /* 61 */ {"SGXLKL_SIGPIPE",                  "sigpipe",                  TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 62 */ {"SGXLKL_SSLEEP",                   "ssleep",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_SSLEEP, ULONG_MAX}}, 0},
+ /* 63 */ {"SGXLKL_SSPINS",                   "sspins",                   TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_SSPINS, ULONG_MAX}}, 0},
+ /* 64 */ {"SGXLKL_STACK_SIZE",               "stack_size",               TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_STACK_SIZE, ULONG_MAX}}, 0},
+ /* 65 */ {"SGXLKL_STHREADS",                 "sthreads",                 TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_STHREADS, MAX_SGXLKL_STHREADS}}, 0},
+ /* 66 */ {"SGXLKL_STHREADS_AFFINITY",        "sthreads_affinity",        TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 67 */ {"SGXLKL_SYSCTL",                   "sysctl",                   TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 68 */ {"SGXLKL_TAP",                      "tap",                      TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 69 */ {"SGXLKL_TAP_MTU",                  "tap_mtu",                  TYPE_UINT, {.def_uint = {0, INT_MAX}}, 0},
+ /* 70 */ {"SGXLKL_TAP_OFFLOAD",              "tap_offload",              TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 71 */ {"SGXLKL_THREAD_STATS",             "thread_stats",             TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 72 */ {"SGXLKL_TRACE_HOST_SYSCALL",       "trace_host_syscall",       TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 73 */ {"SGXLKL_TRACE_INTERNAL_SYSCALL",   "trace_internal_syscall",   TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 74 */ {"SGXLKL_TRACE_LKL_SYSCALL",        "trace_lkl_syscall",        TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 75 */ {"SGXLKL_TRACE_MMAP",               "trace_mmap",               TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 76 */ {"SGXLKL_TRACE_SYSCALL",            "trace_syscall",            TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 77 */ {"SGXLKL_TRACE_THREAD",             "trace_thread",             TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 78 */ {"SGXLKL_VERBOSE",                  "verbose",                  TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 79 */ {"SGXLKL_WAIT_ON_HOST_CALLS",       "wait_on_host_calls",       TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 80 */ {"SGXLKL_WAIT_ON_IO_HOST_CALLS",    "wait_on_io_host_calls",    TYPE_BOOL, {.def_bool = 0}, 0},
+ /* 81 */ {"SGXLKL_WG_IP",                    "wg_ip",                    TYPE_CHAR, {.def_char = DEFAULT_SGXLKL_WG_IP}, 0},
+ /* 82 */ {"SGXLKL_WG_PORT",                  "wg_port",                  TYPE_UINT, {.def_uint = {DEFAULT_SGXLKL_WG_PORT, USHRT_MAX}}, 0},
+ /* 83 */ {"SGXLKL_WG_KEY",                   "wg_key",                   TYPE_CHAR, {.def_char = NULL}, 0},
+ /* 84 */ {"SGXLKL_WG_PEERS",                 "wg_peers",                 TYPE_CHAR, {.def_char = ""}, 0},
 };
 
 static inline struct sgxlkl_config_elem *config_elem_by_key(const char *key) {
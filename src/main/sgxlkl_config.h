@@ -2,73 +2,96 @@
 #define SGXLKL_CONFIG_H
 
 #define SGXLKL_APP_CONFIG               0
-#define SGXLKL_CMDLINE                  1
-#define SGXLKL_CWD                      2
-#define SGXLKL_DEBUGMOUNT               3
-#define SGXLKL_ESPINS                   4
-#define SGXLKL_ESLEEP                   5
-#define SGXLKL_ETHREADS                 6
-#define SGXLKL_ETHREADS_AFFINITY        7
-#define SGXLKL_EXIT_ON_HOST_CALLS       8
-#define SGXLKL_GETTIME_VDSO             9
-#define SGXLKL_GW4                      10
-#define SGXLKL_HD                       11
-#define SGXLKL_HD_KEY                   12
-#define SGXLKL_HD_RO                    13
-#define SGXLKL_HDS                      14
-#define SGXLKL_HD_VERITY                15
-#define SGXLKL_HD_VERITY_OFFSET         16
-#define SGXLKL_HEAP                     17
-#define SGXLKL_HOSTNAME                 18
-#define SGXLKL_HOSTNET                  19
-#define SGXLKL_IAS_QUOTE_TYPE           20
-#define SGXLKL_IAS_SERVER               21
-#define SGXLKL_IAS_SPID                 22
-#define SGXLKL_IAS_SUBSCRIPT_KEY        23
-#define SGXLKL_IP4                      24
-#define SGXLKL_KERNEL_VERBOSE           25
-#define SGXLKL_KEY                      26
-#define SGXLKL_MASK4                    27
-#define SGXLKL_MAX_USER_THREADS         28
-#define SGXLKL_MMAP_FILES               29
-#define SGXLKL_NON_PIE                  30
-#define SGXLKL_PRINT_APP_RUNTIME        31
-#define SGXLKL_PRINT_HOST_SYSCALL_STATS 32
-#define SGXLKL_REAL_TIME_PRIO           33
-#define SGXLKL_REMOTE_ATTEST_PORT       34
-#define SGXLKL_REMOTE_CMD_PORT          35
-#define SGXLKL_REMOTE_CMD_ETH0          36
-#define SGXLKL_REMOTE_CONFIG            37
-#define SGXLKL_REPORT_NONCE             38
-#define SGXLKL_SHMEM_FILE               39
-#define SGXLKL_SHMEM_SIZE               40
-#define SGXLKL_SIGPIPE                  41
-#define SGXLKL_SSLEEP                   42
-#define SGXLKL_SSPINS                   43
-#define SGXLKL_STACK_SIZE               44
-#define SGXLKL_STHREADS                 45
-#define SGXLKL_STHREADS_AFFINITY        46
-#define SGXLKL_SYSCTL                   47
-#define SGXLKL_TAP                      48
-#define SGXLKL_TAP_MTU                  49
-#define SGXLKL_TAP_OFFLOAD              50
-#define SGXLKL_TRACE_HOST_SYSCALL       51
-#define SGXLKL_TRACE_INTERNAL_SYSCALL   52
-#define SGXLKL_TRACE_LKL_SYSCALL        53
-#define SGXLKL_TRACE_MMAP               54
-#define SGXLKL_TRACE_SYSCALL            55
-#define SGXLKL_TRACE_THREAD             56
-#define SGXLKL_VERBOSE                  57
-#define SGXLKL_WAIT_ON_HOST_CALLS       58
-#define SGXLKL_WAIT_ON_IO_HOST_CALLS    59
-#define SGXLKL_WG_IP                    60
-#define SGXLKL_WG_PORT                  61
-#define SGXLKL_WG_KEY                   62
-#define SGXLKL_WG_PEERS                 63
+#define SGXLKL_BLOCKING_STHREADS        1
+#define SGXLKL_BOOT_PROFILE             2
+#define SGXLKL_CMDLINE                  3
+#define SGXLKL_CWD                      4
+#define SGXLKL_DEBUGMOUNT               5
+#define SGXLKL_ESPINS                   6
+#define SGXLKL_ESLEEP                   7
+#define SGXLKL_ETHREADS                 8
+#define SGXLKL_ETHREADS_AFFINITY        9
+#define SGXLKL_ETHREADS_MIN             10
+#define SGXLKL_ETHREADS_WAKE_THRESHOLD  11
+#define SGXLKL_EXIT_ON_HOST_CALLS       12
+#define SGXLKL_EXIT_PROFILE             13
+#define SGXLKL_EXIT_PROFILE_PERIOD      14
+#define SGXLKL_FAST_SYSCALLS            15
+#define SGXLKL_GETTIME_VDSO             16
+#define SGXLKL_GW4                      17
+#define SGXLKL_HD                       18
+#define SGXLKL_HD_CRYPTO_THREADS        19
+#define SGXLKL_HD_KEY                   20
+#define SGXLKL_HD_KEY_IS_VOLUME_KEY     21
+#define SGXLKL_HD_PREFETCH              22
+#define SGXLKL_HD_PREFETCH_WINDOW       23
+#define SGXLKL_HD_RO                    24
+#define SGXLKL_HDS                      25
+#define SGXLKL_HD_TRACE                 26
+#define SGXLKL_HD_VERITY                27
+#define SGXLKL_HD_VERITY_BLOCK_SIZE     28
+#define SGXLKL_HD_VERITY_CACHE_SIZE     29
+#define SGXLKL_HD_VERITY_OFFSET         30
+#define SGXLKL_HEAP                     31
+#define SGXLKL_HOSTNAME                 32
+#define SGXLKL_HOSTNET                  33
+#define SGXLKL_HOST_CALL_RINGS          34
+#define SGXLKL_HUGEPAGES                35
+#define SGXLKL_IAS_QUOTE_TYPE           36
+#define SGXLKL_IAS_SERVER               37
+#define SGXLKL_IAS_SPID                 38
+#define SGXLKL_IAS_SUBSCRIPT_KEY        39
+#define SGXLKL_IP4                      40
+#define SGXLKL_KERNEL_MEM               41
+#define SGXLKL_KERNEL_VERBOSE           42
+#define SGXLKL_KEY                      43
+#define SGXLKL_MASK4                    44
+#define SGXLKL_MAX_USER_THREADS         45
+#define SGXLKL_MMAP_FILES               46
+#define SGXLKL_NON_PIE                  47
+#define SGXLKL_PAGER_CHUNK_SIZE         48
+#define SGXLKL_PAGER_RESIDENT_SIZE      49
+#define SGXLKL_PAGER_SWAP_SIZE          50
+#define SGXLKL_PRINT_APP_RUNTIME        51
+#define SGXLKL_PRINT_HOST_SYSCALL_STATS 52
+#define SGXLKL_REAL_TIME_PRIO           53
+#define SGXLKL_REMOTE_ATTEST_PORT       54
+#define SGXLKL_REMOTE_CMD_PORT          55
+#define SGXLKL_REMOTE_CMD_ETH0          56
+#define SGXLKL_REMOTE_CONFIG            57
+#define SGXLKL_REPORT_NONCE             58
+#define SGXLKL_SHMEM_FILE               59
+#define SGXLKL_SHMEM_SIZE               60
+#define SGXLKL_SIGPIPE                  61
+#define SGXLKL_SSLEEP                   62
+#define SGXLKL_SSPINS                   63
+#define SGXLKL_STACK_SIZE               64
+#define SGXLKL_STHREADS                 65
+#define SGXLKL_STHREADS_AFFINITY        66
+#define SGXLKL_SYSCTL                   67
+#define SGXLKL_TAP                      68
+#define SGXLKL_TAP_MTU                  69
+#define SGXLKL_TAP_OFFLOAD              70
+#define SGXLKL_THREAD_STATS             71
+#define SGXLKL_TRACE_HOST_SYSCALL       72
+#define SGXLKL_TRACE_INTERNAL_SYSCALL   73
+#define SGXLKL_TRACE_LKL_SYSCALL        74
+#define SGXLKL_TRACE_MMAP               75
+#define SGXLKL_TRACE_SYSCALL            76
+#define SGXLKL_TRACE_THREAD             77
+#define SGXLKL_VERBOSE                  78
+#define SGXLKL_WAIT_ON_HOST_CALLS       79
+#define SGXLKL_WAIT_ON_IO_HOST_CALLS    80
+#define SGXLKL_WG_IP                    81
+#define SGXLKL_WG_PORT                  82
+#define SGXLKL_WG_KEY                   83
+#define SGXLKL_WG_PEERS                 84
 
 
 #define DEFAULT_SGXLKL_CWD "/"
 #define DEFAULT_SGXLKL_GW4 "10.0.1.254"
+#define DEFAULT_SGXLKL_HD_PREFETCH_WINDOW 32 * 1024 * 1024
+#define DEFAULT_SGXLKL_HD_VERITY_BLOCK_SIZE 4096
 /* The default heap size will only be used if no heap size is specified and
  * either we are in simulation mode, or we are in HW mode and a key is provided
  * via SGXLKL_KEY.
@@ -80,9 +103,12 @@
 #define DEFAULT_SGXLKL_IP4 "10.0.1.1"
 #define DEFAULT_SGXLKL_MASK4 24
 #define DEFAULT_SGXLKL_MAX_USER_THREADS 256
+#define DEFAULT_SGXLKL_PAGER_CHUNK_SIZE 1024 * 1024
 #define DEFAULT_SGXLKL_ESLEEP 16000
 #define DEFAULT_SGXLKL_ETHREADS 1
+#define DEFAULT_SGXLKL_ETHREADS_WAKE_THRESHOLD 1
 #define DEFAULT_SGXLKL_STHREADS 4
+#define DEFAULT_SGXLKL_BLOCKING_STHREADS 16
 #define DEFAULT_SGXLKL_ESPINS 500
 #define DEFAULT_SGXLKL_SSLEEP 4000
 #define DEFAULT_SGXLKL_SSPINS 100
@@ -0,0 +1,362 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sgx_enclave_config.h"
+#include "sgxlkl_config.h"
+#include "sgxlkl_host_debug.h"
+#include "sgxlkl_host_stats.h"
+#include "sgxlkl_util.h"
+
+#define HOSTCALL_HIST_MAX_THREADS (MAX_SGXLKL_STHREADS + MAX_SGXLKL_ETHREADS)
+
+struct hostcall_hist {
+    uint64_t queue[HOSTCALL_HIST_MAX_SYSCALL][HOSTCALL_HIST_BUCKETS];
+    uint64_t exec[HOSTCALL_HIST_MAX_SYSCALL][HOSTCALL_HIST_BUCKETS];
+};
+
+static struct hostcall_hist *_hists[HOSTCALL_HIST_MAX_THREADS];
+static int _num_hists = 0;
+static __thread struct hostcall_hist *_hist;
+
+static struct hostcall_hist *hostcall_hist_self(void) {
+    if (_hist)
+        return _hist;
+
+    int idx = __sync_fetch_and_add(&_num_hists, 1);
+    if (idx >= HOSTCALL_HIST_MAX_THREADS || !(_hist = calloc(1, sizeof(*_hist))))
+        return NULL;
+
+    _hists[idx] = _hist;
+    return _hist;
+}
+
+static inline int hist_bucket(uint64_t cycles) {
+    int b = cycles ? 63 - __builtin_clzll(cycles) : 0;
+    return b < HOSTCALL_HIST_BUCKETS ? b : HOSTCALL_HIST_BUCKETS - 1;
+}
+
+void hostcall_hist_record(uint64_t syscallno, uint64_t enqueue_tsc, uint64_t dequeue_tsc, uint64_t done_tsc) {
+    struct hostcall_hist *h;
+    if (syscallno >= HOSTCALL_HIST_MAX_SYSCALL || !(h = hostcall_hist_self()))
+        return;
+
+    // The TSC values of the enclave and host threads might be slightly out of
+    // sync if they run on different cores, ignore negative queueing times.
+    if (enqueue_tsc && dequeue_tsc >= enqueue_tsc)
+        h->queue[syscallno][hist_bucket(dequeue_tsc - enqueue_tsc)]++;
+    h->exec[syscallno][hist_bucket(done_tsc - dequeue_tsc)]++;
+}
+
+/* Returns the upper bound (in cycles) of the bucket containing percentile p */
+static uint64_t hist_percentile(const uint64_t *buckets, uint64_t total, int p) {
+    uint64_t sum = 0, target = (total * p + 99) / 100;
+    for (int b = 0; b < HOSTCALL_HIST_BUCKETS; b++) {
+        sum += buckets[b];
+        if (sum >= target)
+            return 2ULL << b;
+    }
+    return 2ULL << (HOSTCALL_HIST_BUCKETS - 1);
+}
+
+/* Formats into a stack buffer and writes it with write(2) rather than stdio,
+ * as the histograms are printed from a signal handler. */
+static void hist_printf(const char *fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0)
+        return;
+    if (len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    for (int off = 0, ret; off < len; off += ret) {
+        if ((ret = write(STDERR_FILENO, buf + off, len - off)) <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                ret = 0;
+                continue;
+            }
+            return;
+        }
+    }
+}
+
+void hostcall_hist_print(void) {
+    int saved_errno = errno;
+    uint64_t queue[HOSTCALL_HIST_BUCKETS], exec[HOSTCALL_HIST_BUCKETS];
+    int num_hists = _num_hists < HOSTCALL_HIST_MAX_THREADS ? _num_hists : HOSTCALL_HIST_MAX_THREADS;
+
+    hist_printf("\nHost call latencies (TSC cycles, upper bound of log2 histogram bucket):\n");
+    hist_printf("%20s %4s %10s %10s %12s %12s %10s %12s %12s\n", "Syscall", "No.",
+            "Calls", "queue p50", "queue p99", "queue max", "exec p50", "exec p99", "exec max");
+
+    for (int i = 0; i < HOSTCALL_HIST_MAX_SYSCALL; i++) {
+        uint64_t nqueue = 0, nexec = 0;
+        memset(queue, 0, sizeof(queue));
+        memset(exec, 0, sizeof(exec));
+        for (int t = 0; t < num_hists; t++) {
+            if (!_hists[t])
+                continue;
+            for (int b = 0; b < HOSTCALL_HIST_BUCKETS; b++) {
+                queue[b] += _hists[t]->queue[i][b];
+                exec[b] += _hists[t]->exec[i][b];
+            }
+        }
+        for (int b = 0; b < HOSTCALL_HIST_BUCKETS; b++) {
+            nqueue += queue[b];
+            nexec += exec[b];
+        }
+
+        if (!nexec)
+            continue;
+
+        hist_printf("%20s %4d %10lu", i < sizeof(_syscall_names)/sizeof(_syscall_names[0]) ? _syscall_names[i] : "UNKNOWN", i, nexec);
+        // Queueing times are unknown if the enclave can't read the TSC.
+        if (nqueue)
+            hist_printf(" %10lu %12lu %12lu", hist_percentile(queue, nqueue, 50),
+                    hist_percentile(queue, nqueue, 99), hist_percentile(queue, nqueue, 100));
+        else
+            hist_printf(" %10s %12s %12s", "-", "-", "-");
+        hist_printf(" %10lu %12lu %12lu\n", hist_percentile(exec, nexec, 50),
+                hist_percentile(exec, nexec, 99), hist_percentile(exec, nexec, 100));
+    }
+    errno = saved_errno;
+}
+
+static exit_prof_t *_exit_prof = NULL;
+static char *_exit_prof_path = NULL;
+static void *_exit_prof_base = NULL;
+static __thread exit_prof_ring_t *_exit_prof_ring = NULL;
+
+static const char* const _exit_prof_reasons[EXIT_PROF_MAX_REASON] = {
+    "TERMINATE",
+    "SYSCALL",
+    "ERROR",
+    "SLEEP",
+    "CPUID",
+    "DORESUME",
+    "REPORT",
+    "PARK",
+    [EXIT_PROF_REASON_SIGNAL] = "SIGNAL"
+};
+
+static void exit_prof_dump(void) {
+    FILE *f;
+    if (!(f = fopen(_exit_prof_path, "w"))) {
+        sgxlkl_warn("Failed to open exit profile file %s: %s\n", _exit_prof_path, strerror(errno));
+        return;
+    }
+
+    fprintf(f, "# SGX-LKL exit profile\n");
+    fprintf(f, "# base %p period %lu\n", _exit_prof_base, _exit_prof->period);
+    fprintf(f, "# total <ring> <reason> <exits> <cycles>\n");
+    fprintf(f, "# exit <ring> <reason> <arg> <cycles> <return address>\n");
+
+    size_t num_rings = _exit_prof->next_ring < _exit_prof->num_rings ? _exit_prof->next_ring : _exit_prof->num_rings;
+    for (size_t r = 0; r < num_rings; r++) {
+        exit_prof_ring_t *ring = &_exit_prof->rings[r];
+        for (int i = 0; i < EXIT_PROF_MAX_REASON; i++) {
+            if (ring->count[i])
+                fprintf(f, "total %zu %s %lu %lu\n", r, _exit_prof_reasons[i] ? _exit_prof_reasons[i] : "UNKNOWN",
+                        ring->count[i], ring->cycles[i]);
+        }
+
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t start = head > EXIT_PROF_RING_SIZE ? head - EXIT_PROF_RING_SIZE : 0;
+        for (uint64_t i = start; i < head; i++) {
+            exit_prof_record_t *rec = &ring->recs[i & (EXIT_PROF_RING_SIZE - 1)];
+            fprintf(f, "exit %zu %s %lu %lu 0x%lx\n", r,
+                    _exit_prof_reasons[rec->reason] ? _exit_prof_reasons[rec->reason] : "UNKNOWN",
+                    rec->arg, rec->cycles, rec->ret_addr);
+        }
+    }
+
+    fclose(f);
+}
+
+exit_prof_t *exit_prof_init(const char *path, uint64_t period, size_t num_rings, void *base) {
+    exit_prof_t *prof;
+    exit_prof_ring_t *rings;
+
+    if (!(prof = calloc(1, sizeof(*prof))))
+        sgxlkl_fail("Failed to allocate memory for exit profiler: %s\n", strerror(errno));
+
+    rings = mmap(0, num_rings * sizeof(*rings), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (rings == MAP_FAILED)
+        sgxlkl_fail("Failed to allocate memory for exit profiler ring buffers: %s\n", strerror(errno));
+
+    prof->period = period ? period : 1;
+    prof->num_rings = num_rings;
+    prof->next_ring = 0;
+    prof->rings = rings;
+
+    _exit_prof = prof;
+    _exit_prof_path = strdup(path);
+    _exit_prof_base = base;
+    atexit(exit_prof_dump);
+
+    return prof;
+}
+
+void exit_prof_host_record(uint64_t reason, uint64_t arg, uint64_t exit_tsc, uint64_t ret_addr) {
+    if (!_exit_prof)
+        return;
+
+    if (!_exit_prof_ring && !(_exit_prof_ring = exit_prof_claim_ring(_exit_prof)))
+        return;
+
+    exit_prof_add(_exit_prof_ring, _exit_prof->period, reason, arg, host_rdtsc() - exit_tsc, ret_addr);
+}
+
+static boot_prof_t *_boot_prof = NULL;
+static char *_boot_prof_path = NULL;
+
+/* Writes a JSON string, escaping characters that would make the output
+ * invalid. Phase names recorded by the enclave are untrusted. */
+static void boot_prof_print_str(FILE *f, const char *s, size_t len) {
+    fputc('"', f);
+    for (size_t i = 0; i < len && s[i]; i++) {
+        if (s[i] == '"' || s[i] == '\\')
+            fprintf(f, "\\%c", s[i]);
+        else if ((unsigned char) s[i] < 0x20)
+            fprintf(f, "\\u%04x", s[i]);
+        else
+            fputc(s[i], f);
+    }
+    fputc('"', f);
+}
+
+static void boot_prof_dump(void) {
+    FILE *f;
+    if (!(f = fopen(_boot_prof_path, "w"))) {
+        sgxlkl_warn("Failed to open boot profile file %s: %s\n", _boot_prof_path, strerror(errno));
+        return;
+    }
+
+    int num_phases = _boot_prof->num_phases;
+    if (num_phases > BOOT_PROF_MAX_PHASES)
+        num_phases = BOOT_PROF_MAX_PHASES;
+
+    // All times are relative to the start of sgx-lkl-run. Phases that did not
+    // finish have an end time of null.
+    fprintf(f, "{\n");
+#ifdef SGXLKL_HW
+    fprintf(f, "  \"mode\": \"hw\",\n");
+#else
+    fprintf(f, "  \"mode\": \"sim\",\n");
+#endif
+    fprintf(f, "  \"unit\": \"ns\",\n");
+    fprintf(f, "  \"phases\": [");
+    for (int i = 0; i < num_phases; i++) {
+        boot_prof_phase_t *phase = &_boot_prof->phases[i];
+        uint64_t end_ns = __atomic_load_n(&phase->end_ns, __ATOMIC_ACQUIRE);
+        int64_t start = phase->start_ns - _boot_prof->start_ns;
+
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        boot_prof_print_str(f, phase->name, sizeof(phase->name));
+        fprintf(f, ", \"where\": \"%s\", \"start\": %ld, ", phase->enclave ? "enclave" : "host", start);
+        if (end_ns)
+            fprintf(f, "\"end\": %ld, \"duration\": %ld}", (int64_t) (end_ns - _boot_prof->start_ns),
+                    (int64_t) (end_ns - phase->start_ns));
+        else
+            fprintf(f, "\"end\": null, \"duration\": null}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+
+    fclose(f);
+}
+
+boot_prof_t *boot_prof_init(const char *path, uint64_t start_ns) {
+    boot_prof_t *prof;
+
+    if (!(prof = calloc(1, sizeof(*prof))))
+        sgxlkl_fail("Failed to allocate memory for boot profiler: %s\n", strerror(errno));
+
+    prof->start_ns = start_ns;
+
+    _boot_prof = prof;
+    _boot_prof_path = strdup(path);
+    atexit(boot_prof_dump);
+
+    return prof;
+}
+
+int boot_prof_host_begin(const char *name) {
+    return boot_prof_begin(_boot_prof, name, 0);
+}
+
+int boot_prof_host_begin_at(const char *name, uint64_t start_ns) {
+    return boot_prof_begin_at(_boot_prof, name, 0, start_ns);
+}
+
+void boot_prof_host_end(int idx) {
+    boot_prof_end(_boot_prof, idx);
+}
+
+void boot_prof_host_phase_cb(const char *phase, int begin) {
+    // Steps of enclave creation are sequential
+    static int idx = -1;
+    if (begin)
+        idx = boot_prof_host_begin(phase);
+    else
+        boot_prof_host_end(idx);
+}
+
+int hd_trace_fd = -1;
+static char *_hd_trace_path = NULL;
+static enclave_disk_extent_t *_hd_trace = NULL;
+static size_t _hd_trace_len = 0;
+static size_t _hd_trace_cap = 0;
+static pthread_mutex_t _hd_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void hd_trace_dump(void) {
+    FILE *f;
+    if (!(f = fopen(_hd_trace_path, "w"))) {
+        sgxlkl_warn("Failed to open disk trace file %s: %s\n", _hd_trace_path, strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&_hd_trace_lock);
+    fprintf(f, "# SGX-LKL disk trace\n");
+    fprintf(f, "# <offset> <length>\n");
+    for (size_t i = 0; i < _hd_trace_len; i++)
+        fprintf(f, "%lu %lu\n", _hd_trace[i].offset, _hd_trace[i].len);
+    pthread_mutex_unlock(&_hd_trace_lock);
+
+    fclose(f);
+}
+
+void hd_trace_init(const char *path, int fd) {
+    _hd_trace_path = strdup(path);
+    hd_trace_fd = fd;
+    atexit(hd_trace_dump);
+}
+
+void hd_trace_add(uint64_t offset, uint64_t len) {
+    pthread_mutex_lock(&_hd_trace_lock);
+    if (_hd_trace_len == _hd_trace_cap) {
+        size_t cap = _hd_trace_cap ? 2 * _hd_trace_cap : 4096;
+        enclave_disk_extent_t *trace = realloc(_hd_trace, cap * sizeof(*trace));
+        if (!trace) {
+            pthread_mutex_unlock(&_hd_trace_lock);
+            return;
+        }
+        _hd_trace = trace;
+        _hd_trace_cap = cap;
+    }
+    _hd_trace[_hd_trace_len].offset = offset;
+    _hd_trace[_hd_trace_len].len = len;
+    _hd_trace_len++;
+    pthread_mutex_unlock(&_hd_trace_lock);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#ifndef _SGXLKL_HOST_STATS_INCLUDE
+#define _SGXLKL_HOST_STATS_INCLUDE
+
+#include <stdint.h>
+
+#include "boot_prof.h"
+#include "exit_prof.h"
+
+/* Host calls with larger syscall numbers are not recorded */
+#define HOSTCALL_HIST_MAX_SYSCALL 512
+/* Bucket i holds latencies in [2^i, 2^(i+1)) TSC cycles, the last bucket also
+ * holds everything above. */
+#define HOSTCALL_HIST_BUCKETS 40
+
+static inline uint64_t host_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * Records the latency of a host call with the given syscall number. enqueue_tsc
+ * is the TSC value at which the enclave submitted the call (0 if unknown),
+ * dequeue_tsc/done_tsc are the TSC values at which the host picked up and
+ * completed the call. Histograms are kept per host thread so that recording
+ * does not require any synchronisation.
+ */
+void hostcall_hist_record(uint64_t syscallno, uint64_t enqueue_tsc, uint64_t dequeue_tsc, uint64_t done_tsc);
+
+/* Prints the aggregated histograms of all host threads to stderr. Only uses
+ * write(2), so it can be called from a signal handler. */
+void hostcall_hist_print(void);
+
+/*
+ * Allocates per-thread exit profiling ring buffers for num_rings enclave
+ * threads. Records are written to path on exit. base is the load address of
+ * libsgxlkl and is used by the offline tooling to resolve return addresses.
+ */
+exit_prof_t *exit_prof_init(const char *path, uint64_t period, size_t num_rings, void *base);
+
+/*
+ * Records an enclave exit of the calling host thread that started at
+ * exit_tsc. Only used in hardware mode, in simulation mode the enclave
+ * records exits itself.
+ */
+void exit_prof_host_record(uint64_t reason, uint64_t arg, uint64_t exit_tsc, uint64_t ret_addr);
+
+/*
+ * Allocates the boot phase table. start_ns is the time at which sgx-lkl-run
+ * started. The report is written to path in JSON format on exit.
+ */
+boot_prof_t *boot_prof_init(const char *path, uint64_t start_ns);
+
+/* Records a boot phase of sgx-lkl-run, does nothing if profiling is disabled */
+int boot_prof_host_begin(const char *name);
+int boot_prof_host_begin_at(const char *name, uint64_t start_ns);
+void boot_prof_host_end(int idx);
+
+/* Records the steps of create_enclave_mem, see libsgx.h */
+void boot_prof_host_phase_cb(const char *phase, int begin);
+
+/*
+ * Records the offset and length of every host read from the disk image with
+ * file descriptor fd, in order, and writes them to path on exit. The trace can
+ * be turned into a prefetch file with 'sgx-lkl-disk prefetch'.
+ */
+void hd_trace_init(const char *path, int fd);
+
+extern int hd_trace_fd;
+void hd_trace_add(uint64_t offset, uint64_t len);
+
+static inline void hd_trace_record(int fd, uint64_t offset, uint64_t len) {
+    if (fd == hd_trace_fd)
+        hd_trace_add(offset, len);
+}
+
+#endif /* _SGXLKL_HOST_STATS_INCLUDE */
@@ -28,6 +28,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <linux/futex.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
@@ -38,8 +39,10 @@
 #include "enclave_mem.h"
 #include "load_elf.h"
 #include "mpmc_queue.h"
+#include "spsc_queue.h"
 #include "sgx_enclave_config.h"
 #include "sgxlkl_config.h"
+#include "sgxlkl_host_stats.h"
 #include "sgxlkl_util.h"
 
 #include "lkl/linux/virtio_net.h"
@@ -77,7 +80,8 @@ static const char* const _enclave_exit_reasons[] = {
     "SLEEP",
     "CPUID",
     "DORESUME",
-    "REPORT"
+    "REPORT",
+    "PARK"
 };
 
 static unsigned long _host_syscall_stats[MAX_SYSCALL_NUMBER];
@@ -86,8 +90,14 @@ static int _sigint_handling = 0;
 extern unsigned long hw_exceptions;
 #endif /* DEBUG */
 
-// One first empty block for bootloaders, and offset in second block
-#define EXT4_MAGIC_OFFSET (1024 + 0x38)
+// LUKS1 and LUKS2 headers start with the same magic
+#define LUKS_MAGIC "LUKS\xba\xbe"
+#define LUKS_MAGIC_LEN 6
+
+// dm-verity superblock written by veritysetup at the hash offset
+#define VERITY_SB_SIGNATURE "verity\0\0"
+#define VERITY_SB_SIGNATURE_LEN 8
+#define VERITY_SB_BLOCK_SIZE_OFFSET 64
 
 #define MAX_KEY_FILE_SIZE_KB 8192
 #define MAX_HASH_DIGITS 512
@@ -106,6 +116,7 @@ static pthread_spinlock_t _stdout_print_lock = {0};
 static pthread_spinlock_t _stderr_print_lock = {0};
 
 static syscall_t *_syscallpage;
+static ethread_park_t *_ethread_park = NULL;
 static size_t backoff_maxpause;
 static size_t backoff_factor;
 
@@ -120,6 +131,7 @@ int   get_tcs_num();
 void  enter_enclave(int tcs_id, uint64_t call_id, void* arg, uint64_t* ret);
 uint64_t create_enclave_mem(char* p, int base_zero, void *base_zero_max);
 void     enclave_update_heap(void *p, size_t new_heap, char* key_path);
+extern void (*create_enclave_phase_cb)(const char *phase, int begin);
 
 typedef struct {
     int   tcs_id;
@@ -197,16 +209,21 @@ static void help(char* prog) {
     printf("SGXLKL_ESLEEP: Sleep timeout in the scheduler (in ns).\n");
     printf("SGXLKL_ESPINS: Number of spins inside scheduler before sleeping begins.\n");
     printf("SGXLKL_ETHREADS: Number of enclave threads.\n");
+    printf("SGXLKL_ETHREADS_MIN: Min. number of active enclave threads. If smaller than SGXLKL_ETHREADS, idle enclave threads park on a host futex instead of sleeping periodically and are woken when work is queued (see SGXLKL_ETHREADS_WAKE_THRESHOLD). Set to 0 to keep all enclave threads active (Default: 0).\n");
+    printf("SGXLKL_ETHREADS_WAKE_THRESHOLD: Number of queued user-level threads per active enclave thread above which a parked enclave thread is woken (Default: %d).\n", DEFAULT_SGXLKL_ETHREADS_WAKE_THRESHOLD);
     printf("SGXLKL_STHREADS: Number of system call threads outside the enclave.\n");
+    printf("SGXLKL_BLOCKING_STHREADS: Max. number of additional host threads for host calls that may block for a long time (e.g. poll without timeout, nanosleep). These threads are started on demand so that blocking host calls do not stall the system call threads. Set to 0 to execute all host calls on the system call threads (Default: %d).\n", DEFAULT_SGXLKL_BLOCKING_STHREADS);
     printf("SGXLKL_MAX_USER_THREADS: Max. number of user-level thread inside the enclave.\n");
     printf("SGXLKL_REAL_TIME_PRIO: Set to 1 to use realtime priority for enclave threads.\n");
     printf("SGXLKL_SSPINS: Number of spins inside host syscall threads before sleeping begins.\n");
     printf("SGXLKL_SSLEEP: Sleep timeout in the syscall threads (in ns).\n");
     printf("SGXLKL_GETTIME_VDSO: Set to 1 to use the host kernel vdso mechanism to handle clock_gettime calls (Default: 1).\n");
+    printf("SGXLKL_FAST_SYSCALLS: Set to 0 to pass all system calls on to the kernel. By default, getpid, gettid, get[e]uid, get[e]gid and uname are answered from cached results, clock_gettime from the vdso (see SGXLKL_GETTIME_VDSO), getrandom with RDRAND, and sched_yield yields the user-level thread, without entering the kernel (Default: 1).\n");
     printf("SGXLKL_ETHREADS_AFFINITY: Specifies the CPU core affinity for enclave threads as a comma-separated list of cores to use, e.g. \"0-2,4\".\n");
     printf("SGXLKL_STHREADS_AFFINITY: Specifies the CPU core affinity for system call threads as a comma-separated list of cores to use, e.g. \"0-2,4\".\n");
     printf("SGXLKL_WAIT_ON_IO_HOST_CALLS: Set to 1 to make SGX-LKL busy wait on read/write network or disk I/O host calls rather than yield.\n");
     printf("SGXLKL_WAIT_ON_HOST_CALLS: Set to 1 to make SGX-LKL busy wait on all host calls rather than yield. Note: This includes blocking calls such as poll (used for network I/O) and the corresponding enclave thread will not schedule any other application thread until the call returns. Should not be used with a single enclave thread.\n");
+    printf("SGXLKL_HOST_CALL_RINGS: Set to 1 to give each enclave thread dedicated host call queues served by its own host thread, pinned to a hyperthread sibling of the enclave thread's core (see SGXLKL_ETHREADS_AFFINITY). Host calls that do not fit into these queues are handled by the regular system call threads (Default: 0).\n");
     printf("SGXLKL_EXIT_ON_HOST_CALLS: Set to 1 to make SGX-LKL exit the enclave to execute host calls and reenter after completion. Note: This only applies when SGX-LKL would otherwise busy wait for the call to return (see SGXLKL_WAIT_ON_HOST_CALLS and SGXLKL_WAIT_ON_IO_HOST_CALLS).\n");
     printf("\n## Network ##\n");
     printf("SGXLKL_TAP: Tap for LKL to use as a network interface.\n");
@@ -223,16 +240,28 @@ static void help(char* prog) {
     printf("\n## Disk ##\n");
     printf("SGXLKL_HD_VERITY: Root hash or file path to root hash for the root file system image (Debug only).\n");
     printf("SGXLKL_HD_VERITY_OFFSET: Offset or file path to offset of the dm-verity merkle tree on the root file system image (Debug only). If omitted and <path/to/diskimage>.hashoffset exists, this offset will be used if possible.\n");
+    printf("SGXLKL_HD_VERITY_BLOCK_SIZE: dm-verity data and hash block size of the root file system image, as passed to sgx-lkl-disk --verity-block-size (Default: %d).\n", DEFAULT_SGXLKL_HD_VERITY_BLOCK_SIZE);
+    printf("SGXLKL_HD_VERITY_CACHE_SIZE: Size (in bytes) of the in-enclave cache of verified dm-verity hash blocks. Hash blocks in the cache are not re-hashed on access. Default: 0 (kernel default of 2%% of kernel memory).\n");
+    printf("SGXLKL_HD_CRYPTO_THREADS: Number of threads used to encrypt and decrypt disk blocks in parallel with AES-NI. A value close to SGXLKL_ETHREADS is a good starting point. Default: 0 (disk blocks are encrypted and decrypted synchronously by the kernel).\n");
     printf("SGXLKL_HD_KEY: Encryption key as passphrase or file path to a key file for the root file system image (Debug only).\n");
+    printf("SGXLKL_HD_KEY_IS_VOLUME_KEY: Set to 1 if SGXLKL_HD_KEY is the LUKS volume key, either hex-encoded or as a file path (e.g. as created by sgx-lkl-disk --volume-key). This avoids running the slow LUKS key derivation function at startup.\n");
     printf("SGXLKL_HD_RO: Set to 1 to mount the root file system as read-only.\n");
     printf("SGXLKL_HDS: Secondary file system images. Comma-separated list of the format: disk1path:disk1mntpoint:disk1mode,disk2path:disk2mntpoint:disk2mode,[...].\n");
+    printf("SGXLKL_HD_TRACE: Record the offsets and lengths of all reads from the root disk image in the order in which they occur and write them to the specified file on exit. Use 'sgx-lkl-disk prefetch' to turn the trace into a prefetch file.\n");
+    printf("SGXLKL_HD_PREFETCH: Set to 0 to not use the prefetch file <root disk image>.prefetch. If the file exists and the root disk is read-only, the listed extents of the image are read ahead in large reads at startup (Default: 1).\n");
+    printf("SGXLKL_HD_PREFETCH_WINDOW: Maximum amount of prefetched disk data (in bytes) held in the enclave at a time (Default: %d MB).\n", DEFAULT_SGXLKL_HD_PREFETCH_WINDOW / 1024 / 1024);
     printf("SGXLKL_HD_MMAP: Set to 1 to use file-backed mmap to read from and write to disks instead of using host read/write system calls.\n");
     printf("\n## Memory ##\n");
     printf("SGXLKL_HEAP: Total heap size (in bytes) available in the enclave. This includes memory used by the kernel.\n");
+    printf("SGXLKL_KERNEL_MEM: Size of the heap (in bytes) reserved for the kernel, e.g. for the page cache, socket buffers and dentry/inode caches. This memory is not available to the application. At most half of the heap can be reserved. Ignored if SGXLKL_CMDLINE contains mem=. Default: 0 (%lu MB).\n", KERNEL_MEM_DEFAULT / 1024 / 1024);
     printf("SGXLKL_STACK_SIZE: Stack size of in-enclave user-level threads.\n");
+    printf("SGXLKL_HUGEPAGES: Set to 1 to back disk image mappings, host call queues and, in simulation mode, the enclave heap with transparent huge pages. Large enclave mappings are then aligned to %lu MiB boundaries. Set to 2 to use hugetlbfs pages for the host call queues instead, which must be reserved beforehand. The enclave heap always uses transparent huge pages (Default: 0).\n", HUGE_PAGE_SIZE / 1024 / 1024);
     printf("SGXLKL_MMAP_FILES: Set to \"Private\" to allow mmaping files with private copy-on-write mapping ('MAP_PRIVATE'). Set to \"Shared\" to allow mmaping files with 'MAP_SHARED'. These files will be mapped as if 'MAP_PRIVATE' has been used instead. Default: No File mapping supported.\n");
     printf("SGXLKL_SHMEM_FILE: Name of the file to be used for shared memory between the enclave and the outside.\n");
     printf("SGXLKL_SHMEM_SIZE: Size of the file to be used for shared memory between the enclave and the outside.\n");
+    printf("SGXLKL_PAGER_SWAP_SIZE: Experimental, simulation mode only. Size of untrusted host memory (in bytes) to which the enclave may evict cold anonymous memory. Evicted memory is encrypted and integrity-protected with AES-GCM and paged back in on access. Applications can evict and prefetch memory with madvise(MADV_PAGEOUT/MADV_COLD) and madvise(MADV_WILLNEED). Requires a libc that routes mprotect and madvise to the enclave's memory management. Default: 0 (paging disabled).\n");
+    printf("SGXLKL_PAGER_CHUNK_SIZE: Granularity (in bytes) of enclave paging. Must be a power of two and a multiple of the page size. Only anonymous mappings that cover whole chunks are paged (Default: %d).\n", DEFAULT_SGXLKL_PAGER_CHUNK_SIZE);
+    printf("SGXLKL_PAGER_RESIDENT_SIZE: Maximum amount of pageable memory (in bytes) that stays resident in the enclave before cold chunks are evicted automatically. Default: 0 (only evict on request via madvise).\n");
     printf("\n## Attestation ##\n");
     printf("SGXLKL_IAS_SPID: Specifies the Service Provider ID (SPID) required for communication with the Intel Attestation Service (IAS).\n");
     printf("SGXLKL_IAS_SUBSCRIPT_KEY: Specifies the Intel Attestation Service (IAS) subscription key.\n");
@@ -252,7 +281,12 @@ static void help(char* prog) {
     printf("SGXLKL_TRACE_HOST_SYSCALL: Print detailed information about host system calls.\n");
     printf("SGXLKL_TRACE_REDIRECT_SYSCALL: Print detailed information about libc syscall() invocations that have been redirected.\n");
     printf("SGXLKL_PRINT_HOST_SYSCALL_STATS: Print statistics on the number of host system calls and enclave exits.\n");
+    printf("SGXLKL_EXIT_PROFILE: Record enclave exits (reason, host call number, time spent outside the enclave and in-enclave call site) and write them to the specified file on exit. Use tools/sgx-lkl-exit-fold.py to convert the file into folded stacks for flame graphs.\n");
+    printf("SGXLKL_EXIT_PROFILE_PERIOD: Only keep a record of every n-th enclave exit when SGXLKL_EXIT_PROFILE is set. Exit counts and cycle totals always include all exits (Default: 1).\n");
+    printf("SGXLKL_THREAD_STATS: Set to 1 to record per-thread run time and host call statistics inside the enclave. Statistics can be retrieved via 'sgx-lkl-ctl threadstats'. Requires SGXLKL_GETTIME_VDSO=1.\n");
+    printf("SGXLKL_BOOT_PROFILE: Record the duration of the phases of sgx-lkl-run and of the enclave boot (e.g. enclave creation, LKL start, disk setup, network setup) and write them as JSON to the specified file on exit. Enclave phases require SGXLKL_GETTIME_VDSO=1.\n");
     printf("SGXLKL_PRINT_APP_RUNTIME: Measure and print total runtime of the application itself excluding the enclave and SGX-LKL startup and shutdown time.\n");
+    printf("\nSending SIGUSR1 to %s prints per-syscall host call queueing and execution latency histograms to stderr.\n", prog);
 }
 
 static void help_tls() {
@@ -348,6 +382,8 @@ static void handle_syscall(size_t i) {
             }
         } else {
             do_syscall(&scall[i]);
+            if (scall[i].syscallno == SYS_pread64 && (long) scall[i].ret_val > 0)
+                hd_trace_record((int) scall[i].arg1, scall[i].arg4, scall[i].ret_val);
         }
 
         /* Release ticket lock if previously acquired */
@@ -365,35 +401,218 @@ static void handle_syscall(size_t i) {
 #endif /* DEBUG */
 }
 
-void *host_syscall_thread(void *v) {
-    enclave_config_t *conf = v;
+/* Executes the host call in slot i and hands the slot back to the enclave,
+ * via retring if given and not full, via the shared return queue otherwise. */
+static inline void serve_syscall(enclave_config_t *conf, size_t i, struct spscq *retring) {
     volatile syscall_t *scall = conf->syscallpage;
-    pthread_spinlock_t* curr_print_lock = NULL;
-    size_t i;
     unsigned s;
     union {void *ptr; size_t i;} u;
-    u.ptr = MAP_FAILED;
+    u.i = i;
+
+    uint64_t dequeue_tsc = host_rdtsc();
+    uint64_t syscallno = scall[i].syscallno;
+    handle_syscall(i);
+    hostcall_hist_record(syscallno, scall[i].enqueue_tsc, dequeue_tsc, host_rdtsc());
+
+    if (scall[i].status == 1) {
+        /* This was submitted by the scheduler or a pinned thread, no need to push anything to queue */
+        __atomic_store_n(&scall[i].status, 2, __ATOMIC_RELEASE);
+    } else if (!retring || !spsc_enqueue(retring, u.ptr)) {
+        for (s = 0; !mpmc_enqueue(conf->returnq, u.ptr);) {s = backoff(s);}
+    }
+}
+
+/*
+ * Elastic pool of host threads for host calls that may block for a long time,
+ * e.g. a poll on the network device without timeout. Handing these off keeps
+ * the spinning syscall threads available for latency-critical host calls.
+ * Workers are started on demand up to SGXLKL_BLOCKING_STHREADS and exit after
+ * being idle for BLOCKING_POOL_IDLE_TIMEOUT seconds, except for the last one.
+ */
+#define BLOCKING_POOL_IDLE_TIMEOUT 10
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    enclave_config_t *conf;
+    size_t *pending;    /* FIFO of slot indices, one entry per slot at most */
+    size_t cap;
+    size_t head;
+    size_t count;
+    size_t nthreads;
+    size_t nidle;
+    size_t max_threads; /* 0 if the pool is disabled */
+} blocking_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static void blocking_pool_init(enclave_config_t *conf, size_t max_threads) {
+    if (!max_threads)
+        return;
+    if (!(blocking_pool.pending = calloc(conf->maxsyscalls, sizeof(*blocking_pool.pending))))
+        sgxlkl_fail("Could not allocate memory for blocking host call pool: %s\n", strerror(errno));
+    blocking_pool.conf = conf;
+    blocking_pool.cap = conf->maxsyscalls;
+    blocking_pool.max_threads = max_threads;
+}
+
+/* Returns 1 if the host call in sc may block for a long time. Calls are
+ * classified by their system call number and arguments, or by the enclave if
+ * only the caller can tell (see hostcall_may_block). */
+static int syscall_may_block(volatile syscall_t *sc) {
+    if (sc->flags & SYSCALL_FLAG_MAY_BLOCK)
+        return 1;
+    switch (sc->syscallno) {
+    case SYS_nanosleep:
+    case SYS_rt_sigsuspend:
+    case SYS_rt_sigtimedwait:
+    case SYS_fdatasync:
+        return 1;
+    case SYS_msync:
+        return (sc->arg3 & MS_SYNC) != 0;
+    default:
+        return 0;
+    }
+}
+
+static void *blocking_pool_thread(void *v) {
+    struct timespec deadline;
+    size_t i;
+
+    pthread_mutex_lock(&blocking_pool.lock);
     while (1) {
-        for (s = 0; !mpmc_dequeue(conf->syscallq, &u.ptr);) {s = backoff(s);}
-        i = u.i;
+        while (!blocking_pool.count) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += BLOCKING_POOL_IDLE_TIMEOUT;
+            blocking_pool.nidle++;
+            int r = pthread_cond_timedwait(&blocking_pool.cond, &blocking_pool.lock, &deadline);
+            blocking_pool.nidle--;
+            if (r == ETIMEDOUT && !blocking_pool.count && blocking_pool.nthreads > 1) {
+                blocking_pool.nthreads--;
+                pthread_mutex_unlock(&blocking_pool.lock);
+                return NULL;
+            }
+        }
+        i = blocking_pool.pending[blocking_pool.head];
+        blocking_pool.head = (blocking_pool.head + 1) % blocking_pool.cap;
+        blocking_pool.count--;
+        pthread_mutex_unlock(&blocking_pool.lock);
+
+        /* Completions always go through the shared return queue, the
+         * dedicated return rings only have a single producer. */
+        serve_syscall(blocking_pool.conf, i, NULL);
+
+        pthread_mutex_lock(&blocking_pool.lock);
+    }
+
+    return NULL;
+}
 
-        handle_syscall(i);
+/* Hands the host call in slot i to the blocking pool. Starts another worker
+ * if there are not enough idle ones. Returns 0 if the caller has to execute
+ * the host call itself. */
+static int blocking_pool_submit(size_t i) {
+    pthread_attr_t attr;
+    pthread_t thread;
 
-        if (scall[i].status == 1) {
-            /* This was submitted by the scheduler or a pinned thread, no need to push anything to queue */
-            __atomic_store_n(&scall[i].status, 2, __ATOMIC_RELEASE);
+    if (!blocking_pool.max_threads)
+        return 0;
+
+    pthread_mutex_lock(&blocking_pool.lock);
+    if (blocking_pool.count >= blocking_pool.nidle && blocking_pool.nthreads < blocking_pool.max_threads) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, blocking_pool_thread, NULL)) {
+            if (!blocking_pool.nthreads) {
+                pthread_mutex_unlock(&blocking_pool.lock);
+                return 0;
+            }
         } else {
-            for (s = 0; !mpmc_enqueue(conf->returnq, u.ptr);) {s = backoff(s);}
+            blocking_pool.nthreads++;
+            pthread_setname_np(thread, "HOST_BLOCKING");
         }
     }
+    blocking_pool.pending[(blocking_pool.head + blocking_pool.count) % blocking_pool.cap] = i;
+    blocking_pool.count++;
+    pthread_cond_signal(&blocking_pool.cond);
+    pthread_mutex_unlock(&blocking_pool.lock);
+    return 1;
+}
+
+/* Executes the host call in slot i unless it may block, in which case it is
+ * handed to the blocking pool. */
+static inline void dispatch_syscall(enclave_config_t *conf, size_t i, struct spscq *retring) {
+    if (syscall_may_block(&((syscall_t *)conf->syscallpage)[i]) && blocking_pool_submit(i))
+        return;
+    serve_syscall(conf, i, retring);
+}
+
+/* Wakes a parked ethread if the enclave has requested it */
+static inline void ethread_unpark_pending(void) {
+    if (_ethread_park && __atomic_load_n(&_ethread_park->wake, __ATOMIC_ACQUIRE) &&
+        __atomic_exchange_n(&_ethread_park->wake, 0, __ATOMIC_ACQ_REL))
+        syscall(SYS_futex, &_ethread_park->futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+void *host_syscall_thread(void *v) {
+    enclave_config_t *conf = v;
+    unsigned s;
+    union {void *ptr; size_t i;} u;
+    u.ptr = MAP_FAILED;
+    while (1) {
+        for (s = 0; !mpmc_dequeue(conf->syscallq, &u.ptr);) {
+            ethread_unpark_pending();
+            s = backoff(s);
+        }
+        dispatch_syscall(conf, u.i, NULL);
+        ethread_unpark_pending();
+    }
+
+    return NULL;
+}
+
+typedef struct {
+    enclave_config_t *conf;
+    struct spscq *syscall_ring;
+    struct spscq *return_ring;
+} host_call_ring_args_t;
+
+/* Serves the dedicated host call rings of a single ethread */
+void *host_syscall_ring_thread(void *v) {
+    host_call_ring_args_t *args = v;
+    unsigned s;
+    union {void *ptr; size_t i;} u;
+    u.ptr = MAP_FAILED;
+    while (1) {
+        for (s = 0; !spsc_dequeue(args->syscall_ring, &u.ptr);) {s = backoff(s);}
+        dispatch_syscall(args->conf, u.i, args->return_ring);
+    }
 
     return NULL;
 }
 
+/*
+ * Returns the data block size recorded in the dm-verity superblock at offset
+ * of the disk image, or 0 if the image has no superblock.
+ */
+static size_t verity_sb_block_size(char *disk_path, size_t offset) {
+    unsigned char sb[VERITY_SB_BLOCK_SIZE_OFFSET + 4];
+    int fd = open(disk_path, O_RDONLY);
+    if (fd == -1)
+        return 0;
+    ssize_t read_bytes = pread(fd, sb, sizeof(sb), offset);
+    close(fd);
+    if (read_bytes != sizeof(sb) || memcmp(sb, VERITY_SB_SIGNATURE, VERITY_SB_SIGNATURE_LEN))
+        return 0;
+
+    uint32_t block_size;
+    memcpy(&block_size, sb + VERITY_SB_BLOCK_SIZE_OFFSET, sizeof(block_size));
+    return block_size;
+}
+
 static void prepare_verity(struct enclave_disk_config *disk, char *disk_path, char *verity_file_or_roothash, char *verity_file_or_hashoffset) {
     if (!verity_file_or_roothash) {
         disk->roothash = NULL;
         disk->roothash_offset = 0;
+        disk->verity_block_size = 0;
         return;
     }
 
@@ -457,21 +676,127 @@ static void prepare_verity(struct enclave_disk_config *disk, char *disk_path, ch
     if (errno == EINVAL || errno == ERANGE)
         sgxlkl_fail("Failed to parse hash offset!\n");
 
+    size_t block_size = sgxlkl_config_uint64(SGXLKL_HD_VERITY_BLOCK_SIZE);
+    if (block_size < 512 || (block_size & (block_size - 1)))
+        sgxlkl_fail("Invalid dm-verity block size %lu, must be a power of two between 512 and 4096.\n", block_size);
+
+    // The superblock written by veritysetup takes precedence, so that images
+    // created with other block sizes work without SGXLKL_HD_VERITY_BLOCK_SIZE.
+    size_t sb_block_size = verity_sb_block_size(disk_path, disk->roothash_offset);
+    if (sb_block_size) {
+        if (sb_block_size != block_size)
+            SGXLKL_VERBOSE("Using dm-verity block size %lu of %s instead of %lu.\n", sb_block_size, disk_path, block_size);
+        block_size = sb_block_size;
+    } else if (disk->roothash_offset % block_size) {
+        sgxlkl_warn("Hash offset %lu is not a multiple of the dm-verity block size %lu. Set SGXLKL_HD_VERITY_BLOCK_SIZE to the block size the disk image was created with.\n", disk->roothash_offset, block_size);
+    }
+    disk->verity_block_size = block_size;
+
     if (hashoffset_path != verity_file_or_hashoffset)
         free(hashoffset_path);
 }
 
+/* Huge page backing of host memory (SGXLKL_HUGEPAGES): 0 = none,
+ * 1 = transparent huge pages, 2 = hugetlbfs pages for anonymous memory other
+ * than the enclave heap */
+static int huge_pages;
+
+/*
+ * Like mmap, but backs the mapping with huge pages if SGXLKL_HUGEPAGES is set.
+ * Unless MAP_FIXED is given, the mapping is aligned to HUGE_PAGE_SIZE. Anonymous
+ * mappings use hugetlbfs pages if hugetlb is set, which rules out protection
+ * changes at page granularity. Falls back to transparent huge pages if no
+ * hugetlbfs pages are available.
+ */
+static void *mmap_huge(void *addr, size_t len, int prot, int flags, int fd, int hugetlb) {
+    if (!huge_pages)
+        return mmap(addr, len, prot, flags, fd, 0);
+
+    if (huge_pages == 2 && hugetlb && (flags & MAP_ANONYMOUS)) {
+        size_t huge_len = (len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        void *mem = mmap(addr, huge_len, prot, flags | MAP_HUGETLB, fd, 0);
+        if (mem != MAP_FAILED)
+            return mem;
+        sgxlkl_warn("Could not allocate %zu bytes of hugetlbfs pages, using transparent huge pages instead: %s\n", huge_len, strerror(errno));
+        huge_pages = 1;
+    }
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t page_len = (len + page_size - 1) & ~(page_size - 1);
+    char *resv = NULL;
+    if (!(flags & MAP_FIXED)) {
+        // Reserve address space to place the mapping at an aligned address.
+        size_t resv_len = page_len + HUGE_PAGE_SIZE;
+        resv = mmap(addr, resv_len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (resv == MAP_FAILED)
+            return MAP_FAILED;
+        char *aligned = (char *) (((uintptr_t) resv + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if (aligned > resv)
+            munmap(resv, aligned - resv);
+        munmap(aligned + page_len, resv + resv_len - (aligned + page_len));
+        addr = resv = aligned;
+        flags |= MAP_FIXED;
+    }
+
+    void *mem = mmap(addr, len, prot, flags, fd, 0);
+    if (mem == MAP_FAILED) {
+        if (resv)
+            munmap(resv, page_len);
+        return MAP_FAILED;
+    }
+    // Best effort, e.g. not all file systems support transparent huge pages.
+    madvise(mem, len, MADV_HUGEPAGE);
+    return mem;
+}
+
 static int is_disk_encrypted(int fd) {
-    unsigned char magic[2] = {0};
-    ssize_t read_bytes = pread(fd, magic, 2, EXT4_MAGIC_OFFSET);
-    if (read_bytes != 2) {
-        perror("pread(disk,2,EXT4_MAGIC_OFFSET)");
+    char magic[LUKS_MAGIC_LEN] = {0};
+    ssize_t read_bytes = pread(fd, magic, LUKS_MAGIC_LEN, 0);
+    if (read_bytes != LUKS_MAGIC_LEN) {
+        perror("pread(disk,LUKS_MAGIC_LEN,0)");
         return 0;
     }
-    return !(magic[0] == 0x53 && magic[1] == 0xEF);
+    // Unencrypted images may hold any file system (ext4, erofs or squashfs)
+    return !memcmp(magic, LUKS_MAGIC, LUKS_MAGIC_LEN);
 }
 
-static void register_hd(enclave_config_t* encl, char* path, char* mnt, int readonly, char *keyfile_or_passphrase, char *verity_file_or_roothash, char *verity_file_or_hashoffset) {
+/*
+ * Reads the prefetch file <disk_path>.prefetch created by 'sgx-lkl-disk
+ * prefetch' if it exists. Each line contains the offset and length in bytes
+ * of an extent of the disk image, in the order in which they are read at boot.
+ */
+static void prepare_prefetch(struct enclave_disk_config *disk, char *disk_path) {
+    char path[PATH_MAX];
+    char line[128];
+    FILE *pf;
+
+    disk->prefetch = NULL;
+    disk->num_prefetch = 0;
+    disk->prefetch_window = sgxlkl_config_uint64(SGXLKL_HD_PREFETCH_WINDOW);
+
+    snprintf(path, sizeof(path), "%s.prefetch", disk_path);
+    if (!disk->ro || !sgxlkl_config_bool(SGXLKL_HD_PREFETCH) || !(pf = fopen(path, "r")))
+        return;
+
+    size_t cap = 0;
+    while (fgets(line, sizeof(line), pf)) {
+        uint64_t offset, len;
+        if (line[0] == '#' || sscanf(line, "%lu %lu", &offset, &len) != 2)
+            continue;
+
+        if (disk->num_prefetch == cap) {
+            cap = cap ? 2 * cap : 1024;
+            if (!(disk->prefetch = realloc(disk->prefetch, cap * sizeof(*disk->prefetch))))
+                sgxlkl_fail("Failed to allocate memory for prefetch extents: %s\n", strerror(errno));
+        }
+        disk->prefetch[disk->num_prefetch].offset = offset;
+        disk->prefetch[disk->num_prefetch].len = len;
+        disk->num_prefetch++;
+    }
+    fclose(pf);
+}
+
+static void register_hd(enclave_config_t* encl, char* path, char* mnt, int readonly, char *keyfile_or_passphrase, int volume_key, char *verity_file_or_roothash, char *verity_file_or_hashoffset) {
     size_t idx = encl->num_disks;
 
     if (strlen(mnt) > SGXLKL_DISK_MNT_MAX_PATH_LEN)
@@ -490,7 +815,7 @@ static void register_hd(enclave_config_t* encl, char* path, char* mnt, int reado
         }
     }
 
-    char * disk_mmap = mmap(NULL, size, PROT_READ | (readonly ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
+    char * disk_mmap = mmap_huge(NULL, size, PROT_READ | (readonly ? 0 : PROT_WRITE), MAP_SHARED, fd, 1);
     if (disk_mmap == MAP_FAILED)
         sgxlkl_fail("Could not map memory for disk image: %s\n", strerror(errno));
 
@@ -508,6 +833,9 @@ static void register_hd(enclave_config_t* encl, char* path, char* mnt, int reado
     strncpy(disk->mnt, mnt, SGXLKL_DISK_MNT_MAX_PATH_LEN);
     disk->mnt[SGXLKL_DISK_MNT_MAX_PATH_LEN] = '\0';
     disk->enc = is_disk_encrypted(fd);
+    disk->volume_key = volume_key;
+    disk->prefetch = NULL;
+    disk->num_prefetch = 0;
 #ifndef SGXLKL_RELEASE
     // If key/root hash is provided remotely or is set via app config, don't set it here.
     if (disk->enc && !sgxlkl_config_bool(SGXLKL_REMOTE_CONFIG) && !encl->app_config) {
@@ -538,6 +866,11 @@ static void register_hd(enclave_config_t* encl, char* path, char* mnt, int reado
                 sgxlkl_fail("Failed to read keyfile %s.\n", keyfile_or_passphrase);
 
             fclose(kf);
+        } else if (volume_key) {
+            ssize_t key_len = hex_to_bytes(keyfile_or_passphrase, &disk->key);
+            if (key_len <= 0)
+                sgxlkl_fail("Volume key provided via SGXLKL_HD_KEY is neither a key file nor a hex string.\n");
+            disk->key_len = key_len;
         } else {
             disk->key_len = strlen(keyfile_or_passphrase);
             disk->key = (char *) malloc(disk->key_len);
@@ -569,7 +902,20 @@ static void register_hds(enclave_config_t *encl, char *root_hd) {
     encl->num_disks = 0;
     // Register root disk
     register_hd(encl, root_hd, "/", sgxlkl_config_bool(SGXLKL_HD_RO), sgxlkl_config_str(SGXLKL_HD_KEY),
-                sgxlkl_config_str(SGXLKL_HD_VERITY), sgxlkl_config_str(SGXLKL_HD_VERITY_OFFSET));
+                sgxlkl_config_bool(SGXLKL_HD_KEY_IS_VOLUME_KEY), sgxlkl_config_str(SGXLKL_HD_VERITY),
+                sgxlkl_config_str(SGXLKL_HD_VERITY_OFFSET));
+    // Record the root disk's access trace or prefetch it based on an earlier
+    // trace. Prefetching is disabled while recording so that the trace only
+    // contains the reads of the application.
+    if (sgxlkl_config_str(SGXLKL_HD_TRACE)) {
+        if (getenv_bool("SGXLKL_HD_MMAP", 0))
+            sgxlkl_warn("SGXLKL_HD_TRACE has no effect if SGXLKL_HD_MMAP is set.\n");
+        hd_trace_init(sgxlkl_config_str(SGXLKL_HD_TRACE), encl->disks[0].fd);
+        encl->disks[0].prefetch = NULL;
+        encl->disks[0].num_prefetch = 0;
+    } else {
+        prepare_prefetch(&encl->disks[0], root_hd);
+    }
     // Register secondary disks
     while (*hds_str) {
         char *hd_path = hds_str;
@@ -579,7 +925,7 @@ static void register_hds(enclave_config_t *encl, char *root_hd) {
         char *hd_mnt_end = strchrnul(hd_mnt, ':');
         *hd_mnt_end = '\0';
         int hd_ro = hd_mnt_end[1] == '1' ? 1 : 0;
-        register_hd(encl, hd_path, hd_mnt, hd_ro, NULL, NULL, NULL);
+        register_hd(encl, hd_path, hd_mnt, hd_ro, NULL, 0, NULL, NULL);
 
         hds_str = strchrnul(hd_mnt_end + 1, ',');
         while(*hds_str == ' ' || *hds_str == ',') hds_str++;
@@ -698,13 +1044,17 @@ static void register_queues(enclave_config_t* encl) {
     sqs = next_pow2(sqs);
     rqs = next_pow2(rqs);
 
-    void *rq = mmap(0, rqs, PROT_READ|PROT_WRITE, mmapflags, -1, 0);
-    if (rq == MAP_FAILED) sgxlkl_fail("Could not allocate memory for return queue: %s\n", strerror(errno));
-    void *sq = mmap(0, sqs, PROT_READ|PROT_WRITE, mmapflags, -1, 0);
-    if (rq == MAP_FAILED) sgxlkl_fail("Could not allocate memory for syscall queue: %s\n", strerror(errno));
-    encl->syscallpage = calloc(sizeof(syscall_t), encl->maxsyscalls);
-    if (encl->syscallpage == NULL) sgxlkl_fail("Could not allocate memory for syscall pages: %s\n", strerror(errno));
+    // Syscall slots must be cache line aligned, mmap also zeroes them. The
+    // queue buffers share the mapping so that huge pages can back all of them.
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t scs = encl->maxsyscalls * sizeof(syscall_t);
+    scs = (scs + page_size - 1) & ~(page_size - 1);
+    char *mem = mmap_huge(0, scs + rqs + sqs, PROT_READ|PROT_WRITE, mmapflags, -1, 1);
+    if (mem == MAP_FAILED) sgxlkl_fail("Could not allocate memory for syscall pages and queues: %s\n", strerror(errno));
+    encl->syscallpage = mem;
     _syscallpage = encl->syscallpage;
+    void *rq = mem + scs;
+    void *sq = mem + scs + rqs;
 
     if (!(encl->returnq = malloc(sizeof(struct mpmcq))))
         sgxlkl_fail("Could not allocate memory for return queue struct: %s\n, strerror(errno)");
@@ -764,6 +1114,30 @@ void set_vdso(enclave_config_t* conf) {
         fprintf(stderr, "[    SGX-LKL   ] Warning: Could not locate vvar region. vDSO will not be used.\n");
 }
 
+/* Sets up the untrusted backing store of the enclave pager */
+static void set_pager(enclave_config_t *conf) {
+    size_t swap_size = sgxlkl_config_uint64(SGXLKL_PAGER_SWAP_SIZE);
+    size_t chunk_size = sgxlkl_config_uint64(SGXLKL_PAGER_CHUNK_SIZE);
+    if (!swap_size)
+        return;
+#ifdef SGXLKL_HW
+    sgxlkl_warn("Enclave paging is only supported in simulation mode, ignoring SGXLKL_PAGER_SWAP_SIZE.\n");
+    return;
+#endif /* SGXLKL_HW */
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (chunk_size < page_size || (chunk_size & (chunk_size - 1)))
+        sgxlkl_fail("SGXLKL_PAGER_CHUNK_SIZE must be a power of two and at least %ld bytes.\n", page_size);
+
+    swap_size = (swap_size + chunk_size - 1) & ~(chunk_size - 1);
+    conf->pager_swap = mmap(NULL, swap_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (conf->pager_swap == MAP_FAILED)
+        sgxlkl_fail("Could not allocate memory for enclave paging: %s\n", strerror(errno));
+    conf->pager_swap_size = swap_size;
+    conf->pager_chunk_size = chunk_size;
+    conf->pager_resident_size = sgxlkl_config_uint64(SGXLKL_PAGER_RESIDENT_SIZE);
+}
+
 /* Sets up shared memory with the outside */
 void set_shared_mem(enclave_config_t *conf) {
     char *shm_file = sgxlkl_config_str(SGXLKL_SHMEM_FILE);
@@ -955,6 +1329,79 @@ void parse_cpu_affinity_params(char *config, int **cores, size_t *cores_len) {
     }
 }
 
+/* Returns a hyperthread sibling of cpu, or cpu itself if it has none. */
+static int get_sibling_cpu(int cpu) {
+    char path[128], siblings[256];
+    int *cores, sibling = cpu;
+    size_t cores_len;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (!(f = fopen(path, "r")))
+        return cpu;
+    if (!fgets(siblings, sizeof(siblings), f)) {
+        fclose(f);
+        return cpu;
+    }
+    fclose(f);
+    siblings[strcspn(siblings, "\n")] = 0;
+
+    parse_cpu_affinity_params(siblings, &cores, &cores_len);
+    for (size_t i = 0; i < cores_len; i++) {
+        if (cores[i] != cpu) {
+            sibling = cores[i];
+            break;
+        }
+    }
+    free(cores);
+    return sibling;
+}
+
+/*
+ * Sets up a pair of single-producer/single-consumer host call rings per
+ * ethread and starts a host thread serving them. The thread is pinned to a
+ * hyperthread sibling of the ethread's core (or the same core) so that slots
+ * and ring cells stay in a shared cache. Host calls that do not fit into a
+ * ring are submitted via the shared queues served by the regular syscall
+ * threads.
+ */
+static void start_host_call_rings(enclave_config_t *encl, size_t ntenclave, int *ethreads_cores, size_t ethreads_cores_len) {
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t rings_size = 2 * ntenclave * sizeof(struct spscq);
+    struct spscq *rings;
+    host_call_ring_args_t *args;
+    pthread_attr_t attr;
+    pthread_t thread;
+    cpu_set_t set;
+
+    rings = mmap(0, rings_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (rings == MAP_FAILED)
+        sgxlkl_fail("Could not allocate memory for host call rings: %s\n", strerror(errno));
+    if (!(args = calloc(ntenclave, sizeof(*args))))
+        sgxlkl_fail("Could not allocate memory for host call ring threads: %s\n", strerror(errno));
+
+    for (size_t i = 0; i < ntenclave; i++) {
+        newspscq(&rings[2 * i]);
+        newspscq(&rings[2 * i + 1]);
+        args[i].conf = encl;
+        args[i].syscall_ring = &rings[2 * i];
+        args[i].return_ring = &rings[2 * i + 1];
+
+        int cpu = ethreads_cores_len ? ethreads_cores[i % ethreads_cores_len] : i % nproc;
+        pthread_attr_init(&attr);
+        CPU_ZERO(&set);
+        CPU_SET(get_sibling_cpu(cpu), &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, host_syscall_ring_thread, &args[i]))
+            sgxlkl_fail("Could not create host call ring thread.\n");
+        pthread_setname_np(thread, "HOST_SYSCALL_RING");
+    }
+
+    encl->host_call_rings = rings;
+    encl->num_host_call_rings = ntenclave;
+}
+
 #ifdef SGXLKL_HW
 void do_cpuid(unsigned int* reg) {
     __asm__ __volatile__ ("cpuid":\
@@ -962,13 +1409,114 @@ void do_cpuid(unsigned int* reg) {
             "a" (reg[0]), "c"(reg[2]));
 }
 
+/* Maximum number of subleaves cached for CPUID leaves indexed by ecx */
+#define CPUID_CACHE_MAX_SUBLEAF 16
+
+static cpuid_leaf_t cpuid_cache[CPUID_CACHE_MAX_LEAVES];
+
+static int cpuid_leaf_indexed(uint32_t leaf) {
+    switch (leaf) {
+    case 0x4: case 0x7: case 0xd: case 0xf: case 0x10: case 0x12:
+    case 0x14: case 0x17: case 0x18: case 0x8000001d:
+        return 1;
+    }
+    return 0;
+}
+
+static void add_cpuid_leaf(enclave_config_t *conf, uint32_t leaf, uint32_t subleaf) {
+    unsigned int reg[4] = {leaf, 0, subleaf, 0};
+    int indexed = cpuid_leaf_indexed(leaf);
+
+    do_cpuid(reg);
+    // Skip empty subleaves, a lookup for them falls back to a CPUID exit.
+    if (indexed && subleaf && !(reg[0] | reg[1] | reg[2] | reg[3]))
+        return;
+
+    if (conf->cpuid_cache_len >= CPUID_CACHE_MAX_LEAVES) {
+        static int warned = 0;
+        if (!warned++)
+            sgxlkl_warn("CPUID cache full, leaf 0x%x subleaf %u and later leaves will cause additional enclave exits.\n", leaf, subleaf);
+        return;
+    }
+
+    // The initial APIC ID in EBX[31:24] depends on the core that executes
+    // CPUID. lthreads are not pinned to cores, report 0 instead of the ID of
+    // the core that happened to fill the cache.
+    if (leaf == 0x1)
+        reg[1] &= 0x00ffffff;
+
+    cpuid_leaf_t *l = &cpuid_cache[conf->cpuid_cache_len++];
+    l->leaf = leaf;
+    l->subleaf = subleaf;
+    l->flags = indexed ? CPUID_LEAF_INDEXED : 0;
+    memcpy(l->regs, reg, sizeof(l->regs));
+}
+
+/*
+ * Query the basic and extended CPUID leaves once so that the enclave can answer
+ * CPUID instructions without exiting. Leaves 0xb, 0x1f and 0x8000001e report
+ * the (x2)APIC ID of the current core and are not cached. Leaves that do not
+ * fit into the cache are still answered by the host.
+ */
+void set_cpuid_cache(enclave_config_t *conf) {
+    uint32_t ranges[] = {0x0, 0x80000000};
+    conf->cpuid_cache = cpuid_cache;
+    conf->cpuid_cache_len = 0;
+
+    for (int r = 0; r < sizeof(ranges)/sizeof(ranges[0]); r++) {
+        unsigned int reg[4] = {ranges[r], 0, 0, 0};
+        do_cpuid(reg);
+        uint32_t max = reg[0];
+        if (max < ranges[r])
+            continue;
+        // Bound the loop for bogus maximum leaves
+        if (max - ranges[r] >= CPUID_CACHE_MAX_LEAVES)
+            max = ranges[r] + CPUID_CACHE_MAX_LEAVES - 1;
+
+        for (uint32_t leaf = ranges[r]; leaf <= max; leaf++) {
+            if (leaf == 0xb || leaf == 0x1f || leaf == 0x8000001e)
+                continue;
+            if (cpuid_leaf_indexed(leaf)) {
+                for (uint32_t sub = 0; sub < CPUID_CACHE_MAX_SUBLEAF; sub++)
+                    add_cpuid_leaf(conf, leaf, sub);
+            } else {
+                add_cpuid_leaf(conf, leaf, 0);
+            }
+        }
+    }
+}
+
+static void tsc_sample(uint64_t *tsc, uint64_t *ns) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *tsc = host_rdtsc();
+    *ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Provide the TSC frequency to the enclave for internal TSC timestamps. The
+ * frequency is measured over the enclave creation which takes long enough
+ * for a precise estimate.
+ */
+void set_tsc_info(enclave_config_t *conf, uint64_t start_tsc, uint64_t start_ns) {
+    uint64_t tsc, ns;
+    tsc_sample(&tsc, &ns);
+    if (ns <= start_ns || tsc <= start_tsc)
+        return;
+
+    conf->tsc_info.tsc_ref = tsc;
+    conf->tsc_info.ns_ref = ns;
+    conf->tsc_info.cycles_per_ns = (uint64_t) ((double) (tsc - start_tsc) / (ns - start_ns) * (1ULL << 32));
+}
+
 void* enclave_thread(void* parm) {
     args_t* args = (args_t*)parm;
-    uint64_t ret[2];
+    uint64_t ret[3];
     int exit_code = 0;
     my_tcs_id = args->tcs_id;
     while (!__state_exiting) {
         enter_enclave(args->tcs_id, args->call_id, args->args, ret);
+        uint64_t exit_tsc = host_rdtsc();
 #ifdef DEBUG
         __sync_fetch_and_add(&_enclave_exit_stats[ret[0]], 1);
 #endif /* DEBUG */
@@ -980,13 +1528,24 @@ void* enclave_thread(void* parm) {
             }
             case SGXLKL_EXIT_CPUID: {
                 unsigned int* reg = (unsigned int*)ret[1];
+                uint64_t leaf = reg[0];
                 do_cpuid(reg);
+                exit_prof_host_record(SGXLKL_EXIT_CPUID, leaf, exit_tsc, ret[2]);
                 args->call_id = SGXLKL_ENTER_RESUME;
                 break;
             }
             case SGXLKL_EXIT_SLEEP: {
                 struct timespec sleep = {0, ret[1]};
                 nanosleep(&sleep, NULL);
+                exit_prof_host_record(SGXLKL_EXIT_SLEEP, ret[1], exit_tsc, ret[2]);
+                args->call_id = SGXLKL_ENTER_RESUME;
+                break;
+            }
+            case SGXLKL_EXIT_PARK: {
+                /* ret[1] is the futex value observed by the enclave */
+                if (_ethread_park)
+                    syscall(SYS_futex, &_ethread_park->futex, FUTEX_WAIT, (int) ret[1], NULL, NULL, 0);
+                exit_prof_host_record(SGXLKL_EXIT_PARK, 0, exit_tsc, ret[2]);
                 args->call_id = SGXLKL_ENTER_RESUME;
                 break;
             }
@@ -996,11 +1555,16 @@ void* enclave_thread(void* parm) {
                                                : "Enclave config assertion violation");
             }
             case SGXLKL_EXIT_DORESUME: {
+                exit_prof_host_record(SGXLKL_EXIT_DORESUME, 0, exit_tsc, ret[2]);
                 eresume(my_tcs_id);
             }
             case SGXLKL_EXIT_SYSCALL: {
                 size_t syscall_slot = (size_t) ret[1];
+                uint64_t syscallno = _syscallpage[syscall_slot].syscallno;
                 handle_syscall(syscall_slot);
+                uint64_t done_tsc = host_rdtsc();
+                hostcall_hist_record(syscallno, 0, exit_tsc, done_tsc);
+                exit_prof_host_record(SGXLKL_EXIT_SYSCALL, syscallno, exit_tsc, ret[2]);
                 args->call_id = SGXLKL_ENTER_RESUME;
                 break;
             }
@@ -1022,6 +1586,7 @@ void* enclave_thread(void* parm) {
                         _attn_info.ias_report = get_attestation_report(quote, quote_size);
                 }
 
+                exit_prof_host_record(SGXLKL_EXIT_REPORT, 0, exit_tsc, ret[2]);
                 args->call_id = SGXLKL_ENTER_RESUME;
                 break;
             }
@@ -1039,22 +1604,29 @@ done:
 
 void forward_signal(int signum, void *handler_arg) {
     uint64_t call_id = SGXLKL_ENTER_HANDLE_SIGNAL;
-    uint64_t ret[2];
+    uint64_t ret[3];
     void * arg;
     enclave_signal_info_t siginfo;
     siginfo.signum = signum;
     siginfo.arg = handler_arg;
     arg = &siginfo;
+    /* The asynchronous exit that led here is not observable by the host, so
+     * it is only counted. Exits while handling the signal are timed. */
+    uint64_t signal_tsc = host_rdtsc();
+    exit_prof_host_record(EXIT_PROF_REASON_SIGNAL, signum, signal_tsc, 0);
 reenter:
     if (__state_exiting) return;
     enter_enclave(my_tcs_id, call_id, arg, ret);
+    uint64_t exit_tsc = host_rdtsc();
 #ifdef DEBUG
     __sync_fetch_and_add(&_enclave_exit_stats[ret[0]], 1);
 #endif /* DEBUG */
     switch (ret[0]) {
         case SGXLKL_EXIT_CPUID: {
             unsigned int* reg = (unsigned int*)ret[1];
+            uint64_t leaf = reg[0];
             do_cpuid(reg);
+            exit_prof_host_record(SGXLKL_EXIT_CPUID, leaf, exit_tsc, ret[2]);
             call_id = SGXLKL_ENTER_RESUME;
             goto reenter;
         }
@@ -1224,6 +1796,10 @@ void stats_sigint_handler(int signo) {
 }
 #endif /* DEBUG */
 
+void hostcall_hist_sigusr1_handler(int signo) {
+    hostcall_hist_print();
+}
+
 void check_envs(const char **pres, char **envp, const char *warn_msg) {
     char envname[128];
     for (char **env = envp; *env != 0; env++) {
@@ -1260,6 +1836,13 @@ void setup_signal_handlers(void) {
     }
 #endif /* DEBUG */
 
+    /* dump host call latency histograms on SIGUSR1 */
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = hostcall_hist_sigusr1_handler;
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa, NULL) == -1)
+        sgxlkl_fail("Failed to register SIGUSR1 handler\n");
+
     /* ignore sigpipe? */
     if (!sgxlkl_config_bool(SGXLKL_SIGPIPE)) {
         sigemptyset(&sa.sa_mask);
@@ -1451,6 +2034,12 @@ int main(int argc, char *argv[], char *envp[]) {
     cpu_set_t set;
     int *ethreads_cores, *sthreads_cores;
     size_t ethreads_cores_len, sthreads_cores_len;
+    int boot_phase;
+    uint64_t main_start_ns = boot_prof_now();
+#ifdef SGXLKL_HW
+    uint64_t start_tsc, start_ns;
+    tsc_sample(&start_tsc, &start_ns);
+#endif
 
     // We reuse getopt features but do the parsing ourselves (not via
     // getopt_long) as we must allow unrecognized options. We need to stop
@@ -1494,6 +2083,14 @@ int main(int argc, char *argv[], char *envp[]) {
         }
     }
 
+    if (sgxlkl_config_str(SGXLKL_BOOT_PROFILE)) {
+        encl.boot_prof = boot_prof_init(sgxlkl_config_str(SGXLKL_BOOT_PROFILE), main_start_ns);
+#ifdef SGXLKL_HW
+        create_enclave_phase_cb = boot_prof_host_phase_cb;
+#endif
+    }
+    boot_phase = boot_prof_host_begin_at("config", main_start_ns);
+
     encl.argc = argc - optind;
     encl.argv = argv + optind;
 
@@ -1552,12 +2149,23 @@ int main(int argc, char *argv[], char *envp[]) {
     encl.maxsyscalls = encl.max_user_threads + sgxlkl_config_uint64(SGXLKL_ETHREADS);
     encl.espins = sgxlkl_config_uint64(SGXLKL_ESPINS);
     encl.esleep = sgxlkl_config_uint64(SGXLKL_ESLEEP);
+    encl.ethreads = ntenclave;
+    encl.ethreads_min = sgxlkl_config_uint64(SGXLKL_ETHREADS_MIN);
+    encl.ethreads_wake_threshold = sgxlkl_config_uint64(SGXLKL_ETHREADS_WAKE_THRESHOLD);
+    if (encl.ethreads_min && encl.ethreads_min < ntenclave) {
+        if (!(_ethread_park = calloc(1, sizeof(*_ethread_park))))
+            sgxlkl_fail("Could not allocate memory for ethread parking: %s\n", strerror(errno));
+        encl.ethread_park = _ethread_park;
+    }
     encl.wait_on_all_host_calls = sgxlkl_config_bool(SGXLKL_WAIT_ON_HOST_CALLS);
     encl.wait_on_io_host_calls = sgxlkl_config_bool(SGXLKL_WAIT_ON_IO_HOST_CALLS);
     encl.exit_on_host_calls = sgxlkl_config_bool(SGXLKL_EXIT_ON_HOST_CALLS);
+    encl.thread_stats = sgxlkl_config_bool(SGXLKL_THREAD_STATS);
     encl.verbose = sgxlkl_config_bool(SGXLKL_VERBOSE);
     encl.kernel_verbose = sgxlkl_config_bool(SGXLKL_KERNEL_VERBOSE);
     encl.kernel_cmd = sgxlkl_config_str(SGXLKL_CMDLINE);
+    encl.kernel_mem = sgxlkl_config_uint64(SGXLKL_KERNEL_MEM);
+    encl.fast_syscalls = sgxlkl_config_bool(SGXLKL_FAST_SYSCALLS);
     encl.sysctl = sgxlkl_config_str(SGXLKL_SYSCTL);
     encl.cwd = sgxlkl_config_str(SGXLKL_CWD);
     encl.remote_attest_port = (uint16_t) sgxlkl_config_uint64(SGXLKL_REMOTE_ATTEST_PORT);
@@ -1568,19 +2176,24 @@ int main(int argc, char *argv[], char *envp[]) {
     encl.mmap_files = !strcmp(mmap_files, "Shared") ? ENCLAVE_MMAP_FILES_SHARED :
                      (!strcmp(mmap_files, "Private") ? ENCLAVE_MMAP_FILES_PRIVATE :
                      ENCLAVE_MMAP_FILES_NONE);
+    huge_pages = sgxlkl_config_uint64(SGXLKL_HUGEPAGES);
     set_sysconf_params(&encl, ntenclave);
     set_clock_res(&encl);
     set_vdso(&encl);
     set_shared_mem(&encl);
+    set_pager(&encl);
     set_tls(&encl);
     set_wg(&encl);
     register_hds(&encl, root_hd);
+    encl.verity_cache_size = sgxlkl_config_uint64(SGXLKL_HD_VERITY_CACHE_SIZE);
+    encl.disk_crypto_threads = sgxlkl_config_uint64(SGXLKL_HD_CRYPTO_THREADS);
     register_net(&encl, sgxlkl_config_str(SGXLKL_TAP),
                         sgxlkl_config_str(SGXLKL_IP4),
                         (int) sgxlkl_config_uint64(SGXLKL_MASK4),
                         sgxlkl_config_str(SGXLKL_GW4),
                         sgxlkl_config_str(SGXLKL_HOSTNAME));
     register_queues(&encl);
+    boot_prof_host_end(boot_phase);
 
 #ifdef SGXLKL_HW
     init_attestation(&encl);
@@ -1613,6 +2226,7 @@ int main(int argc, char *argv[], char *envp[]) {
 
 #ifdef SGXLKL_HW
     /* Map enclave file into memory */
+    boot_phase = boot_prof_host_begin("map_elf");
     int lkl_lib_fd;
     struct stat lkl_lib_stat;
     if(!(lkl_lib_fd = open(libsgxlkl, O_RDONLY)))
@@ -1623,11 +2237,17 @@ int main(int argc, char *argv[], char *envp[]) {
 
     char* enclave_start = mmap(0, lkl_lib_stat.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, lkl_lib_fd, 0);
 
+    boot_prof_host_end(boot_phase);
+
+    boot_phase = boot_prof_host_begin("init_sgx");
     init_sgx();
+    boot_prof_host_end(boot_phase);
     if (sgxlkl_configured(SGXLKL_HEAP) || sgxlkl_configured(SGXLKL_KEY)) {
         if (!sgxlkl_configured(SGXLKL_KEY))
             sgxlkl_fail("Heap size but no enclave signing key specified. Please specify a signing key via SGXLKL_KEY.\n");
+        boot_phase = boot_prof_host_begin("enclave_update_heap");
         enclave_update_heap(enclave_start, sgxlkl_config_uint64(SGXLKL_HEAP), sgxlkl_config_str(SGXLKL_KEY));
+        boot_prof_host_end(boot_phase);
     }
     encl.base = create_enclave_mem(enclave_start, sgxlkl_config_bool(SGXLKL_NON_PIE), &__sgxlklrun_text_segment_start);
 
@@ -1638,6 +2258,8 @@ int main(int argc, char *argv[], char *envp[]) {
 #else
     /* Initialize heap memory */
     encl.heapsize = sgxlkl_config_uint64(SGXLKL_HEAP);
+    if (huge_pages)
+        encl.heapsize = (encl.heapsize + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
     encl_mmap_flags = MAP_PRIVATE|MAP_ANONYMOUS;
     if (sgxlkl_config_bool(SGXLKL_NON_PIE)) {
         if ((char*) SIM_NON_PIE_ENCL_MMAP_OFFSET + encl.heapsize > &__sgxlklrun_text_segment_start) {
@@ -1645,19 +2267,35 @@ int main(int argc, char *argv[], char *envp[]) {
         }
         encl_mmap_flags |= MAP_FIXED;
     }
-    encl.heap = mmap((void*) SIM_NON_PIE_ENCL_MMAP_OFFSET, encl.heapsize, PROT_EXEC|PROT_READ|PROT_WRITE, encl_mmap_flags, -1, 0);
+    // The enclave changes the protection of individual pages of its heap
+    // (e.g. for RELRO and guard pages), so it never uses hugetlbfs pages.
+    encl.heap = mmap_huge((void*) SIM_NON_PIE_ENCL_MMAP_OFFSET, encl.heapsize, PROT_EXEC|PROT_READ|PROT_WRITE, encl_mmap_flags, -1, 0);
     if (encl.heap == MAP_FAILED)
         sgxlkl_fail("Failed to allocate memory for enclave heap: %s\n", strerror(errno));
+    // Align large mappings in the enclave to huge page boundaries.
+    encl.huge_pages = huge_pages;
 
     /* Load libsgxlkl */
+    boot_phase = boot_prof_host_begin("map_elf");
     struct encl_map_info encl_map;
     load_elf(libsgxlkl, &encl_map);
+    boot_prof_host_end(boot_phase);
     if (encl_map.base < 0) sgxlkl_fail("Could not load liblkl.\n");
 
     encl.base = encl_map.base;
     encl.ifn = encl_map.entry_point;
 #endif
 
+    if (sgxlkl_config_str(SGXLKL_EXIT_PROFILE))
+        encl.exit_prof = exit_prof_init(sgxlkl_config_str(SGXLKL_EXIT_PROFILE),
+                                        sgxlkl_config_uint64(SGXLKL_EXIT_PROFILE_PERIOD),
+                                        ntenclave, (void *) encl.base);
+
+    blocking_pool_init(&encl, sgxlkl_config_uint64(SGXLKL_BLOCKING_STHREADS));
+
+    if (sgxlkl_config_bool(SGXLKL_HOST_CALL_RINGS))
+        start_host_call_rings(&encl, ntenclave, ethreads_cores, ethreads_cores_len);
+
     /* Launch system call threads */
     for (i = 0; i < ntsyscall; i++) {
         pthread_attr_init(&eattr);
@@ -1681,6 +2319,8 @@ int main(int argc, char *argv[], char *envp[]) {
     encl.auxv = (Elf64_auxv_t*) (++auxvp);
 
 #ifdef SGXLKL_HW
+    set_cpuid_cache(&encl);
+    set_tsc_info(&encl, start_tsc, start_ns);
     args_t a[ntenclave];
 #else
     // Run the relocation routine inside the new environment
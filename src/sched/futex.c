@@ -8,7 +8,7 @@
 #include <time.h>
 #include <lthread.h>
 #include <atomic.h>
-#include <ticketlock.h>
+#include <hybridlock.h>
 #include <sgxlkl_debug.h>
 
 #include <futex.h>
@@ -18,7 +18,7 @@ SLIST_HEAD(__futex_q_head, futex_q) futex_queues =
      SLIST_HEAD_INITIALIZER(futex_queues);
 
 /* for the total ordering of futex operations as mandated by POSIX */
-static struct ticketlock futex_q_lock;
+static struct hybridlock futex_q_lock = HYBRIDLOCK_INITIALIZER("futex_q_lock");
 
 /* number of threads sleeping on a futex, protected by futex_q_lock */
 static volatile int futex_sleepers;
@@ -27,6 +27,68 @@ static volatile int futex_sleepers;
 #define FUTEX_NONE    0 /* no extraordinary happened */
 #define FUTEX_EXPIRED 1 /* timeout expired */
 
+/* futex_q flags */
+#define FUTEX_Q_PI         1 /* waits for a PI futex to be handed over */
+#define FUTEX_Q_REQUEUE_PI 2 /* waits in FUTEX_WAIT_REQUEUE_PI */
+
+#ifndef FUTEX_WAKE_OP
+#define FUTEX_WAKE_OP         5
+#endif
+#ifndef FUTEX_LOCK_PI
+#define FUTEX_LOCK_PI         6
+#endif
+#ifndef FUTEX_UNLOCK_PI
+#define FUTEX_UNLOCK_PI       7
+#endif
+#ifndef FUTEX_TRYLOCK_PI
+#define FUTEX_TRYLOCK_PI      8
+#endif
+#ifndef FUTEX_WAIT_REQUEUE_PI
+#define FUTEX_WAIT_REQUEUE_PI 11
+#endif
+#ifndef FUTEX_CMP_REQUEUE_PI
+#define FUTEX_CMP_REQUEUE_PI  12
+#endif
+
+/* PI futex word layout */
+#define FUTEX_WAITERS    0x80000000
+#define FUTEX_OWNER_DIED 0x40000000
+#define FUTEX_TID_MASK   0x3fffffff
+
+/* FUTEX_WAKE_OP operations and comparisons */
+#define FUTEX_OP_SET         0
+#define FUTEX_OP_ADD         1
+#define FUTEX_OP_OR          2
+#define FUTEX_OP_ANDN        3
+#define FUTEX_OP_XOR         4
+#define FUTEX_OP_OPARG_SHIFT 8
+#define FUTEX_OP_CMP_EQ      0
+#define FUTEX_OP_CMP_NE      1
+#define FUTEX_OP_CMP_LT      2
+#define FUTEX_OP_CMP_LE      3
+#define FUTEX_OP_CMP_GT      4
+#define FUTEX_OP_CMP_GE      5
+
+/*
+ * Owners of PI futexes that acquired them through this layer, so that they
+ * can be boosted to the lthread priority of their highest-priority waiter.
+ * Owners that took a futex in user space without a system call are unknown
+ * and are not boosted. An entry is only trusted while the TID in the futex
+ * word still matches, which also guarantees that its lthread is alive.
+ * Protected by futex_q_lock.
+ */
+#define FUTEX_PI_OWNERS 64 /* Must be a power of 2 */
+
+struct futex_pi_owner {
+    uint32_t futex_key;
+    int tid;                /* 0 if unused */
+    struct lthread *lt;
+    int base_prio;          /* priority of lt before it was boosted */
+    int boosted;
+};
+
+static struct futex_pi_owner futex_pi_owners[FUTEX_PI_OWNERS];
+
 //#define SGXLKL_DEBUG_FUTEX
 #ifdef SGXLKL_DEBUG_FUTEX
 # define FUTEX_SGXLKL_VERBOSE(...) SGXLKL_VERBOSE(__VA_ARGS__)
@@ -62,7 +124,7 @@ futex_tick() {
 
     a_barrier();
 
-    if (ticket_trylock(&futex_q_lock) == EBUSY)
+    if (hybrid_trylock(&futex_q_lock) == EBUSY)
         return;
 
     SLIST_FOREACH_SAFE(fq, &futex_queues, entries, tmp) {
@@ -78,7 +140,7 @@ futex_tick() {
         }
     }
 
-    ticket_unlock(&futex_q_lock);
+    hybrid_unlock(&futex_q_lock);
 }
 
 /* constructs a new futex_q */
@@ -89,7 +151,7 @@ __futex_wait_new(uint32_t futex_key, uint32_t bitset) {
 
     /*
      * It is not safe to use malloc and/or free while holding the futex
-     * ticketlock as both malloc and free perform a futex system call themselves
+     * lock as both malloc and free perform a futex system call themselves
      * under certain circumstances which will result in a deadlock.
      *
      * There should only ever be at most one fq per lthread. We therefore use an
@@ -102,6 +164,7 @@ __futex_wait_new(uint32_t futex_key, uint32_t bitset) {
     fq->futex_deadline = 0;
     fq->clock = CLOCK_MONOTONIC;
     fq->futex_lt = lthread_self();
+    fq->futex_flags = 0;
 
     FUTEX_SGXLKL_VERBOSE("%s: created new futex_q in tid %d\n",
             __func__, lthread_current()->tid);
@@ -122,7 +185,7 @@ _lthread_timespec_to_usec_safe(struct timespec *ts) {
 
 static void
 __do_futex_unlock(void *lock) {
-    ticket_unlock((struct ticketlock *) lock);
+    hybrid_unlock((struct hybridlock *) lock);
 }
 
 static int
@@ -148,6 +211,17 @@ __do_futex_sleep(struct futex_q *fq, const struct timespec *ts, const clock_t cl
     return lthread_self()->err == FUTEX_EXPIRED ? -ETIMEDOUT : 0;
 }
 
+/* removes fq from the futex queues and makes its lthread runnable */
+static void
+__futex_q_wake(struct futex_q *fq) {
+    struct lthread *lt = fq->futex_lt;
+    fq->futex_lt = NULL;
+    a_fetch_add(&futex_sleepers, -1);
+    SLIST_REMOVE(&futex_queues, fq, futex_q, entries);
+    lt->err = FUTEX_NONE;
+    __scheduler_enqueue(lt);
+}
+
 /* a FUTEX_WAIT operation */
 static int
 futex_wait(int *uaddr, int val, uint32_t bitset, const struct timespec *ts, const clock_t clock, const struct timespec *now) {
@@ -198,14 +272,11 @@ futex_wake(int *uaddr, unsigned int num, uint32_t bitset) {
             __func__, lthread_current()->tid, futex_key, num);
 
     SLIST_FOREACH_SAFE(fq, &futex_queues, entries, tmp) {
-        if (fq->futex_key == futex_key && fq->futex_bitset & bitset && w < num) {
-            struct lthread *lt = fq->futex_lt;
-            fq->futex_lt = NULL;
+        /* PI waiters are only woken by handing the futex over to them */
+        if (fq->futex_key == futex_key && fq->futex_bitset & bitset && w < num &&
+                !(fq->futex_flags & FUTEX_Q_PI)) {
             w++;
-            a_fetch_add(&futex_sleepers, -1);
-            SLIST_REMOVE(&futex_queues, fq, futex_q, entries);
-            lt->err = FUTEX_NONE;
-            __scheduler_enqueue(lt);
+            __futex_q_wake(fq);
         }
     }
 
@@ -224,14 +295,11 @@ static int futex_requeue(int *uaddr, int *uaddr2, unsigned int num, unsigned int
     futex_key2 = to_futex_key(uaddr2);
 
     SLIST_FOREACH_SAFE(fq, &futex_queues, entries, tmp) {
+        if (fq->futex_flags & FUTEX_Q_PI)
+            continue;
         if (fq->futex_key == futex_key && w < num) {
-            struct lthread *lt = fq->futex_lt;
-            fq->futex_lt = NULL;
             w++;
-            a_fetch_add(&futex_sleepers, -1);
-            SLIST_REMOVE(&futex_queues, fq, futex_q, entries);
-            lt->err = FUTEX_NONE;
-            __scheduler_enqueue(lt);
+            __futex_q_wake(fq);
         } else if(fq->futex_key == futex_key && w < num + limit) {
             fq->futex_key = futex_key2;
 	    w++;
@@ -241,18 +309,300 @@ static int futex_requeue(int *uaddr, int *uaddr2, unsigned int num, unsigned int
     return w;
 }
 
+/* a FUTEX_WAKE_OP operation */
+static int
+futex_wake_op(int *uaddr, unsigned int num, unsigned int num2, int *uaddr2, int val3) {
+    int op = (val3 >> 28) & 0xf;
+    int cmp = (val3 >> 24) & 0xf;
+    int oparg = (int) ((uint32_t) val3 << 8) >> 20;
+    int cmparg = (int) ((uint32_t) val3 << 20) >> 20;
+    int oldval, w;
+
+    if (op & FUTEX_OP_OPARG_SHIFT) {
+        oparg = 1 << (oparg & 31);
+        op &= ~FUTEX_OP_OPARG_SHIFT;
+    }
+
+    /* Reject invalid operations before modifying uaddr2 or waking anyone */
+    if (op > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE)
+        return -ENOSYS;
+
+    switch (op) {
+        case FUTEX_OP_SET:
+            oldval = __atomic_exchange_n(uaddr2, oparg, __ATOMIC_SEQ_CST);
+            break;
+        case FUTEX_OP_ADD:
+            oldval = __atomic_fetch_add(uaddr2, oparg, __ATOMIC_SEQ_CST);
+            break;
+        case FUTEX_OP_OR:
+            oldval = __atomic_fetch_or(uaddr2, oparg, __ATOMIC_SEQ_CST);
+            break;
+        case FUTEX_OP_ANDN:
+            oldval = __atomic_fetch_and(uaddr2, ~oparg, __ATOMIC_SEQ_CST);
+            break;
+        case FUTEX_OP_XOR:
+            oldval = __atomic_fetch_xor(uaddr2, oparg, __ATOMIC_SEQ_CST);
+            break;
+        default:
+            return -ENOSYS;
+    }
+
+    w = futex_wake(uaddr, num, FUTEX_BITSET_MATCH_ANY);
+
+    switch (cmp) {
+        case FUTEX_OP_CMP_EQ: cmp = oldval == cmparg; break;
+        case FUTEX_OP_CMP_NE: cmp = oldval != cmparg; break;
+        case FUTEX_OP_CMP_LT: cmp = oldval < cmparg; break;
+        case FUTEX_OP_CMP_LE: cmp = oldval <= cmparg; break;
+        case FUTEX_OP_CMP_GT: cmp = oldval > cmparg; break;
+        case FUTEX_OP_CMP_GE: cmp = oldval >= cmparg; break;
+        default:
+            return -ENOSYS;
+    }
+
+    if (cmp)
+        w += futex_wake(uaddr2, num2, FUTEX_BITSET_MATCH_ANY);
+
+    return w;
+}
+
+static struct futex_pi_owner *
+__futex_pi_owner(uint32_t futex_key) {
+    return &futex_pi_owners[(futex_key >> 2) & (FUTEX_PI_OWNERS - 1)];
+}
+
+static void
+__futex_pi_set_owner(uint32_t futex_key, struct lthread *lt) {
+    struct futex_pi_owner *o = __futex_pi_owner(futex_key);
+    /* Do not evict a boosted owner of another futex, its priority could
+     * otherwise not be restored */
+    if (o->boosted && o->futex_key != futex_key)
+        return;
+    o->futex_key = futex_key;
+    o->tid = lt->tid;
+    o->lt = lt;
+    o->boosted = 0;
+}
+
+/* forgets the owner of a PI futex and restores its priority */
+static void
+__futex_pi_clear_owner(uint32_t futex_key, int tid) {
+    struct futex_pi_owner *o = __futex_pi_owner(futex_key);
+    if (o->futex_key != futex_key || o->tid != tid)
+        return;
+    if (o->boosted)
+        lthread_set_prio(o->lt, o->base_prio);
+    memset(o, 0, sizeof(*o));
+}
+
+/* raises the priority of the owner of a PI futex to prio */
+static void
+__futex_pi_boost(uint32_t futex_key, int tid, int prio) {
+    struct futex_pi_owner *o = __futex_pi_owner(futex_key);
+    if (o->futex_key != futex_key || o->tid != tid || o->lt->prio >= prio)
+        return;
+    if (!o->boosted) {
+        o->base_prio = o->lt->prio;
+        o->boosted = 1;
+    }
+    lthread_set_prio(o->lt, prio);
+}
+
+/* returns the PI waiter on futex_key with the highest priority, the one that
+ * has waited longest among waiters of equal priority */
+static struct futex_q *
+__futex_pi_top_waiter(uint32_t futex_key, struct futex_q *skip) {
+    struct futex_q *fq, *top = NULL;
+
+    /* futex_queues is in LIFO order */
+    SLIST_FOREACH(fq, &futex_queues, entries) {
+        if (fq->futex_key == futex_key && fq->futex_flags & FUTEX_Q_PI && fq != skip &&
+                (!top || fq->futex_lt->prio >= top->futex_lt->prio))
+            top = fq;
+    }
+
+    return top;
+}
+
+/*
+ * Makes sure that the PI waiters on uaddr get the futex: hands a free futex
+ * to the top waiter, or marks a held futex as contended so that its owner
+ * releases it with FUTEX_UNLOCK_PI, boosting the owner if it is known.
+ */
+static void
+__futex_pi_settle(int *uaddr) {
+    uint32_t futex_key = to_futex_key(uaddr);
+    uint32_t v, nv;
+    struct futex_q *top, *next;
+
+    for (;;) {
+        top = __futex_pi_top_waiter(futex_key, NULL);
+        if (!top)
+            return;
+
+        v = __atomic_load_n((uint32_t *) uaddr, __ATOMIC_SEQ_CST);
+        if (v & FUTEX_TID_MASK) {
+            if (!(v & FUTEX_WAITERS) &&
+                    !__atomic_compare_exchange_n((uint32_t *) uaddr, &v, v | FUTEX_WAITERS, 0,
+                                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                continue;
+            __futex_pi_boost(futex_key, v & FUTEX_TID_MASK, top->futex_lt->prio);
+            return;
+        }
+
+        next = __futex_pi_top_waiter(futex_key, top);
+        nv = top->futex_lt->tid | (v & FUTEX_OWNER_DIED) | (next ? FUTEX_WAITERS : 0);
+        if (!__atomic_compare_exchange_n((uint32_t *) uaddr, &v, nv, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            continue;
+
+        FUTEX_SGXLKL_VERBOSE("%s: handing PI futex 0x%x to tid %d\n",
+                __func__, futex_key, top->futex_lt->tid);
+
+        __futex_pi_set_owner(futex_key, top->futex_lt);
+        if (next)
+            __futex_pi_boost(futex_key, top->futex_lt->tid, next->futex_lt->prio);
+        __futex_q_wake(top);
+        return;
+    }
+}
+
+/* a FUTEX_LOCK_PI or FUTEX_TRYLOCK_PI operation, sets *slept if the futex
+ * lock has been released. Returns -EOWNERDEAD if the futex has been acquired
+ * but its previous owner died while holding it. */
+static int
+futex_lock_pi(int *uaddr, const struct timespec *ts, const struct timespec *now, int trylock, int *slept) {
+    struct lthread *lt = lthread_self();
+    uint32_t futex_key = to_futex_key(uaddr);
+    uint32_t v, owner;
+    struct futex_q *fq;
+    int rc;
+
+    for (;;) {
+        v = __atomic_load_n((uint32_t *) uaddr, __ATOMIC_SEQ_CST);
+        owner = v & FUTEX_TID_MASK;
+        if (!owner) {
+            /* The futex is free or its owner died, take it */
+            if (__atomic_compare_exchange_n((uint32_t *) uaddr, &v, lt->tid | (v & ~FUTEX_TID_MASK), 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                __futex_pi_set_owner(futex_key, lt);
+                return v & FUTEX_OWNER_DIED ? -EOWNERDEAD : 0;
+            }
+            continue;
+        }
+
+        if (owner == lt->tid)
+            return -EDEADLK;
+        if (trylock)
+            return -EAGAIN;
+
+        if ((v & FUTEX_WAITERS) ||
+                __atomic_compare_exchange_n((uint32_t *) uaddr, &v, v | FUTEX_WAITERS, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            break;
+    }
+
+    __futex_pi_boost(futex_key, owner, lt->prio);
+
+    fq = __futex_wait_new(futex_key, FUTEX_BITSET_MATCH_ANY);
+    fq->futex_flags = FUTEX_Q_PI;
+
+    /* FUTEX_LOCK_PI timeouts are absolute CLOCK_REALTIME values. When woken
+     * up without timing out, the futex has been handed to us. */
+    *slept = 1;
+    rc = __do_futex_sleep(fq, ts, CLOCK_REALTIME, now);
+    if (!rc && (__atomic_load_n((uint32_t *) uaddr, __ATOMIC_SEQ_CST) & FUTEX_OWNER_DIED))
+        rc = -EOWNERDEAD;
+    return rc;
+}
+
+/* a FUTEX_UNLOCK_PI operation */
+static int
+futex_unlock_pi(int *uaddr) {
+    int tid = lthread_self()->tid;
+    uint32_t v = __atomic_load_n((uint32_t *) uaddr, __ATOMIC_SEQ_CST);
+
+    if ((v & FUTEX_TID_MASK) != tid)
+        return -EPERM;
+
+    __futex_pi_clear_owner(to_futex_key(uaddr), tid);
+
+    /* Lockers cannot modify the futex word while FUTEX_WAITERS is set, but
+     * the futex may be taken in user space as soon as it is released. */
+    __atomic_store_n((uint32_t *) uaddr, 0, __ATOMIC_SEQ_CST);
+    __futex_pi_settle(uaddr);
+
+    return 0;
+}
+
+/* a FUTEX_WAIT_REQUEUE_PI operation, sets *slept if the futex lock has been
+ * released */
+static int
+futex_wait_requeue_pi(int *uaddr, int val, const struct timespec *ts, const clock_t clock,
+                      const struct timespec *now, int *uaddr2, int *slept) {
+    struct futex_q *fq;
+    int rc;
+
+    if (uaddr == uaddr2)
+        return -EINVAL;
+
+    if (a_fetch_add(uaddr, 0) != val)
+        return -EAGAIN;
+
+    fq = __futex_wait_new(to_futex_key(uaddr), FUTEX_BITSET_MATCH_ANY);
+    fq->futex_flags = FUTEX_Q_REQUEUE_PI;
+    fq->futex_requeue_key = to_futex_key(uaddr2);
+
+    *slept = 1;
+    rc = __do_futex_sleep(fq, ts, clock, now);
+    if (rc)
+        return rc;
+
+    /* Only waiters requeued onto the PI futex are handed the futex, waiters
+     * woken by a FUTEX_WAKE have to retry */
+    return fq->futex_flags & FUTEX_Q_PI ? 0 : -EAGAIN;
+}
+
+/* a FUTEX_CMP_REQUEUE_PI operation */
+static int
+futex_cmp_requeue_pi(int *uaddr, unsigned int num, unsigned int limit, int *uaddr2, int val3) {
+    uint32_t futex_key, futex_key2;
+    struct futex_q *fq;
+    unsigned int w = 0;
+
+    /* Only one waiter can acquire the PI futex */
+    if (num != 1 || uaddr == uaddr2)
+        return -EINVAL;
+
+    if (a_fetch_add(uaddr, 0) != val3)
+        return -EAGAIN;
+
+    futex_key = to_futex_key(uaddr);
+    futex_key2 = to_futex_key(uaddr2);
+
+    /* Move the waiters onto the PI futex, the top one of which acquires it
+     * if it is free */
+    SLIST_FOREACH(fq, &futex_queues, entries) {
+        if (fq->futex_key == futex_key && fq->futex_flags & FUTEX_Q_REQUEUE_PI &&
+                fq->futex_requeue_key == futex_key2 && w < num + limit) {
+            fq->futex_key = futex_key2;
+            fq->futex_flags = FUTEX_Q_PI;
+            w++;
+        }
+    }
+
+    if (w)
+        __futex_pi_settle(uaddr2);
+
+    return w;
+}
+
 int
 syscall_SYS_futex(int *uaddr, int op, int val, const struct timespec *timeout,
                     int *uaddr2, int val3) {
-    int rc;
-    static int init = 1;
+    int rc, slept = 0;
     uint32_t bitset = FUTEX_BITSET_MATCH_ANY;
 
-    if (init) {
-        memset((void*) &futex_q_lock, 0, sizeof(struct ticketlock));
-        init = 0;
-    }
-
     /* Ignore FUTEX_PRIVATE. We are single-process anyway. */
     op &= ~(FUTEX_PRIVATE);
 
@@ -274,7 +624,7 @@ syscall_SYS_futex(int *uaddr, int op, int val, const struct timespec *timeout,
         clock_gettime(clock, &now);
     }
 
-    ticket_lock(&futex_q_lock);
+    hybrid_lock(&futex_q_lock);
     switch(op) {
         case FUTEX_WAIT_BITSET:
             if (val3 == 0) {
@@ -302,7 +652,7 @@ syscall_SYS_futex(int *uaddr, int op, int val, const struct timespec *timeout,
             break;
         case FUTEX_CMP_REQUEUE:
             if (*uaddr != val3) {
-                rc == -EAGAIN;
+                rc = -EAGAIN;
                 break;
             }
             /* Fall through to FUTEX_REQUEUE */
@@ -310,12 +660,37 @@ syscall_SYS_futex(int *uaddr, int op, int val, const struct timespec *timeout,
             /* In the case of FUTEX_REQUEUE, the third argument is actually of type uint32_t */
             rc = futex_requeue(uaddr, uaddr2, val, (int) timeout);
             break;
+        case FUTEX_WAKE_OP:
+            /* The fourth argument is the number of waiters to wake on uaddr2 */
+            rc = futex_wake_op(uaddr, val, (unsigned int) (uintptr_t) timeout, uaddr2, val3);
+            break;
+        case FUTEX_LOCK_PI:
+        case FUTEX_TRYLOCK_PI:
+            assert(lthread_self());
+
+            rc = futex_lock_pi(uaddr, timeout, &now, op == FUTEX_TRYLOCK_PI, &slept);
+            if (slept)
+                goto ret_nounlock;
+            break;
+        case FUTEX_UNLOCK_PI:
+            rc = futex_unlock_pi(uaddr);
+            break;
+        case FUTEX_WAIT_REQUEUE_PI:
+            assert(lthread_self());
+
+            rc = futex_wait_requeue_pi(uaddr, val, timeout, clock, &now, uaddr2, &slept);
+            if (slept)
+                goto ret_nounlock;
+            break;
+        case FUTEX_CMP_REQUEUE_PI:
+            rc = futex_cmp_requeue_pi(uaddr, val, (unsigned int) (uintptr_t) timeout, uaddr2, val3);
+            break;
         default:
             FUTEX_SGXLKL_VERBOSE("%s: futex invalid op: %d\n", __func__, op);
             rc = -ENOSYS;
     }
 
-    ticket_unlock(&futex_q_lock);
+    hybrid_unlock(&futex_q_lock);
 
 ret_nounlock:
     return rc;
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "hybridlock.h"
+#include "lthread.h"
+#include "lthread_int.h"
+#include "sgx_hostcall_interface.h"
+
+/* Waiter node states */
+#define HYBRIDLOCK_WAITING 0
+#define HYBRIDLOCK_PARKED  1
+#define HYBRIDLOCK_GRANTED 2
+
+#ifdef SGXLKL_LOCK_STATS
+static struct hybridlock *volatile hybridlock_list = NULL;
+
+/* Called with the lock held */
+static void hybrid_acquired(struct hybridlock *l, int contended) {
+    struct hybridlock_stats *s = &l->stats;
+    if (!s->registered) {
+        s->registered = 1;
+        s->next_lock = hybridlock_list;
+        while (!__atomic_compare_exchange_n(&hybridlock_list, &s->next_lock, l, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    }
+    s->acquired++;
+    s->contended += contended;
+    s->acquire_tsc = hostcall_tsc();
+}
+
+static void hybrid_released(struct hybridlock *l) {
+    struct hybridlock_stats *s = &l->stats;
+    uint64_t hold = hostcall_tsc() - s->acquire_tsc;
+    s->hold_cycles += hold;
+    if (hold > s->max_hold_cycles)
+        s->max_hold_cycles = hold;
+}
+
+void hybrid_lock_stats_print(void) {
+    printf("Lock statistics:\n");
+    printf("%-16s %12s %12s %12s %16s %16s\n", "lock", "acquired", "contended", "parked", "avg hold cycles", "max hold cycles");
+    for (struct hybridlock *l = hybridlock_list; l; l = l->stats.next_lock) {
+        struct hybridlock_stats *s = &l->stats;
+        printf("%-16s %12lu %12lu %12lu %16lu %16lu\n", s->name ? s->name : "?",
+               s->acquired, s->contended, s->parked,
+               s->acquired ? s->hold_cycles / s->acquired : 0, s->max_hold_cycles);
+    }
+}
+#else
+#define hybrid_acquired(l, contended) do {} while (0)
+#define hybrid_released(l) do {} while (0)
+#endif /* SGXLKL_LOCK_STATS */
+
+/* Yield callback of a parking waiter, runs on the scheduler once the lthread
+ * is off its stack. The lock may have been handed over in the meantime. */
+static void hybrid_park(void *arg) {
+    struct hybridlock_node *node = arg;
+    struct lthread *lt = node->lt;
+    int expected = HYBRIDLOCK_WAITING;
+    if (!__atomic_compare_exchange_n(&node->state, &expected, HYBRIDLOCK_PARKED, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        __scheduler_enqueue(lt);
+}
+
+static void hybrid_wait(struct hybridlock *l, struct hybridlock_node *node) {
+    struct lthread *lt = lthread_self();
+    int may_park = lt && !(lt->attr.state & BIT(LT_ST_PINNED));
+    size_t spins = 0;
+
+    while (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) != HYBRIDLOCK_GRANTED) {
+        if (may_park && spins >= HYBRIDLOCK_SPINS) {
+            node->lt = lt;
+#ifdef SGXLKL_LOCK_STATS
+            __atomic_add_fetch(&l->stats.parked, 1, __ATOMIC_RELAXED);
+#endif /* SGXLKL_LOCK_STATS */
+            _lthread_yield_cb(lt, hybrid_park, node);
+        } else {
+            a_spin();
+            spins++;
+        }
+    }
+}
+
+/* Hands the lock to the waiter at the head of the queue */
+static void hybrid_grant(struct hybridlock_node *succ) {
+    int expected = HYBRIDLOCK_WAITING;
+    if (__atomic_compare_exchange_n(&succ->state, &expected, HYBRIDLOCK_GRANTED, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return;
+
+    /* The waiter has parked and only runs again once enqueued */
+    struct lthread *lt = succ->lt;
+    __atomic_store_n(&succ->state, HYBRIDLOCK_GRANTED, __ATOMIC_RELEASE);
+    __scheduler_enqueue(lt);
+}
+
+void hybrid_lock(struct hybridlock *l) {
+    /* The lock itself serves as queue node of a holder without waiters */
+    struct hybridlock_node *self = (struct hybridlock_node *) l;
+    struct hybridlock_node node, *prev, *succ;
+
+    for (;;) {
+        prev = __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE);
+        if (!prev) {
+            if (__atomic_compare_exchange_n(&l->tail, &prev, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+
+        node.next = NULL;
+        node.state = HYBRIDLOCK_WAITING;
+        node.lt = NULL;
+        if (!__atomic_compare_exchange_n(&l->tail, &prev, &node, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            continue;
+        __atomic_store_n(&prev->next, &node, __ATOMIC_RELEASE);
+
+        hybrid_wait(l, &node);
+
+        /* Move our successor, if any, to the head of the queue as the node
+         * is about to go out of scope */
+        succ = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE);
+        if (!succ) {
+            l->next = NULL;
+            prev = &node;
+            if (!__atomic_compare_exchange_n(&l->tail, &prev, self, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                while (!(succ = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE)))
+                    a_spin();
+                l->next = succ;
+            }
+        } else {
+            l->next = succ;
+        }
+#if DEBUG
+        l->lt = lthread_self();
+#endif /* DEBUG */
+        hybrid_acquired(l, 1);
+        return;
+    }
+
+#if DEBUG
+    l->lt = lthread_self();
+#endif /* DEBUG */
+    hybrid_acquired(l, 0);
+}
+
+void hybrid_unlock(struct hybridlock *l) {
+    struct hybridlock_node *self = (struct hybridlock_node *) l;
+    struct hybridlock_node *succ;
+
+    hybrid_released(l);
+#if DEBUG
+    l->lt = NULL;
+#endif /* DEBUG */
+
+    succ = __atomic_load_n(&l->next, __ATOMIC_ACQUIRE);
+    if (!succ) {
+        struct hybridlock_node *expected = self;
+        if (__atomic_compare_exchange_n(&l->tail, &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+        while (!(succ = __atomic_load_n(&l->next, __ATOMIC_ACQUIRE)))
+            a_spin();
+    }
+    hybrid_grant(succ);
+}
+
+int hybrid_trylock(struct hybridlock *l) {
+    struct hybridlock_node *expected = NULL;
+    if (!__atomic_compare_exchange_n(&l->tail, &expected, (struct hybridlock_node *) l, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return EBUSY;
+#if DEBUG
+    l->lt = lthread_self();
+#endif /* DEBUG */
+    hybrid_acquired(l, 0);
+    return 0;
+}
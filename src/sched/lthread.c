@@ -51,6 +51,7 @@
 #include "sgxlkl_debug.h"
 #include "stdio_impl.h"
 #include "sgx_hostcall_interface.h"
+#include "hybridlock.h"
 #include "ticketlock.h"
 #include "tree.h"
 #include "sgx_enclave_config.h"
@@ -83,7 +84,7 @@ RB_GENERATE(lthread_rb_sleep, lthread, sleep_node, _lthread_sleep_cmp);
 
 static int spawned_lthreads = 1;
 
-static struct ticketlock sleeplock;
+static struct hybridlock sleeplock = HYBRIDLOCK_INITIALIZER("sleeplock");
 int _lthread_sleeprb_inited = 0;
 struct lthread_rb_sleep _lthread_sleeping;
 
@@ -94,6 +95,23 @@ static size_t sleeptime_ns = 1600;
 static size_t futex_wake_spins = 500;
 static volatile int schedqueuelen = 0;
 
+/* Capacity of the priority scheduler queue in lthreads */
+#define SCHEDQUEUE_PRIO_SIZE 1024
+
+/* Parking of idle ethreads, see lthread_park_enable */
+static ethread_park_t *park = NULL;
+static size_t park_nethreads;
+static size_t park_min_active;
+static size_t park_wake_threshold;
+static volatile int nparked = 0;
+
+/* Per-lthread statistics, protected by statslock */
+static int stats_enabled = 0;
+static struct ticketlock statslock;
+static size_t nstats = 0;
+SLIST_HEAD(__lthread_stats_head, lthread_stats) lthread_stats_list =
+     SLIST_HEAD_INITIALIZER(lthread_stats_list);
+
 #if DEBUG
 int thread_count = 1;
 struct lthread_queue *__active_lthreads = NULL;
@@ -144,6 +162,10 @@ __asm__ (
 "       movq %r13, 40(%rsi)                              \n"
 "       movq %r14, 48(%rsi)                              \n"
 "       movq %r15, 56(%rsi)                              \n"
+"       stmxcsr 64(%rsi)        # save mxcsr, x87 cw     \n"
+"       fnstcw 68(%rsi)                                  \n"
+"       ldmxcsr 64(%rdi)        # restore mxcsr, x87 cw  \n"
+"       fldcw 68(%rdi)                                   \n"
 "       movq 56(%rdi), %r15                              \n"
 "       movq 48(%rdi), %r14                              \n"
 "       movq 40(%rdi), %r13     # restore rbx,r12-r15    \n"
@@ -171,33 +193,112 @@ static void _exec(void *lt_) {
     _lthread_yield(lt);
 }
 
-static long lthread_scall(long n, long a1, long a2, long a3) {
+static long lthread_scall(long n, long a1, long a2, long a3, long a4) {
     unsigned long ret;
-    register long r10 __asm__("r10") = a3;
+    register long r10 __asm__("r10") = a4;
     register long r8 __asm__("r8") = 0;
     register long r9 __asm__("r9") = 0;
-    __asm__ __volatile__ ("syscall" : "=a"(ret) : "a"(n), "D"(a1), "S"(a2), "d"(0), "r"(r10), "r"(r8), "r"(r9)
+    __asm__ __volatile__ ("syscall" : "=a"(ret) : "a"(n), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8), "r"(r9)
                           : "rcx", "r11", "memory");
     return ret;
 }
 
+/* Accounts an lthread added to the scheduler queue. Only called by
+ * __scheduler_enqueue, the matching decrement is in lthread_run. */
+void _lthread_schedqueue_inc(void) {
+    int queued = __atomic_add_fetch(&schedqueuelen, 1, __ATOMIC_SEQ_CST);
+    if (!park)
+        return;
+
+    /* Wake a parked ethread if the active ones have more queued work than
+     * the threshold allows for */
+    int parked = __atomic_load_n(&nparked, __ATOMIC_SEQ_CST);
+    if (parked && queued > 0 && queued > park_wake_threshold * (park_nethreads - parked)) {
+        __atomic_add_fetch(&park->futex, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&park->wake, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Kept for callers in sgx-lkl-musl that used to account their enqueues
+ * separately. __scheduler_enqueue already does, counting them again would
+ * keep the queue length from ever reaching zero. */
 void __schedqueue_inc() {
-    a_inc(&schedqueuelen);
+}
+
+/*
+ * Lets idle ethreads park on a host futex instead of periodically sleeping.
+ * At least min_active of the nethreads ethreads stay active to serve host call
+ * completions, timers and futex timeouts. Parked ethreads are woken once
+ * more than wake_threshold lthreads per active ethread are queued.
+ */
+void lthread_park_enable(ethread_park_t *park_, size_t nethreads, size_t min_active, size_t wake_threshold) {
+    park_nethreads = nethreads;
+    park_min_active = min_active ? min_active : 1;
+    park_wake_threshold = wake_threshold;
+    if (park_min_active < park_nethreads)
+        park = park_;
+}
+
+/* Parks the calling ethread until woken. Returns 0 without parking if the
+ * minimum number of active ethreads has been reached. */
+static int _lthread_park(const struct lthread_sched *sched) {
+    /* Completions of host calls on the dedicated rings can only be picked up
+     * by this ethread */
+    if (sched->ring_inflight)
+        return 0;
+
+    int parked = __atomic_load_n(&nparked, __ATOMIC_SEQ_CST);
+    do {
+        if (park_nethreads - parked <= park_min_active)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&nparked, &parked, parked + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+    /* Work queued after this point bumps the futex value, so that either
+     * the check below sees it or the wait returns immediately */
+    int val = __atomic_load_n(&park->futex, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&schedqueuelen, __ATOMIC_SEQ_CST) <= 0) {
+#ifndef SGXLKL_HW
+        uint64_t park_tsc = exit_prof_sim_begin();
+        lthread_scall(SYS_futex, (long)&park->futex, FUTEX_WAIT, val, 0L);
+        exit_prof_sim_end(SGXLKL_EXIT_PARK, 0, park_tsc);
+#else
+        leave_enclave(SGXLKL_EXIT_PARK, val);
+#endif
+    }
+
+    __atomic_sub_fetch(&nparked, 1, __ATOMIC_SEQ_CST);
+    return 1;
 }
 
 void lthread_sched_global_init(size_t sleepspins_, size_t sleeptime_ns_, size_t futex_wake_spins_) {
         sleepspins = sleepspins_;
         sleeptime_ns = sleeptime_ns_;
         futex_wake_spins = futex_wake_spins_;
+        newmpmcq(&__scheduler_queue_prio, SCHEDQUEUE_PRIO_SIZE * sizeof(struct cell_t), 0);
         RB_INIT(&_lthread_sleeping);
 }
 
+/* Dequeues the next runnable lthread. Kernel class lthreads take precedence
+ * unless *burst of them have been scheduled in a row. */
+static int _lthread_sched_dequeue(struct lthread **lt, int *burst) {
+    if (*burst < LTHREAD_PRIO_BURST && mpmc_dequeue(&__scheduler_queue_prio, (void **)lt)) {
+        (*burst)++;
+        return 1;
+    }
+    if (mpmc_dequeue(&__scheduler_queue, (void **)lt)) {
+        *burst = 0;
+        return 1;
+    }
+    return mpmc_dequeue(&__scheduler_queue_prio, (void **)lt);
+}
+
 void lthread_run(void) {
-    const struct lthread_sched *const sched = lthread_get_sched();
+    struct lthread_sched *const sched = lthread_get_sched();
     struct lthread *lt = NULL;
     size_t s, pauses = sleepspins;
     struct timespec sleeptime = {0, sleeptime_ns};
     int spins = futex_wake_spins;
+    int prio_burst = 0;
     int dequeued;
     size_t i;
     struct mpmcq *retq = __return_queue;
@@ -205,18 +306,24 @@ void lthread_run(void) {
     if (sched == NULL) {
         return;
     }
+    struct spscq *retring = sched->return_ring;
     for (;;) {
         /* start by checking if a sleeping thread needs to wakeup */
         do {
             dequeued = 0;
-            if (mpmc_dequeue(retq, (void *)&s)) {
+            if (retring && spsc_dequeue(retring, (void *)&s)) {
+                sched->ring_inflight--;
+                dequeued++;
+            } else if (mpmc_dequeue(retq, (void *)&s)) {
                 dequeued++;
+            }
+            if (dequeued) {
                 lt = slottolthread(s);
                 pauses = sleepspins;
                 SGXLKL_TRACE_THREAD("[tid=%-3d] lthread_run() lthread_resume (wakeup sleeping thread) \n", lt->tid);
                 _lthread_resume(lt);
             }
-            if (mpmc_dequeue(&__scheduler_queue, (void **)&lt)) {
+            if (_lthread_sched_dequeue(&lt, &prio_burst)) {
                 dequeued++;
                 pauses = sleepspins;
                 a_dec(&schedqueuelen);
@@ -235,8 +342,12 @@ void lthread_run(void) {
         if (pauses == 0) {
             pauses = sleepspins;
             spins = 0;
+            if (park && _lthread_park(sched))
+                continue;
 #ifndef SGXLKL_HW
-            lthread_scall(SYS_nanosleep, (long)&sleeptime, (long)NULL, 0L);
+            uint64_t sleep_tsc = exit_prof_sim_begin();
+            lthread_scall(SYS_nanosleep, (long)&sleeptime, (long)NULL, 0L, 0L);
+            exit_prof_sim_end(SGXLKL_EXIT_SLEEP, sleeptime_ns, sleep_tsc);
 #else
             leave_enclave(SGXLKL_EXIT_SLEEP, sleeptime_ns);
 #endif
@@ -250,7 +361,7 @@ void lthread_run(void) {
  * sleeping or not.
  */
 void _lthread_desched_sleep(struct lthread *lt) {
-    ticket_lock(&sleeplock);
+    hybrid_lock(&sleeplock);
     SGXLKL_TRACE_THREAD("[tid=%-3d] _lthread_desched_sleep() TICKET_LOCK lock=SLEEPLOCK tid=%d \n", (lthread_self() ? lthread_self()->tid : 0), lt->tid);
     if (lt->attr.state & BIT(LT_ST_SLEEPING)) {
         RB_REMOVE(lthread_rb_sleep, &_lthread_sleeping, lt);
@@ -260,7 +371,7 @@ void _lthread_desched_sleep(struct lthread *lt) {
         nsleepers--;
     }
 
-   ticket_unlock(&sleeplock);
+   hybrid_unlock(&sleeplock);
 
    SGXLKL_TRACE_THREAD("[tid=%-3d] _lthread_desched_sleep() TICKET_UNLOCK lock=SLEEPLOCK tid=%d\n", (lthread_self() ? lthread_self()->tid : 0), lt->tid);
 }
@@ -278,7 +389,7 @@ static void _lthread_resume_expired(struct timespec *now) {
         return;
     }
 
-    ticket_lock(&sleeplock);
+    hybrid_lock(&sleeplock);
 
     SGXLKL_TRACE_THREAD("[tid=%-3d] _lthread_resume_expired() TICKET_LOCK lock=SLEEPLOCK tid=NULL\n", (lthread_self() ? lthread_self()->tid : 0));
 
@@ -297,7 +408,7 @@ static void _lthread_resume_expired(struct timespec *now) {
         }
         break;
     }
-    ticket_unlock(&sleeplock);
+    hybrid_unlock(&sleeplock);
 
     SGXLKL_TRACE_THREAD("[tid=%-3d] _lthread_resume_expired() TICKET_UNLOCK lock=SLEEPLOCK tid=NULL\n", (lthread_self() ? lthread_self()->tid : 0));
 }
@@ -361,6 +472,13 @@ void _lthread_free(struct lthread *lt) {
         lt->attr.stack = NULL;
     }
     freeslot(lt->syscall);
+    if (lt->stats) {
+        ticket_lock(&statslock);
+        SLIST_REMOVE(&lthread_stats_list, lt->stats, lthread_stats, entries);
+        nstats--;
+        ticket_unlock(&statslock);
+        free(lt->stats);
+    }
     memset(lt, 0, sizeof(*lt));
     if (a_fetch_add(&libc.threads_minus_1, -1) == 0) {
         libc.threads_minus_1 = 0;
@@ -456,8 +574,14 @@ int _lthread_resume(struct lthread *lt) {
     sched->current_syscallslot = lt->syscall;
     sched->current_arena = &lt->syscallarena;
 
+    uint64_t start_ns = lt->stats ? lthread_stats_now() : 0;
+
     set_tls_tp(lt);
     _switch(&lt->ctx, &sched->ctx);
+    if (lt->stats) {
+        lt->stats->run_ns += lthread_stats_now() - start_ns;
+        lt->stats->resumes++;
+    }
     sched->current_arena = &sched->arena;
     sched->current_syscallslot = sched->syscall;
     sched->current_lthread = NULL;
@@ -521,6 +645,12 @@ int _lthread_sched_init(size_t stack_size) {
     arena_new(&c->sched.arena, 4096);
     c->sched.current_arena = &c->sched.arena;
 
+#ifndef SGXLKL_HW
+    c->sched.exit_prof_ring = exit_prof_sim_claim_ring();
+#endif
+
+    hostcall_rings_claim(&c->sched.syscall_ring, &c->sched.return_ring);
+
     c->sched.stack_size = sched_stack_size;
     c->sched.page_size = sysconf(_SC_PAGESIZE);
 
@@ -560,7 +690,7 @@ int lthread_create(struct lthread **new_lt, struct lthread_attr *attrp, void *fu
     }
     lt->attr.stack = attrp ? attrp->stack : 0;
     if ((!lt->attr.stack)&&((lt->attr.stack = mmap(0, stack_size, PROT_READ|PROT_WRITE,
-                                                  MAP_ANONYMOUS|MAP_PRIVATE,
+                                                  MAP_ANONYMOUS|MAP_PRIVATE|MAP_STACK,
                                                    -1, 0)) == MAP_FAILED)) {
         free(lt);
         return (errno);
@@ -582,15 +712,28 @@ int lthread_create(struct lthread **new_lt, struct lthread_attr *attrp, void *fu
     }
 
     lt->attr.state = BIT(LT_ST_NEW) | (attrp ? attrp->state : 0);
+    /* The floating-point control state is callee-saved and inherited from
+     * the creating thread, as with pthread_create */
+    __asm__ volatile("stmxcsr %0\n\tfnstcw %1" : "=m"(lt->ctx.mxcsr), "=m"(lt->ctx.fpucw));
     lt->tid = a_fetch_add(&spawned_lthreads, 1);
     lt->fun = fun;
     lt->arg = arg;
+    /* Threads spawned by LKL kernel threads are kernel threads themselves */
+    lt->prio = lthread_self() ? lthread_self()->prio : LTHREAD_PRIO_NORMAL;
     arena_new(&lt->syscallarena, 4096);
     lt->locale = &libc.global_locale;
     LIST_INIT(&lt->tls);
     lt->syscall = allocslot(lt);
     lt->robust_list.head = &lt->robust_list.head;
 
+    if (stats_enabled && (lt->stats = calloc(1, sizeof(*lt->stats)))) {
+        lt->stats->lt = lt;
+        ticket_lock(&statslock);
+        SLIST_INSERT_HEAD(&lthread_stats_list, lt->stats, entries);
+        nstats++;
+        ticket_unlock(&statslock);
+    }
+
     // Inherit name from parent
     if (lthread_self() && lthread_self()->funcname) {
         lthread_set_funcname(lt, lthread_self()->funcname);
@@ -715,6 +858,57 @@ void lthread_set_funcname(struct lthread *lt, const char *f) {
     lt->funcname[64-1] = 0;
 }
 
+void lthread_set_prio(struct lthread *lt, int prio) {
+    lt->prio = prio;
+}
+
+void lthread_stats_enable(void) {
+    stats_enabled = 1;
+}
+
+int lthread_stats_enabled(void) {
+    return stats_enabled;
+}
+
+/*
+ * Takes a snapshot of the statistics of all live lthreads that have been
+ * created after statistics were enabled. On success, *entries points to an
+ * array of *n entries that must be freed by the caller.
+ *
+ * The array is allocated without holding statslock as malloc might perform a
+ * futex call and yield.
+ */
+int lthread_stats_collect(struct lthread_stats_entry **entries, size_t *n) {
+    struct lthread_stats_entry *buf;
+    struct lthread_stats *st;
+    size_t cap, i;
+
+    for (;;) {
+        cap = __atomic_load_n(&nstats, __ATOMIC_SEQ_CST) + 16;
+        if (!(buf = malloc(cap * sizeof(*buf))))
+            return -ENOMEM;
+
+        ticket_lock(&statslock);
+        if (nstats <= cap)
+            break;
+        ticket_unlock(&statslock);
+        free(buf);
+    }
+
+    i = 0;
+    SLIST_FOREACH(st, &lthread_stats_list, entries) {
+        buf[i].tid = st->lt->tid;
+        memcpy(buf[i].funcname, st->lt->funcname, sizeof(buf[i].funcname));
+        buf[i].stats = *st;
+        i++;
+    }
+    ticket_unlock(&statslock);
+
+    *entries = buf;
+    *n = i;
+    return 0;
+}
+
 uint64_t lthread_id(void) {
     struct lthread_sched *sched = lthread_get_sched();
     if (sched->current_lthread) {
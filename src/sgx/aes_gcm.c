@@ -0,0 +1,198 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#include <string.h>
+
+#include "aes_gcm.h"
+
+typedef aes_gcm_block_t block_t;
+typedef unsigned int block32_t __attribute__((vector_size(16)));
+
+/* The instructions are emitted directly as the enclave is built without the
+ * compiler's intrinsics headers. */
+
+#define AESENC(x, k)     __asm__("aesenc %1, %0" : "+x"(x) : "x"(k))
+#define AESENCLAST(x, k) __asm__("aesenclast %1, %0" : "+x"(x) : "x"(k))
+
+#define CLMUL(a, b, imm) ({ block_t _r = (a); \
+        __asm__("pclmulqdq %2, %1, %0" : "+x"(_r) : "x"(b), "i"(imm)); _r; })
+#define SLLDQ(a, n) ({ block_t _r = (a); __asm__("pslldq %1, %0" : "+x"(_r) : "i"(n)); _r; })
+#define SRLDQ(a, n) ({ block_t _r = (a); __asm__("psrldq %1, %0" : "+x"(_r) : "i"(n)); _r; })
+#define SLL32(a, n) ((block_t) ((block32_t) (a) << (n)))
+#define SRL32(a, n) ((block_t) ((block32_t) (a) >> (n)))
+
+#define KEYGEN(k, rcon) ({ block_t _r; \
+        __asm__("aeskeygenassist %2, %1, %0" : "=x"(_r) : "x"(k), "i"(rcon)); _r; })
+
+static inline block_t load(const void *p) {
+    block_t b;
+    memcpy(&b, p, sizeof(b));
+    return b;
+}
+
+static inline void store(void *p, block_t b) {
+    memcpy(p, &b, sizeof(b));
+}
+
+static inline block_t bswap(block_t x) {
+    const block_t mask = { 0x08090a0b0c0d0e0fLL, 0x0001020304050607LL };
+    __asm__("pshufb %1, %0" : "+x"(x) : "x"(mask));
+    return x;
+}
+
+static inline block_t expand_step(block_t key, block_t kg) {
+    __asm__("pshufd $0xff, %0, %0" : "+x"(kg));
+    key ^= SLLDQ(key, 4);
+    key ^= SLLDQ(key, 4);
+    key ^= SLLDQ(key, 4);
+    return key ^ kg;
+}
+
+static inline block_t aes_encrypt(const struct aes_gcm_ctx *ctx, block_t x) {
+    x ^= ctx->rk[0];
+    for (int i = 1; i < 10; i++)
+        AESENC(x, ctx->rk[i]);
+    AESENCLAST(x, ctx->rk[10]);
+    return x;
+}
+
+/* Encrypts four blocks at once to hide the latency of AESENC */
+static inline void aes_encrypt4(const struct aes_gcm_ctx *ctx, block_t x[4]) {
+    block_t a = x[0] ^ ctx->rk[0], b = x[1] ^ ctx->rk[0];
+    block_t c = x[2] ^ ctx->rk[0], d = x[3] ^ ctx->rk[0];
+    for (int i = 1; i < 10; i++) {
+        AESENC(a, ctx->rk[i]);
+        AESENC(b, ctx->rk[i]);
+        AESENC(c, ctx->rk[i]);
+        AESENC(d, ctx->rk[i]);
+    }
+    AESENCLAST(a, ctx->rk[10]);
+    AESENCLAST(b, ctx->rk[10]);
+    AESENCLAST(c, ctx->rk[10]);
+    AESENCLAST(d, ctx->rk[10]);
+    x[0] = a; x[1] = b; x[2] = c; x[3] = d;
+}
+
+/* Multiplication in GF(2^128) of byte-reflected operands (Intel carry-less
+ * multiplication white paper, algorithm 5) */
+static block_t gfmul(block_t a, block_t b) {
+    block_t t3 = CLMUL(a, b, 0x00);
+    block_t t4 = CLMUL(a, b, 0x10);
+    block_t t5 = CLMUL(a, b, 0x01);
+    block_t t6 = CLMUL(a, b, 0x11);
+    block_t t7, t8, t9, t2;
+
+    t4 ^= t5;
+    t5 = SLLDQ(t4, 8);
+    t4 = SRLDQ(t4, 8);
+    t3 ^= t5;
+    t6 ^= t4;
+
+    /* Shift the 256-bit product left by one bit */
+    t7 = SRL32(t3, 31);
+    t8 = SRL32(t6, 31);
+    t3 = SLL32(t3, 1);
+    t6 = SLL32(t6, 1);
+    t9 = SRLDQ(t7, 12);
+    t8 = SLLDQ(t8, 4);
+    t7 = SLLDQ(t7, 4);
+    t3 |= t7;
+    t6 |= t8;
+    t6 |= t9;
+
+    /* Reduce modulo x^128 + x^7 + x^2 + x + 1 */
+    t7 = SLL32(t3, 31) ^ SLL32(t3, 30) ^ SLL32(t3, 25);
+    t8 = SRLDQ(t7, 4);
+    t7 = SLLDQ(t7, 12);
+    t3 ^= t7;
+    t2 = SRL32(t3, 1) ^ SRL32(t3, 2) ^ SRL32(t3, 7) ^ t8;
+    t3 ^= t2;
+    return t6 ^ t3;
+}
+
+void aes_gcm_init(struct aes_gcm_ctx *ctx, const uint8_t key[AES_GCM_KEY_SIZE]) {
+    block_t *rk = ctx->rk;
+    rk[0] = load(key);
+    rk[1] = expand_step(rk[0], KEYGEN(rk[0], 0x01));
+    rk[2] = expand_step(rk[1], KEYGEN(rk[1], 0x02));
+    rk[3] = expand_step(rk[2], KEYGEN(rk[2], 0x04));
+    rk[4] = expand_step(rk[3], KEYGEN(rk[3], 0x08));
+    rk[5] = expand_step(rk[4], KEYGEN(rk[4], 0x10));
+    rk[6] = expand_step(rk[5], KEYGEN(rk[5], 0x20));
+    rk[7] = expand_step(rk[6], KEYGEN(rk[6], 0x40));
+    rk[8] = expand_step(rk[7], KEYGEN(rk[7], 0x80));
+    rk[9] = expand_step(rk[8], KEYGEN(rk[8], 0x1b));
+    rk[10] = expand_step(rk[9], KEYGEN(rk[9], 0x36));
+
+    ctx->h = bswap(aes_encrypt(ctx, (block_t) { 0, 0 }));
+}
+
+static inline block_t counter_block(const uint8_t iv[AES_GCM_IV_SIZE], uint32_t ctr) {
+    uint8_t b[16];
+    memcpy(b, iv, AES_GCM_IV_SIZE);
+    b[12] = ctr >> 24;
+    b[13] = ctr >> 16;
+    b[14] = ctr >> 8;
+    b[15] = ctr;
+    return load(b);
+}
+
+/* Encrypts or decrypts len bytes in CTR mode and authenticates the ciphertext.
+ * Every ciphertext block is loaded exactly once and the same value is used for
+ * both hashing and decryption. */
+static block_t gcm_crypt(const struct aes_gcm_ctx *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                         const uint8_t *in, uint8_t *out, size_t len, int encrypt) {
+    block_t x = { 0, 0 }, ks[4], c;
+    uint32_t ctr = 2;
+    size_t off = 0;
+
+    for (; off + 64 <= len; off += 64) {
+        for (int j = 0; j < 4; j++)
+            ks[j] = counter_block(iv, ctr++);
+        aes_encrypt4(ctx, ks);
+        for (int j = 0; j < 4; j++) {
+            c = load(in + off + 16 * j);
+            if (encrypt)
+                c ^= ks[j];
+            x = gfmul(x ^ bswap(c), ctx->h);
+            store(out + off + 16 * j, encrypt ? c : c ^ ks[j]);
+        }
+    }
+
+    for (; off < len; off += 16) {
+        size_t n = len - off < 16 ? len - off : 16;
+        uint8_t b[16] = { 0 }, k[16];
+        memcpy(b, in + off, n);
+        store(k, aes_encrypt(ctx, counter_block(iv, ctr++)));
+        if (encrypt) {
+            for (size_t i = 0; i < n; i++)
+                b[i] ^= k[i];
+            memcpy(out + off, b, n);
+        } else {
+            for (size_t i = 0; i < n; i++)
+                out[off + i] = b[i] ^ k[i];
+        }
+        /* Hash the zero-padded ciphertext */
+        x = gfmul(x ^ bswap(load(b)), ctx->h);
+    }
+
+    /* Length block, no additional authenticated data */
+    x = gfmul(x ^ (block_t) { (long long) len * 8, 0 }, ctx->h);
+    return bswap(x) ^ aes_encrypt(ctx, counter_block(iv, 1));
+}
+
+void aes_gcm_encrypt(const struct aes_gcm_ctx *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                     const void *in, void *out, size_t len, uint8_t tag[AES_GCM_TAG_SIZE]) {
+    store(tag, gcm_crypt(ctx, iv, in, out, len, 1));
+}
+
+int aes_gcm_decrypt(const struct aes_gcm_ctx *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                    const void *in, void *out, size_t len, const uint8_t tag[AES_GCM_TAG_SIZE]) {
+    block_t d = gcm_crypt(ctx, iv, in, out, len, 0) ^ load(tag);
+    uint8_t b[16], diff = 0;
+    store(b, d);
+    for (int i = 0; i < 16; i++)
+        diff |= b[i];
+    return diff ? -1 : 0;
+}
@@ -87,6 +87,96 @@ static void cmd__add_peers(Sgxlkl__Control_Service *service,
     closure(&result, closure_data);
 }
 
+/* Handle thread stats request
+ *
+ * Returns per-lthread run time and host call statistics.
+ */
+static void cmd__thread_stats(Sgxlkl__Control_Service *service,
+                  const Sgxlkl__ThreadStatsRequest   *req,
+                  Sgxlkl__ThreadStatsResult_Closure  closure,
+                  void                       *closure_data) {
+    struct cmd_server_config *server_config = &srv_from_service(service)->config;
+    Sgxlkl__ThreadStatsResult result = SGXLKL__THREAD_STATS_RESULT__INIT;
+    struct lthread_stats_entry *entries = NULL;
+    size_t num_entries = 0, num_hostcalls = 0;
+    Sgxlkl__ThreadStat *threads = NULL, **thread_ptrs = NULL;
+    Sgxlkl__HostCallStat *hostcalls = NULL, **hostcall_ptrs = NULL;
+
+    // If server is configured to attest only, fail here.
+    if (server_config->attest_only) {
+        result.err = SGXLKL__ERROR__NOT_PERMITTED;
+        result.err_msg = ERR_MSG_ATTEST_ONLY;
+        closure (&result, closure_data);
+        return;
+    }
+
+    if (!lthread_stats_enabled()) {
+        result.err = SGXLKL__ERROR__STATS_DISABLED;
+        result.err_msg = "Thread statistics not enabled (SGXLKL_THREAD_STATS)";
+        closure(&result, closure_data);
+        return;
+    }
+
+    if (lthread_stats_collect(&entries, &num_entries)) {
+        result.err = SGXLKL__ERROR__INTERNAL;
+        result.err_msg = strerror(ENOMEM);
+        closure(&result, closure_data);
+        return;
+    }
+
+    for (size_t i = 0; i < num_entries; i++)
+        for (size_t j = 0; j < LTHREAD_STATS_MAX_SYSCALL; j++)
+            if (entries[i].stats.hostcalls[j])
+                num_hostcalls++;
+
+    if (!(threads = calloc(num_entries, sizeof(*threads))) ||
+        !(thread_ptrs = calloc(num_entries, sizeof(*thread_ptrs))) ||
+        !(hostcalls = calloc(num_hostcalls, sizeof(*hostcalls))) ||
+        !(hostcall_ptrs = calloc(num_hostcalls, sizeof(*hostcall_ptrs)))) {
+        result.err = SGXLKL__ERROR__INTERNAL;
+        result.err_msg = strerror(ENOMEM);
+        closure(&result, closure_data);
+        goto out;
+    }
+
+    // Host call entries of each thread are stored contiguously.
+    size_t k = 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        Sgxlkl__ThreadStat *ts = &threads[i];
+        sgxlkl__thread_stat__init(ts);
+        ts->tid = entries[i].tid;
+        ts->funcname = entries[i].funcname;
+        ts->run_ns = entries[i].stats.run_ns;
+        ts->resumes = entries[i].stats.resumes;
+        ts->hostcalls = &hostcall_ptrs[k];
+
+        for (size_t j = 0; j < LTHREAD_STATS_MAX_SYSCALL; j++) {
+            if (!entries[i].stats.hostcalls[j])
+                continue;
+            Sgxlkl__HostCallStat *hc = &hostcalls[k];
+            sgxlkl__host_call_stat__init(hc);
+            hc->syscallno = j;
+            hc->count = entries[i].stats.hostcalls[j];
+            hc->wait_ns = entries[i].stats.hostcall_ns[j];
+            hostcall_ptrs[k++] = hc;
+            ts->n_hostcalls++;
+        }
+        thread_ptrs[i] = ts;
+    }
+
+    result.err = SGXLKL__ERROR__SUCCESS;
+    result.n_threads = num_entries;
+    result.threads = thread_ptrs;
+    closure(&result, closure_data);
+
+out:
+    free(hostcall_ptrs);
+    free(hostcalls);
+    free(thread_ptrs);
+    free(threads);
+    free(entries);
+}
+
 /* Handle attest request
  *
  * Return quote and IAS attestation report if available
@@ -14,21 +14,27 @@
 
 #include "bitops.h"
 #include "enclave_mem.h"
+#include "enclave_pager.h"
 #include "sgx_hostcalls.h"
 #include "sgxlkl_debug.h"
 #include "sgxlkl_util.h"
-#include "ticketlock.h"
+#include "hybridlock.h"
 
-static struct ticketlock mmaplock;
+static struct hybridlock mmaplock = HYBRIDLOCK_INITIALIZER("mmaplock");
 
 static void* mmap_bitmap;
+static void* mmap_clean;    // Unmapped pages that are known to be zero-filled.
+static void* mmap_released; // Mapped pages that have been released via madvise.
+static void* mmap_anon;     // Mapped pages that belong to anonymous mappings.
+static void* mmap_writable; // Mapped pages that are currently writable.
 static void* mmap_base; // First page that can be mmap'ed.
 static void* mmap_end;  // Last page that can be mmap'ed.
 static size_t mmap_num_pages; // Total number of pages that can be mmap'ed.
 
 static int mmap_files; // Allow MAP_PRIVATE or MAP_SHARED?
+static size_t mmap_huge_pages; // Pages per huge page if large mappings are aligned, 0 otherwise.
 
-static size_t used_pages = 0; // Tracks the number of used pages for the mmap tracing.
+static size_t used_pages = 0; // Tracks the number of mapped pages that have not been released.
 
 #if DEBUG
 extern int sgxlkl_trace_mmap;
@@ -37,6 +43,10 @@ static size_t mmap_max_allocated = 0; // Maximum amount of memory used thus far.
 
 #define DIV_ROUNDUP(x, y)   (((x)+((y)-1))/(y))
 
+#ifndef MADV_FREE
+#define MADV_FREE 8
+#endif
+
 #define for_each_set_bit_in_region(bit, addr, size, start)   \
         for ((bit) = find_next_bit((addr), (size), (start)); \
              (bit) < (start + nr);                           \
@@ -54,13 +64,20 @@ static inline unsigned long bitmap_count_set_bits(unsigned long *map,
     return (retval);
 }
 
-static inline unsigned long bitmap_find_next_zero_area(unsigned long *map,
+/*
+ * Finds a zero area of nr bits such that index + align_offset is a multiple of
+ * align_mask + 1.
+ */
+static inline unsigned long bitmap_find_next_zero_area_off(unsigned long *map,
                                          unsigned long size,
                                          unsigned long start,
-                                         unsigned long nr) {
+                                         unsigned long nr,
+                                         unsigned long align_mask,
+                                         unsigned long align_offset) {
     unsigned long index, end, i;
     for (;;) {
         index = find_next_zero_bit(map, size, start);
+        index = ((index + align_offset + align_mask) & ~align_mask) - align_offset;
 
         end = index + nr;
         if (end > size) {
@@ -75,8 +92,17 @@ static inline unsigned long bitmap_find_next_zero_area(unsigned long *map,
     }
 }
 
+static inline unsigned long bitmap_find_next_zero_area(unsigned long *map,
+                                         unsigned long size,
+                                         unsigned long start,
+                                         unsigned long nr) {
+    return bitmap_find_next_zero_area_off(map, size, start, nr, 0, 0);
+}
+
 static int in_mmap_range(void* addr, size_t size) {
-    return addr >= mmap_base && ((char *)addr + size) <= (char *)mmap_end;
+    // mmap_end is the last page, not the end of the range.
+    char *end = (char *)mmap_end + PAGE_SIZE;
+    return addr >= mmap_base && (char *)addr < end && size <= (size_t)(end - (char *)addr);
 }
 
 static void* index_to_addr(size_t index) {
@@ -87,6 +113,28 @@ static size_t addr_to_index(void* addr) {
     return ((char *)mmap_end - (char *)addr) / PAGE_SIZE;
 }
 
+static inline int mmap_test_bit(void *map, size_t index) {
+    return (((unsigned long *)map)[BIT_WORD(index)] >> (index % BITS_PER_LONG)) & 1;
+}
+
+/*
+ * Sets or clears the bits of the pages of a range in one of the bitmaps that
+ * track the kind and protection of mappings.
+ */
+static void mmap_mark(void *map, void* addr, size_t length, int set) {
+    size_t pages = DIV_ROUNDUP(length, PAGE_SIZE);
+    size_t index_top = addr_to_index(addr) - (pages - 1);
+    hybrid_lock(&mmaplock);
+    if (set)
+        bitmap_set(map, index_top, pages);
+    else
+        bitmap_clear(map, index_top, pages);
+    hybrid_unlock(&mmaplock);
+}
+
+static void* mmap_alloc(void* addr, size_t length, int mmap_fixed, int *zeroed);
+static int mmap_release(void* addr, size_t length, int advice);
+
 void *syscall_SYS_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
     void *mem;
     if ((flags & MAP_SHARED) && (flags & MAP_PRIVATE)) {
@@ -94,19 +142,28 @@ void *syscall_SYS_mmap(void *addr, size_t length, int prot, int flags, int fd, o
         mem = MAP_FAILED;
     // Anonymous mapping/allocation
     } else if (fd == -1 && (flags & MAP_ANONYMOUS)) {
-        mem = enclave_mmap(addr, length, flags & MAP_FIXED);
+        int zeroed;
+        mem = mmap_alloc(addr, length, flags & MAP_FIXED, &zeroed);
         if (mem == MAP_FAILED) {
             return mem;
         }
-        // Zero out memory, make sure memory is writeable
+        // Drop evicted contents of a replaced mapping
+        enclave_pager_unmap(mem, length);
+        // Zero out memory unless it has not been used since it was returned
+        // to the host, make sure memory is writeable
         mprotect(mem, length, prot | PROT_WRITE);
-        memset(mem, 0, length);
+        if (!zeroed)
+            memset(mem, 0, length);
         // Set requested permissions
         mprotect(mem, length , prot);
+        mmap_mark(mmap_anon, mem, length, 1);
+        mmap_mark(mmap_writable, mem, length, prot & PROT_WRITE);
+        enclave_pager_map(mem, length, prot, flags);
     // File-backed mapping (if allowed)
     } else if (fd >= 0 && enclave_mmap_flags_supported(flags, fd)) {
         mem = enclave_mmap(addr, length, flags & MAP_FIXED);
         if (mem > 0) {
+            enclave_pager_unmap(mem, length);
             // Make memory writeable
             mprotect(mem, length, prot | PROT_WRITE);
             // Read file into memory
@@ -147,6 +204,29 @@ int syscall_SYS_munmap(void *addr, size_t length) {
     }
 }
 
+int syscall_SYS_mprotect(void *addr, size_t length, int prot) {
+    if (in_mmap_range(addr, 0)) {
+        // Evicted chunks are paged in first, memory that is not read/write is
+        // never paged
+        enclave_pager_protect(addr, length, prot);
+        if (length && in_mmap_range(addr, length))
+            mmap_mark(mmap_writable, addr, length, prot & PROT_WRITE);
+    }
+    return host_syscall_SYS_mprotect(addr, length, prot);
+}
+
+int syscall_SYS_madvise(void *addr, size_t length, int advice) {
+    if ((uintptr_t) addr % PAGE_SIZE != 0) {
+        return -EINVAL;
+    }
+    if (in_mmap_range(addr, 0)) {
+        if (advice == MADV_DONTNEED || advice == MADV_FREE)
+            return mmap_release(addr, length, advice);
+        return enclave_pager_advise(addr, length, advice);
+    }
+    return 0;
+}
+
 int syscall_SYS_msync(void *addr, size_t length, int flags) {
     if (!in_mmap_range(addr, 0)) {
         return host_syscall_SYS_msync(addr, length, flags);
@@ -178,8 +258,10 @@ int syscall_SYS_sysinfo(struct sysinfo *info) {
  * enumber of pages starting at the base address to manage.
  *
  * A bitmap is used to keep track of mapped/unmapped pages in the range of base
- * to base + num_pages*PAGE_SIZE. The bitmap occupies the first few pages of
- * enclave memory.
+ * to base + num_pages*PAGE_SIZE. Further bitmaps of the same size track
+ * unmapped pages that are known to be zero-filled, mapped pages that have
+ * been released via madvise, and mapped pages that are anonymous or writable.
+ * The bitmaps occupy the first few pages of enclave memory.
  */
 void enclave_mman_init(void* base, size_t num_pages, int _mmap_files) {
     // Don't use page at address 0x0.
@@ -188,20 +270,49 @@ void enclave_mman_init(void* base, size_t num_pages, int _mmap_files) {
         num_pages = num_pages - 1;
     }
 
-    // Determine required size (in pages) for the bitmap.
+    // Determine required size (in pages) for each bitmap.
     size_t bitmap_req_pages = DIV_ROUNDUP(num_pages, BITS_PER_BYTE * PAGE_SIZE);
-    mmap_num_pages = num_pages - bitmap_req_pages;
-    // Bitmap is stored at the beginning of the enclave memory range.
+    mmap_num_pages = num_pages - 5 * bitmap_req_pages;
+    // Bitmaps are stored at the beginning of the enclave memory range.
     mmap_bitmap = base;
+    mmap_clean = (char *)mmap_bitmap + (bitmap_req_pages * PAGE_SIZE);
+    mmap_released = (char *)mmap_clean + (bitmap_req_pages * PAGE_SIZE);
+    mmap_anon = (char *)mmap_released + (bitmap_req_pages * PAGE_SIZE);
+    mmap_writable = (char *)mmap_anon + (bitmap_req_pages * PAGE_SIZE);
     // Base address for range of pages available to mmap calls.
-    mmap_base = (char *)mmap_bitmap + (bitmap_req_pages * PAGE_SIZE);
+    mmap_base = (char *)mmap_writable + (bitmap_req_pages * PAGE_SIZE);
     mmap_end = (char *)mmap_base + (mmap_num_pages - 1) * PAGE_SIZE;
-    // Initialize bitmap
+    // Initialize bitmaps
     bitmap_clear(mmap_bitmap, 0, mmap_num_pages);
+    bitmap_clear(mmap_released, 0, mmap_num_pages);
+    bitmap_clear(mmap_anon, 0, mmap_num_pages);
+    bitmap_clear(mmap_writable, 0, mmap_num_pages);
+#ifdef SGXLKL_HW
+    bitmap_clear(mmap_clean, 0, mmap_num_pages);
+#else
+    // The heap is freshly mapped by the host
+    bitmap_set(mmap_clean, 0, mmap_num_pages);
+#endif /* SGXLKL_HW */
 
     mmap_files = _mmap_files;
 }
 
+/*
+ * Aligns mappings of at least HUGE_PAGE_SIZE bytes to huge page boundaries so
+ * that they can be backed by huge pages in simulation mode.
+ */
+void enclave_mman_huge_pages(void) {
+    mmap_huge_pages = HUGE_PAGE_SIZE / PAGE_SIZE;
+}
+
+/*
+ * Returns the range of enclave memory available to mmap calls.
+ */
+void enclave_mman_range(void **base, void **end) {
+    *base = mmap_base;
+    *end = (char *)mmap_end + PAGE_SIZE;
+}
+
 /*
  * Returns 1 if syscall_SYS_mmap can be called with the specified flags,
  * returns 0 otherwise.
@@ -223,9 +334,18 @@ int enclave_mmap_flags_supported(int flags, int fd) {
  * mmap for enclave memory range.
  */
 void* enclave_mmap(void* addr, size_t length, int mmap_fixed) {
+    return mmap_alloc(addr, length, mmap_fixed, NULL);
+}
+
+/*
+ * Allocates a range of pages. If zeroed is not NULL, it is set to 1 if all
+ * pages of the range are known to be zero-filled, 0 otherwise.
+ */
+static void* mmap_alloc(void* addr, size_t length, int mmap_fixed, int *zeroed) {
     void* ret = 0;
     size_t pages = DIV_ROUNDUP(length, PAGE_SIZE);
     size_t replaced_pages = 0;
+    size_t index_top;
 
     // Make sure addr is page aligned and size is greater than 0.
     if((uintptr_t) addr % PAGE_SIZE != 0 || length == 0) {
@@ -233,26 +353,25 @@ void* enclave_mmap(void* addr, size_t length, int mmap_fixed) {
         return MAP_FAILED;
     }
 
-    ticket_lock(&mmaplock);
+    hybrid_lock(&mmaplock);
     if(mmap_fixed) {
         if(!in_mmap_range(addr, length)) {
             errno = ENOMEM;
             ret = MAP_FAILED;
         } else {
             // Get index for last page since the bitmap is used in reverse.
-            size_t index_top = addr_to_index(addr) - (pages - 1);
+            index_top = addr_to_index(addr) - (pages - 1);
 
-#if DEBUG
-            if(sgxlkl_trace_mmap)
-                replaced_pages = bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages);
-#endif /* DEBUG */
+            // Released pages of replaced mappings are not counted as used.
+            replaced_pages = bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages);
+            replaced_pages -= bitmap_count_set_bits(mmap_released, mmap_num_pages, index_top, pages);
 
             bitmap_set(mmap_bitmap, index_top, pages);
             ret = addr;
         }
     } else if(addr != 0 && in_mmap_range(addr, length)) {
         // Get index for last page since the bitmap is used in reverse.
-        size_t index_top = addr_to_index(addr) - (pages - 1);
+        index_top = addr_to_index(addr) - (pages - 1);
         // Address provided as a hint, check if range is available.
         if(!bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages)) {
             bitmap_set(mmap_bitmap, index_top, pages);
@@ -262,7 +381,16 @@ void* enclave_mmap(void* addr, size_t length, int mmap_fixed) {
 
     // Find next area with enough space.
     if(ret == 0) {
-        size_t index_top = bitmap_find_next_zero_area(mmap_bitmap, mmap_num_pages, 0, pages);
+        if (mmap_huge_pages && pages >= mmap_huge_pages) {
+            // The bitmap is used in reverse, align the start address
+            // mmap_end + PAGE_SIZE - (index_top + pages) * PAGE_SIZE.
+            size_t end_index = ((uintptr_t) mmap_end + PAGE_SIZE) / PAGE_SIZE;
+            size_t align_mask = mmap_huge_pages - 1;
+            index_top = bitmap_find_next_zero_area_off(mmap_bitmap, mmap_num_pages, 0, pages,
+                                                       align_mask, (pages - end_index) & align_mask);
+        } else {
+            index_top = bitmap_find_next_zero_area(mmap_bitmap, mmap_num_pages, 0, pages);
+        }
         if(index_top + pages  > mmap_num_pages) {
             errno = ENOMEM;
             ret = MAP_FAILED;
@@ -273,12 +401,18 @@ void* enclave_mmap(void* addr, size_t length, int mmap_fixed) {
         }
     }
 
-    ticket_unlock(&mmaplock);
-
     if (ret != MAP_FAILED) {
+        if (zeroed)
+            *zeroed = bitmap_count_set_bits(mmap_clean, mmap_num_pages, index_top, pages) == pages;
+        bitmap_clear(mmap_clean, index_top, pages);
+        bitmap_clear(mmap_released, index_top, pages);
+        bitmap_clear(mmap_anon, index_top, pages);
+        bitmap_clear(mmap_writable, index_top, pages);
         used_pages += pages - replaced_pages;
     }
 
+    hybrid_unlock(&mmaplock);
+
 #if DEBUG
     if(sgxlkl_trace_mmap) {
         size_t requested = pages * PAGESIZE;
@@ -312,14 +446,29 @@ int enclave_munmap(void* addr, size_t length) {
     size_t index = addr_to_index(addr);
     size_t index_top = index - (pages - 1);
 
-    ticket_lock(&mmaplock);
+    enclave_pager_unmap(addr, length);
+
+#ifndef SGXLKL_HW
+    // Return the pages to the host, they are zero-filled when used again.
+    int clean = !host_syscall_SYS_madvise(addr, pages * PAGE_SIZE, MADV_DONTNEED);
+#endif /* !SGXLKL_HW */
 
-    // Only count pages that have been marked as mmapped before.
+    hybrid_lock(&mmaplock);
+
+    // Only count pages that have been marked as mmapped and not released before.
     size_t occupied_pages = bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages);
+    occupied_pages -= bitmap_count_set_bits(mmap_released, mmap_num_pages, index_top, pages);
     used_pages -= occupied_pages;
 
     bitmap_clear(mmap_bitmap, index_top, pages);
-    ticket_unlock(&mmaplock);
+    bitmap_clear(mmap_released, index_top, pages);
+    bitmap_clear(mmap_anon, index_top, pages);
+    bitmap_clear(mmap_writable, index_top, pages);
+#ifndef SGXLKL_HW
+    if (clean)
+        bitmap_set(mmap_clean, index_top, pages);
+#endif /* !SGXLKL_HW */
+    hybrid_unlock(&mmaplock);
 
 #if DEBUG
     if(sgxlkl_trace_mmap) {
@@ -345,11 +494,104 @@ void* enclave_mremap(void* old_addr, size_t old_length, void* new_addr, size_t n
         return MAP_FAILED;
     }
 
-    void *mem = enclave_mmap(new_addr, new_length, 0);
+    int zeroed;
+    void *mem = mmap_alloc(new_addr, new_length, 0, &zeroed);
     if (mem != MAP_FAILED) {
-        memcpy(mem, old_addr, old_length > new_length ? new_length : old_length);
+        size_t copy_length = old_length > new_length ? new_length : old_length;
+        memcpy(mem, old_addr, copy_length);
+        if (!zeroed)
+            memset((char *)mem + copy_length, 0, new_length - copy_length);
+        // The new mapping is of the same kind as the old one.
+        size_t old_index = addr_to_index(old_addr);
+        mmap_mark(mmap_anon, mem, new_length, mmap_test_bit(mmap_anon, old_index));
+        mmap_mark(mmap_writable, mem, new_length, mmap_test_bit(mmap_writable, old_index));
         enclave_munmap(old_addr, old_length);
     }
 
     return mem;
 }
+
+/*
+ * Returns the number of consecutive pages starting at the page with the given
+ * index (and continuing towards lower indices, i.e. higher addresses) that
+ * belong to anonymous mappings and, if writable is set, are writable. At most
+ * max pages are counted.
+ */
+static size_t mmap_anon_run(size_t index, size_t max, int writable) {
+    size_t n = 0;
+    hybrid_lock(&mmaplock);
+    while (n < max && mmap_test_bit(mmap_anon, index - n) &&
+           (!writable || mmap_test_bit(mmap_writable, index - n)))
+        n++;
+    hybrid_unlock(&mmaplock);
+    return n;
+}
+
+/*
+ * Zeroes the writable anonymous pages of a range in place of returning them to
+ * the host. Other pages are left as they are: they cannot be written without
+ * faulting, and the contents of file-backed pages could only be restored by
+ * reading the file again.
+ */
+static void mmap_zero_anon(void* addr, size_t pages) {
+    size_t index = addr_to_index(addr);
+    // Page i + n, if any, is not zeroable and skipped.
+    for (size_t i = 0, n; i < pages; i += n + 1) {
+        n = mmap_anon_run(index - i, pages - i, 1);
+        if (n)
+            memset((char *)addr + i * PAGE_SIZE, 0, n * PAGE_SIZE);
+    }
+}
+
+/*
+ * Releases the pages of a mapping on madvise(MADV_DONTNEED/MADV_FREE). The
+ * mapping stays in place, but its pages are no longer counted as used. In
+ * simulation mode, anonymous pages are returned to the host. Enclave pages
+ * cannot be returned to the host, the contents of writable anonymous pages are
+ * discarded on MADV_DONTNEED.
+ */
+static int mmap_release(void* addr, size_t length, int advice) {
+    size_t pages = DIV_ROUNDUP(length, PAGE_SIZE);
+    if (length == 0)
+        return 0;
+    if (!in_mmap_range(addr, pages * PAGE_SIZE))
+        return -ENOMEM;
+
+    // Evicted chunks in the range are dropped rather than paged in.
+    enclave_pager_advise(addr, length, advice);
+
+#ifndef SGXLKL_HW
+    // Only anonymous pages are returned to the host, which zero-fills them on
+    // their next use. Emulated file-backed pages would lose their contents.
+    size_t index = addr_to_index(addr);
+    for (size_t i = 0, n; i < pages; i += n + 1) {
+        n = mmap_anon_run(index - i, pages - i, 0);
+        if (!n)
+            continue;
+        char *run = (char *)addr + i * PAGE_SIZE;
+        int returned = !host_syscall_SYS_madvise(run, n * PAGE_SIZE, advice);
+        // MADV_FREE is only supported from Linux 4.5 onwards.
+        if (!returned && advice == MADV_FREE)
+            returned = !host_syscall_SYS_madvise(run, n * PAGE_SIZE, MADV_DONTNEED);
+        // Partial hugetlbfs pages cannot be returned to the host either.
+        if (!returned && advice == MADV_DONTNEED)
+            mmap_zero_anon(run, n);
+    }
+#else
+    if (advice == MADV_DONTNEED)
+        mmap_zero_anon(addr, pages);
+#endif /* !SGXLKL_HW */
+
+    size_t index_top = addr_to_index(addr) - (pages - 1);
+    size_t nr = pages;
+    unsigned long bit;
+    hybrid_lock(&mmaplock);
+    // Only mapped pages that have not been released before are counted.
+    used_pages -= bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages);
+    used_pages += bitmap_count_set_bits(mmap_released, mmap_num_pages, index_top, pages);
+    for_each_set_bit_in_region(bit, mmap_bitmap, mmap_num_pages, index_top)
+        bitmap_set(mmap_released, bit, 1);
+    hybrid_unlock(&mmaplock);
+
+    return 0;
+}
@@ -0,0 +1,500 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+/* Enclave paging is only supported in simulation mode (see enclave_pager.h) */
+#ifndef SGXLKL_HW
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "ksigaction.h"
+#include "aes_gcm.h"
+#include "atomic.h"
+#include "enclave_mem.h"
+#include "enclave_pager.h"
+#include "sgxlkl_util.h"
+
+#ifndef MADV_COLD
+#define MADV_COLD    20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+#ifndef MADV_FREE
+#define MADV_FREE    8
+#endif
+#ifndef SA_RESTORER
+#define SA_RESTORER  0x04000000
+#endif
+
+#define PROT_RW (PROT_READ|PROT_WRITE)
+
+/* Chunk states */
+#define CHUNK_UNPAGED  0 /* Not (completely) covered by a pageable mapping */
+#define CHUNK_RESIDENT 1
+#define CHUNK_EVICTED  2
+
+struct pager_chunk {
+    uint8_t state;
+    uint8_t referenced; /* Used since the clock hand last passed the chunk */
+    uint32_t slot;      /* Swap slot of an evicted chunk */
+    uint64_t version;   /* Number of evictions, part of the IV */
+    uint8_t tag[AES_GCM_TAG_SIZE];
+};
+
+static int pager_enabled = 0;
+
+/* The pager is entered from the SIGSEGV handler and never yields while
+ * holding the lock, so that a plain spinlock is sufficient. */
+static volatile int pager_lock = 0;
+
+static char *pager_base;
+static char *pager_end;
+static size_t chunk_size;
+static size_t num_chunks;
+static struct pager_chunk *chunks;
+
+static char *swap; /* Untrusted */
+static uint32_t *free_slots;
+static size_t num_free_slots;
+
+static size_t num_resident;
+static size_t max_resident; /* 0 if unlimited */
+static size_t clock_hand;
+
+static struct aes_gcm_ctx gcm;
+
+static char *staging; /* Chunks are decrypted here and then moved into place */
+static struct k_sigaction app_sigsegv; /* SIGSEGV action of the application */
+
+static void pager_acquire(void) {
+    while (a_swap(&pager_lock, 1))
+        a_spin();
+}
+
+static void pager_release(void) {
+    a_store(&pager_lock, 0);
+}
+
+/* System calls are issued directly as the pager may run in a signal handler on
+ * any thread. */
+static long pager_scall(long n, long a1, long a2, long a3, long a4, long a5, long a6) {
+    unsigned long ret;
+    register long r10 __asm__("r10") = a4;
+    register long r8 __asm__("r8") = a5;
+    register long r9 __asm__("r9") = a6;
+    __asm__ __volatile__ ("syscall" : "=a"(ret) : "a"(n), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8), "r"(r9)
+                          : "rcx", "r11", "memory");
+    return ret;
+}
+
+static char *pager_alloc_staging(void) {
+    long ret = pager_scall(SYS_mmap, 0, chunk_size, PROT_RW, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (ret < 0 && ret > -4096)
+        sgxlkl_fail("Enclave pager: Could not allocate staging area: %ld\n", ret);
+    return (char *) ret;
+}
+
+static void chunk_protect(char *addr, int prot) {
+    long ret = pager_scall(SYS_mprotect, (long) addr, chunk_size, prot, 0, 0, 0);
+    if (ret)
+        sgxlkl_fail("Enclave pager: Could not change protection of chunk at %p: %ld\n", addr, ret);
+}
+
+static inline char *chunk_addr(size_t i) {
+    return pager_base + i * chunk_size;
+}
+
+static inline char *slot_addr(uint32_t slot) {
+    return swap + (size_t) slot * chunk_size;
+}
+
+static void chunk_iv(size_t i, uint8_t iv[AES_GCM_IV_SIZE]) {
+    uint32_t index = i;
+    memcpy(iv, &index, sizeof(index));
+    memcpy(iv + sizeof(index), &chunks[i].version, sizeof(chunks[i].version));
+}
+
+/* Seals a resident chunk into a free swap slot. Returns -1 if swap space is
+ * exhausted. */
+static int chunk_evict(size_t i) {
+    struct pager_chunk *c = &chunks[i];
+    char *addr = chunk_addr(i);
+    uint8_t iv[AES_GCM_IV_SIZE];
+
+    if (!num_free_slots)
+        return -1;
+
+    c->slot = free_slots[--num_free_slots];
+    c->version++;
+    chunk_iv(i, iv);
+
+    /* Writers fault and wait for the eviction to complete */
+    chunk_protect(addr, PROT_READ);
+    aes_gcm_encrypt(&gcm, iv, addr, slot_addr(c->slot), chunk_size, c->tag);
+    chunk_protect(addr, PROT_NONE);
+    pager_scall(SYS_madvise, (long) addr, chunk_size, MADV_DONTNEED, 0, 0, 0);
+
+    c->state = CHUNK_EVICTED;
+    num_resident--;
+    return 0;
+}
+
+/* Evicts the next chunk in clock order that has not been used since the hand
+ * last passed it. Returns -1 if no chunk could be evicted. */
+static int pager_evict_cold(void) {
+    for (size_t n = 0; n < 2 * num_chunks; n++) {
+        size_t i = clock_hand;
+        clock_hand = (clock_hand + 1) % num_chunks;
+        if (chunks[i].state != CHUNK_RESIDENT)
+            continue;
+        if (chunks[i].referenced) {
+            chunks[i].referenced = 0;
+            continue;
+        }
+        return chunk_evict(i);
+    }
+    return -1;
+}
+
+static void pager_trim(void) {
+    while (max_resident && num_resident > max_resident)
+        if (pager_evict_cold())
+            break;
+}
+
+static void chunk_page_in(size_t i) {
+    struct pager_chunk *c = &chunks[i];
+    char *addr = chunk_addr(i);
+    uint8_t iv[AES_GCM_IV_SIZE];
+
+    if (max_resident && num_resident >= max_resident)
+        pager_evict_cold();
+
+    chunk_iv(i, iv);
+    /* Replace the chunk at once so that concurrent accesses either fault or
+     * see its complete contents */
+    if (aes_gcm_decrypt(&gcm, iv, slot_addr(c->slot), staging, chunk_size, c->tag))
+        sgxlkl_fail("Enclave pager: Integrity check of chunk at %p failed.\n", addr);
+    if (pager_scall(SYS_mremap, (long) staging, chunk_size, chunk_size, MREMAP_MAYMOVE|MREMAP_FIXED, (long) addr, 0) != (long) addr)
+        sgxlkl_fail("Enclave pager: Could not map chunk at %p.\n", addr);
+    staging = pager_alloc_staging();
+
+    free_slots[num_free_slots++] = c->slot;
+    c->state = CHUNK_RESIDENT;
+    c->referenced = 1;
+    num_resident++;
+}
+
+/* Determines the chunks that overlap [addr, addr + len) or, if covered is
+ * set, only those that lie completely within the range. */
+static int chunk_range(void *addr, size_t len, int covered, size_t *first, size_t *end) {
+    uintptr_t start = (uintptr_t) addr, stop = start + len;
+    if (stop < start || stop > (uintptr_t) pager_end)
+        stop = (uintptr_t) pager_end;
+    if (start < (uintptr_t) pager_base)
+        start = (uintptr_t) pager_base;
+    if (start >= stop)
+        return 0;
+
+    start -= (uintptr_t) pager_base;
+    stop -= (uintptr_t) pager_base;
+    if (covered) {
+        *first = (start + chunk_size - 1) / chunk_size;
+        *end = stop / chunk_size;
+    } else {
+        *first = start / chunk_size;
+        *end = (stop + chunk_size - 1) / chunk_size;
+    }
+    return *first < *end;
+}
+
+void enclave_pager_map(void *addr, size_t len, int prot, int flags) {
+    size_t first, end;
+    if (!pager_enabled || prot != PROT_RW || (flags & (MAP_STACK|MAP_GROWSDOWN)))
+        return;
+    if (!chunk_range(addr, len, 1, &first, &end))
+        return;
+
+    pager_acquire();
+    for (size_t i = first; i < end; i++) {
+        if (chunks[i].state != CHUNK_UNPAGED)
+            continue;
+        chunks[i].state = CHUNK_RESIDENT;
+        chunks[i].referenced = 1;
+        num_resident++;
+    }
+    pager_trim();
+    pager_release();
+}
+
+static inline int chunk_covered(size_t i, void *addr, size_t len) {
+    return chunk_addr(i) >= (char *) addr && chunk_addr(i) + chunk_size <= (char *) addr + len;
+}
+
+/* Makes an evicted chunk accessible again without restoring its contents */
+static void chunk_drop(size_t i) {
+    free_slots[num_free_slots++] = chunks[i].slot;
+    chunk_protect(chunk_addr(i), PROT_RW);
+}
+
+/* Stops paging all chunks overlapping the range. Evicted chunks that are
+ * completely covered are dropped if discard is set, all others are paged
+ * in. */
+static void pager_unpage(void *addr, size_t len, int discard) {
+    size_t first, end;
+    if (!chunk_range(addr, len, 0, &first, &end))
+        return;
+
+    pager_acquire();
+    for (size_t i = first; i < end; i++) {
+        struct pager_chunk *c = &chunks[i];
+        if (c->state == CHUNK_EVICTED) {
+            if (discard && chunk_covered(i, addr, len)) {
+                chunk_drop(i);
+                c->state = CHUNK_UNPAGED;
+                continue;
+            }
+            chunk_page_in(i);
+        }
+        if (c->state == CHUNK_RESIDENT)
+            num_resident--;
+        c->state = CHUNK_UNPAGED;
+    }
+    pager_release();
+}
+
+void enclave_pager_unmap(void *addr, size_t len) {
+    if (pager_enabled)
+        pager_unpage(addr, len, 1);
+}
+
+void enclave_pager_protect(void *addr, size_t len, int prot) {
+    size_t first, end;
+    if (!pager_enabled)
+        return;
+    if (prot != PROT_RW) {
+        pager_unpage(addr, len, 0);
+        return;
+    }
+
+    /* Evicted chunks must be paged in before the host makes them accessible
+     * again, or their contents would be lost */
+    if (!chunk_range(addr, len, 0, &first, &end))
+        return;
+    pager_acquire();
+    for (size_t i = first; i < end; i++)
+        if (chunks[i].state == CHUNK_EVICTED)
+            chunk_page_in(i);
+    pager_release();
+}
+
+int enclave_pager_advise(void *addr, size_t len, int advice) {
+    size_t first, end;
+    if (!pager_enabled)
+        return 0;
+
+    switch (advice) {
+    case MADV_COLD:
+    case MADV_PAGEOUT:
+        if (!chunk_range(addr, len, 1, &first, &end))
+            return 0;
+        pager_acquire();
+        for (size_t i = first; i < end; i++) {
+            if (chunks[i].state != CHUNK_RESIDENT)
+                continue;
+            /* Cold chunks are the next to be evicted by the clock */
+            chunks[i].referenced = 0;
+            if (advice == MADV_PAGEOUT && chunk_evict(i))
+                break;
+        }
+        pager_release();
+        break;
+    case MADV_WILLNEED:
+        if (!chunk_range(addr, len, 0, &first, &end))
+            return 0;
+        pager_acquire();
+        for (size_t i = first; i < end; i++) {
+            if (chunks[i].state == CHUNK_EVICTED)
+                chunk_page_in(i);
+            else if (chunks[i].state == CHUNK_RESIDENT)
+                chunks[i].referenced = 1;
+        }
+        pager_release();
+        break;
+    case MADV_DONTNEED:
+    case MADV_FREE:
+        /* The caller discards the contents of the range, so evicted chunks
+         * that are completely covered are not paged in */
+        if (!chunk_range(addr, len, 0, &first, &end))
+            return 0;
+        pager_acquire();
+        for (size_t i = first; i < end; i++) {
+            if (chunks[i].state != CHUNK_EVICTED)
+                continue;
+            if (!chunk_covered(i, addr, len)) {
+                chunk_page_in(i);
+                continue;
+            }
+            chunk_drop(i);
+            chunks[i].state = CHUNK_RESIDENT;
+            chunks[i].referenced = 0;
+            num_resident++;
+        }
+        pager_release();
+        break;
+    }
+    return 0;
+}
+
+int enclave_pager_fault(void *addr) {
+    int ret = 0;
+    if (!pager_enabled || (char *) addr < pager_base || (char *) addr >= pager_end)
+        return -1;
+
+    size_t i = ((char *) addr - pager_base) / chunk_size;
+    pager_acquire();
+    switch (chunks[i].state) {
+    case CHUNK_EVICTED:
+        chunk_page_in(i);
+        break;
+    case CHUNK_RESIDENT:
+        /* Paged in by another thread in the meantime */
+        break;
+    default:
+        ret = -1;
+    }
+    pager_release();
+    return ret;
+}
+
+static void pager_install_sigsegv(void);
+
+static void pager_sigsegv(int sig, siginfo_t *si, void *uc) {
+    if (si->si_code == SEGV_ACCERR && !enclave_pager_fault(si->si_addr))
+        return;
+
+    /* Not caused by paging, pass on to the application */
+    void (*handler)(int) = app_sigsegv.handler;
+    if (handler == SIG_DFL || handler == SIG_IGN) {
+        /* Faults again with the default action */
+        struct k_sigaction dfl = { .handler = SIG_DFL };
+        pager_scall(SYS_rt_sigaction, SIGSEGV, (long) &dfl, 0, sizeof(dfl.mask), 0, 0);
+        return;
+    }
+    if (app_sigsegv.flags & SA_RESETHAND) {
+        app_sigsegv.handler = SIG_DFL;
+        pager_install_sigsegv();
+    }
+    if (app_sigsegv.flags & SA_SIGINFO)
+        ((void (*)(int, siginfo_t *, void *)) handler)(sig, si, uc);
+    else
+        handler(sig);
+}
+
+static void pager_install_sigsegv(void) {
+    struct k_sigaction sa = {
+        .handler = (void (*)(int)) pager_sigsegv,
+        .flags = SA_SIGINFO | SA_RESTORER | (app_sigsegv.flags & (SA_ONSTACK|SA_NODEFER)),
+        .restorer = __restore_rt,
+    };
+    memcpy(sa.mask, app_sigsegv.mask, sizeof(sa.mask));
+    if (pager_scall(SYS_rt_sigaction, SIGSEGV, (long) &sa, 0, sizeof(sa.mask), 0, 0))
+        sgxlkl_fail("Enclave pager: Could not install SIGSEGV handler.\n");
+}
+
+int enclave_pager_sigaction(const struct k_sigaction *act, struct k_sigaction *oldact) {
+    if (!pager_enabled)
+        return 0;
+
+    pager_acquire();
+    if (oldact)
+        *oldact = app_sigsegv;
+    if (act) {
+        app_sigsegv = *act;
+        pager_install_sigsegv();
+    }
+    pager_release();
+    return 1;
+}
+
+static int pager_cpu_supported(void) {
+    unsigned int eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    /* PCLMULQDQ, AES-NI and RDRAND */
+    return (ecx & (1 << 1)) && (ecx & (1 << 25)) && (ecx & (1 << 30));
+}
+
+static int rdrand64(uint64_t *val) {
+    unsigned char ok;
+    for (int i = 0; i < 10; i++) {
+        __asm__ volatile("rdrand %0; setc %1" : "=r"(*val), "=qm"(ok));
+        if (ok)
+            return 0;
+    }
+    return -1;
+}
+
+void enclave_pager_init(enclave_config_t *encl) {
+    uint64_t key[AES_GCM_KEY_SIZE / sizeof(uint64_t)];
+    void *base, *end;
+    size_t num_slots;
+
+    chunk_size = encl->pager_chunk_size;
+    if (chunk_size < PAGE_SIZE || (chunk_size & (chunk_size - 1))) {
+        sgxlkl_warn("Invalid enclave pager chunk size %lu, paging disabled.\n", chunk_size);
+        return;
+    }
+
+    if (!pager_cpu_supported()) {
+        sgxlkl_warn("Enclave paging requires AES-NI, PCLMULQDQ and RDRAND, paging disabled.\n");
+        return;
+    }
+
+    enclave_mman_range(&base, &end);
+    pager_base = (char *) (((uintptr_t) base + chunk_size - 1) & ~(chunk_size - 1));
+    pager_end = (char *) ((uintptr_t) end & ~(chunk_size - 1));
+    if (pager_end <= pager_base)
+        return;
+    num_chunks = (pager_end - pager_base) / chunk_size;
+
+    swap = encl->pager_swap;
+    num_slots = encl->pager_swap_size / chunk_size;
+    if (num_slots > UINT32_MAX)
+        num_slots = UINT32_MAX;
+
+    /* Allocated before paging is enabled so that the pager's own state is
+     * never paged */
+    if (!(chunks = calloc(num_chunks, sizeof(*chunks))) ||
+        !(free_slots = malloc(num_slots * sizeof(*free_slots))))
+        sgxlkl_fail("Enclave pager: Could not allocate memory for chunk table.\n");
+    for (size_t s = 0; s < num_slots; s++)
+        free_slots[s] = num_slots - 1 - s;
+    num_free_slots = num_slots;
+
+    max_resident = encl->pager_resident_size / chunk_size;
+    if (encl->pager_resident_size && !max_resident)
+        max_resident = 1;
+
+    for (size_t k = 0; k < sizeof(key) / sizeof(key[0]); k++)
+        if (rdrand64(&key[k]))
+            sgxlkl_fail("Enclave pager: Could not generate key.\n");
+    aes_gcm_init(&gcm, (uint8_t *) key);
+    memset(key, 0, sizeof(key));
+
+    staging = pager_alloc_staging();
+    pager_scall(SYS_rt_sigaction, SIGSEGV, 0, (long) &app_sigsegv, sizeof(app_sigsegv.mask), 0, 0);
+    pager_install_sigsegv();
+
+    pager_enabled = 1;
+}
+
+#endif /* !SGXLKL_HW */
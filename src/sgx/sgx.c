@@ -51,6 +51,13 @@ typedef struct {
 
 static int use_in_kernel_init = 0;
 
+void (*create_enclave_phase_cb)(const char *phase, int begin) = NULL;
+
+static inline void create_enclave_phase(const char *phase, int begin) {
+    if (create_enclave_phase_cb)
+        create_enclave_phase_cb(phase, begin);
+}
+
 /*
  * if changed, the same typedef must be updated accordingly in
  * sgx-lkl/src/include/enclave_config.h
@@ -116,6 +123,7 @@ unsigned long hw_exceptions = 0;
 #endif /* DEBUG */
 
 typedef int (*process_func_t)(uint64_t, uint64_t, uint64_t, const void* p);
+typedef int (*process_range_func_t)(uint64_t, uint64_t, size_t, uint64_t, const void* p);
 
 void* get_tcs_addr(int id) {
     if (id >= tcs_max) return 0;
@@ -181,7 +189,8 @@ static char* get_init_token(sigstruct_t* sig) {
     uint64_t rdi = 0xffffffff;
     uint64_t rsi_val = 0x0e9fffff;
     uint64_t rsi = (uint64_t)&rsi_val;
-    eenter(tcsaddr, &rdi, &rsi);
+    uint64_t rdx;
+    eenter(tcsaddr, &rdi, &rsi, &rdx);
     gettoken_t req;
     memset(&req, 0, sizeof(gettoken_t));
     req.hash   = sig->enclaveHash;
@@ -192,7 +201,7 @@ static char* get_init_token(sigstruct_t* sig) {
     mbedtls_sha256(sig->modulus, 384, req.signer, 0);
     rdi = 0;
     rsi = (uint64_t)&req;
-    eenter(tcsaddr, &rdi, &rsi);
+    eenter(tcsaddr, &rdi, &rsi, &rdx);
 
     destroy_enclave(u);
     free(req.signer);
@@ -252,6 +261,18 @@ int add_page(uint64_t base, uint64_t offset, uint64_t prot, const void* p) {
     return ret;
 }
 
+/* Adds npages pages with the same content and protection starting at offset.
+ * EADD order determines the enclave measurement, so pages are added one by
+ * one in ascending order. */
+static int add_pages(uint64_t base, uint64_t offset, size_t npages, uint64_t prot, const void* p) {
+    int ret;
+    for (size_t i = 0; i < npages; i++) {
+        if ((ret = add_page(base, offset + i * PAGE_SIZE, prot, p)))
+            return ret;
+    }
+    return 0;
+}
+
 static size_t get_next_power2(size_t size) {
     if (__builtin_popcountl(size) == 1)
         return size;
@@ -337,8 +358,11 @@ int init_sgx() {
     return 0;
 }
 
-static int
-measure_page(uint64_t base, uint64_t offset, uint64_t prot, const void* page) {
+/* Number of EADD records hashed per mbedtls_sha256_update call for pages
+ * that are not extended (i.e. the heap) */
+#define MEASURE_BATCH_PAGES 64
+
+static void measure_eadd_record(uint64_t* rec, uint64_t offset, uint64_t prot) {
     secinfo_t secinfo={};
     memset(&secinfo, 0, sizeof(secinfo));
 
@@ -355,27 +379,56 @@ measure_page(uint64_t base, uint64_t offset, uint64_t prot, const void* page) {
         secinfo.flags.x = ((prot & PAGE_EXEC)  == PAGE_EXEC)  ? 1 : 0;
     }
 
+    memset(rec, 0, 64);
+    rec[0] = STRING_EADD;
+    rec[1] = offset;
+    memcpy(&rec[2], &secinfo, 48);
+}
+
+static int
+measure_page(uint64_t base, uint64_t offset, uint64_t prot, const void* page) {
     uint64_t tmp_update_field[8];
-    memset(&tmp_update_field[0], 0, 64);
-    tmp_update_field[0] = STRING_EADD;
-    tmp_update_field[1] = offset;
-    memcpy(&tmp_update_field[2], &secinfo, 48);
+    measure_eadd_record(tmp_update_field, offset, prot);
     mbedtls_sha256_update(&ctx, (unsigned char *)tmp_update_field, 64);
 
     if ((prot & PAGE_NOEXTEND) == PAGE_NOEXTEND)
         return 0;
 
+    /* EEXTEND measures 256-byte chunks, each preceded by a 64-byte header.
+     * Hash the whole page in a single update. */
+    unsigned char buf[16 * (64 + 256)];
     for (int i = 0; i < 16; i++) {
-        memset(&tmp_update_field[0], 0, 64);
-        tmp_update_field[0] = STRING_EEXTEND;
-        tmp_update_field[1] = offset + 256*i;
-        mbedtls_sha256_update(&ctx, (unsigned char *)tmp_update_field, 64);
-
-        unsigned char *cast_page = (unsigned char *)page + i * 256;
-        mbedtls_sha256_update(&ctx, (unsigned char *)(&cast_page[0]),   64);
-        mbedtls_sha256_update(&ctx, (unsigned char *)(&cast_page[64]),  64);
-        mbedtls_sha256_update(&ctx, (unsigned char *)(&cast_page[128]), 64);
-        mbedtls_sha256_update(&ctx, (unsigned char *)(&cast_page[192]), 64);
+        uint64_t *hdr = (uint64_t *)(buf + i * (64 + 256));
+        memset(hdr, 0, 64);
+        hdr[0] = STRING_EEXTEND;
+        hdr[1] = offset + 256*i;
+        memcpy((unsigned char *)hdr + 64, (unsigned char *)page + i * 256, 256);
+    }
+    mbedtls_sha256_update(&ctx, buf, sizeof(buf));
+
+    return 0;
+}
+
+/* Measures npages pages with the same content and protection starting at
+ * offset. Pages that are not extended only contribute their EADD records,
+ * which are hashed in batches. */
+static int
+measure_pages(uint64_t base, uint64_t offset, size_t npages, uint64_t prot, const void* page) {
+    if ((prot & PAGE_NOEXTEND) != PAGE_NOEXTEND) {
+        for (size_t i = 0; i < npages; i++)
+            measure_page(base, offset + i * PAGE_SIZE, prot, page);
+        return 0;
+    }
+
+    uint64_t recs[MEASURE_BATCH_PAGES][8];
+    for (size_t i = 0; i < MEASURE_BATCH_PAGES; i++)
+        measure_eadd_record(recs[i], 0, prot);
+
+    for (size_t i = 0; i < npages; i += MEASURE_BATCH_PAGES) {
+        size_t n = npages - i < MEASURE_BATCH_PAGES ? npages - i : MEASURE_BATCH_PAGES;
+        for (size_t j = 0; j < n; j++)
+            recs[j][1] = offset + (i + j) * PAGE_SIZE;
+        mbedtls_sha256_update(&ctx, (unsigned char *)recs, n * 64);
     }
 
     return 0;
@@ -428,20 +481,21 @@ void eresume(uint64_t tcs_id)  {
 
 /*
  * IN:  rdi - call id, rsi - call arg
- * OUT: rdi - exit reason, rsi - exit code
+ * OUT: rdi - exit reason, rsi - exit code, rdx - in-enclave return address
  */
 __attribute__((noinline))
-    void eenter(uint64_t tcs, uint64_t* rdi, uint64_t* rsi)  {
+    void eenter(uint64_t tcs, uint64_t* rdi, uint64_t* rsi, uint64_t* rdx)  {
         asm volatile(
                 ".byte 0x0f \n"
                 ".byte 0x01 \n"
                 ".byte 0xd7 \n"
-                : "+D"(*rdi), "+S"(*rsi)
+                : "+D"(*rdi), "+S"(*rsi), "=d"(*rdx)
                 : "a"(0x2), "b"(tcs), "c"(&exception)
-                : "%rdx", "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15", "memory"
+                : "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15", "memory"
                 );
     }
 
+/* ret receives the exit reason, exit code and in-enclave return address */
 void enter_enclave(int tcs_id, uint64_t call_id, void* arg, uint64_t* ret) {
     if (tcs_id < 0 || tcs_id > tcs_max) {
         fprintf(stderr, "Incorrect TCS id %d\n", tcs_id);
@@ -456,8 +510,9 @@ void enter_enclave(int tcs_id, uint64_t call_id, void* arg, uint64_t* ret) {
     threads[tcs_id].busy = 1;
     ret[0] = call_id;
     ret[1] = (uint64_t)arg;
+    ret[2] = 0;
 
-    eenter((uint64_t)threads[tcs_id].addr, &ret[0], &ret[1]);
+    eenter((uint64_t)threads[tcs_id].addr, &ret[0], &ret[1], &ret[2]);
     threads[tcs_id].busy = 0;
 }
 
@@ -521,7 +576,7 @@ static size_t get_enclave_size(size_t heap, size_t stack, int tcsp, int ssaFrame
     return heap + tcsp * (1 + stack + ssaFrameSize * nssa + tls) + code;
 }
 
-static void process_pages(char* p, uint64_t ubase, size_t heap, size_t stack, int tcsp, int nssa, process_func_t process_page) {
+static void process_pages(char* p, uint64_t ubase, size_t heap, size_t stack, int tcsp, int nssa, process_func_t process_page, process_range_func_t process_range) {
     size_t pageoffset = 0;
     int prot = 0;
     char page[PAGE_SIZE] = {};
@@ -530,10 +585,8 @@ static void process_pages(char* p, uint64_t ubase, size_t heap, size_t stack, in
     prot = PAGE_READ|PAGE_WRITE|PAGE_EXEC|PAGE_NOEXTEND;
     uint64_t heap_offset = pageoffset;
     D printf("heap: %lx, size: %lu\n", pageoffset, heap);
-    for (size_t i = 0; i < heap; i++) {
-        process_page(ubase, pageoffset, prot, page);
-        pageoffset += PAGE_SIZE;
-    }
+    process_range(ubase, pageoffset, heap, prot, page);
+    pageoffset += heap * PAGE_SIZE;
 
     Elf_Ehdr *ehdr = (Elf_Ehdr*)p;
     Elf_Phdr *phdr = (Elf_Phdr*)(ehdr->e_phoff + p);
@@ -599,10 +652,8 @@ static void process_pages(char* p, uint64_t ubase, size_t heap, size_t stack, in
 
         int rest = phdr[i].p_memsz - file_read - mem_read;
         if (rest > 0) {
-            for (int n = 0; n < rest / PAGE_SIZE; n++) {
-                process_page(ubase, libbase + pageoffset, prot, page);
-                pageoffset += PAGE_SIZE;
-            }
+            process_range(ubase, libbase + pageoffset, rest / PAGE_SIZE, prot, page);
+            pageoffset += (rest / PAGE_SIZE) * PAGE_SIZE;
         }
 
         if (rest % PAGE_SIZE > 0) {
@@ -643,17 +694,13 @@ static void process_pages(char* p, uint64_t ubase, size_t heap, size_t stack, in
     for (int i = 0; i < tcsp; i++) {
         D printf("stack(%d): %lx\n", i, pageoffset);
         uint64_t stack_start = pageoffset;
-        for (int i = 0; i < stack; i++) {
-            process_page(ubase, pageoffset, PAGE_READ|PAGE_WRITE, page);
-            pageoffset += PAGE_SIZE;
-        }
+        process_range(ubase, pageoffset, stack, PAGE_READ|PAGE_WRITE, page);
+        pageoffset += stack * PAGE_SIZE;
 
         uint64_t ossa = pageoffset;
         D printf("ossa: %lx\n", ossa);
-        for (int i = 0; i < nssa; i++) {
-            process_page(ubase, pageoffset, prot, page);
-            pageoffset += PAGE_SIZE;
-        }
+        process_range(ubase, pageoffset, nssa, prot, page);
+        pageoffset += nssa * PAGE_SIZE;
 
         //tls
         uint64_t tls = pageoffset;
@@ -767,11 +814,17 @@ uintptr_t create_enclave_mem(char *p, int base_zero, void *base_zero_max) {
         encl_base_addr = (void*) 0x0;
     }
 
+    create_enclave_phase("ecreate", 1);
     ubase = ecreate(size, ssaFrameSize, s, encl_base_addr);
+    create_enclave_phase("ecreate", 0);
     heap_size = enc->heap_size; // Used by GDB plugin
-    process_pages(p, (uint64_t)ubase, heap, stack, tcsp, nssa, &add_page);
+    create_enclave_phase("process_pages", 1);
+    process_pages(p, (uint64_t)ubase, heap, stack, tcsp, nssa, &add_page, &add_pages);
+    create_enclave_phase("process_pages", 0);
 
+    create_enclave_phase("einit", 1);
     int res = einit(ubase, s);
+    create_enclave_phase("einit", 0);
     if (res != 0) {
         printf("Error while initializing enclave, error code: %d\n", res);
         destroy_enclave(ubase);
@@ -920,7 +973,7 @@ void enclave_update_heap(void *p, size_t new_heap, char* key_path) {
     memcpy((unsigned char*)&tmp_update_field[1], &ssaFrameSize, 4);
     memcpy((unsigned char*)&tmp_update_field[1] + 4, &size, 8);
     mbedtls_sha256_update(&ctx, (unsigned char *)tmp_update_field, 64);
-    process_pages(p, 0, new_heap, stack, tcsp, nssa, &measure_page);
+    process_pages(p, 0, new_heap, stack, tcsp, nssa, &measure_page, &measure_pages);
     mbedtls_sha256_finish(&ctx, (unsigned char*)hash);
 
     sigstruct_t *s = (sigstruct_t*)get_section_address(p, ".note.sigstruct");
@@ -991,7 +1044,7 @@ void enclave_sign(char* path, char* key, size_t heap, size_t stack, int tcsp) {
     memcpy((unsigned char*)&tmp_update_field[1], &ssaFrameSize, 4);
     memcpy((unsigned char*)&tmp_update_field[1] + 4, &size, 8);
     mbedtls_sha256_update(&ctx, (unsigned char *)tmp_update_field, 64);
-    process_pages(p, 0, heap, stack, tcsp, nssa, &measure_page);
+    process_pages(p, 0, heap, stack, tcsp, nssa, &measure_page, &measure_pages);
     mbedtls_sha256_finish(&ctx, (unsigned char*)hash);
 
     unsigned char header [16] = SIG_HEADER1;
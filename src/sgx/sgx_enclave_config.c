@@ -8,6 +8,7 @@
 #include <setjmp.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "mpmc_queue.h"
 #include "sgx_enclave_config.h"
 #include "sgx_hostcall_interface.h"
@@ -82,6 +83,13 @@ void leave_enclave(uint64_t rdi, uint64_t rsi) {
     void* exit_address = get_exit_address();
     uint64_t ursp = get_ursp();
     uint64_t urbp = get_urbp();
+    /* Expose the call site to the host exit profiler (not in release mode
+     * where the enclave layout should not be disclosed) */
+#ifndef SGXLKL_RELEASE
+    uint64_t ret_addr = (uint64_t) __builtin_return_address(0);
+#else
+    uint64_t ret_addr = 0;
+#endif
     if (setjmp(get_enclave_parms()->regs) == 0) {
         //TODO: clear registers
         __asm__ volatile(
@@ -91,7 +99,7 @@ void leave_enclave(uint64_t rdi, uint64_t rsi) {
                 ".byte 0x01 \n"
                 ".byte 0xd7 \n"
                 :
-                : "r"(ursp), "r"(urbp), "a"(0x4), "b"(exit_address), "D"(rdi), "S"(rsi)
+                : "r"(ursp), "r"(urbp), "a"(0x4), "b"(exit_address), "D"(rdi), "S"(rsi), "d"(ret_addr)
                 :
         );
     }
@@ -111,7 +119,7 @@ void exit_enclave(uint64_t rdi, uint64_t rsi, void* exit_address, int exit_threa
         ".byte 0x01 \n"
         ".byte 0xd7 \n"
         :
-        : "r"(ursp), "r"(urbp), "a"(0x4), "b"(exit_address), "D"(rdi), "S"(rsi)
+        : "r"(ursp), "r"(urbp), "a"(0x4), "b"(exit_address), "D"(rdi), "S"(rsi), "d"(0)
         :
         );
 }
@@ -149,6 +157,25 @@ void ocall_cpuid(unsigned int* request) {
     arena_free(a);
 }
 
+/* CPUID leaves reported by the host at startup. Answering CPUID from this
+ * cache avoids an additional enclave exit for each executed CPUID
+ * instruction. Leaves that are not cached are still requested from the
+ * host. */
+static cpuid_leaf_t cpuid_cache[CPUID_CACHE_MAX_LEAVES];
+static size_t cpuid_cache_len = 0;
+
+static int cpuid_cache_lookup(unsigned int* request) {
+    for (size_t i = 0; i < cpuid_cache_len; i++) {
+        cpuid_leaf_t *l = &cpuid_cache[i];
+        if (l->leaf == request[0] &&
+            (!(l->flags & CPUID_LEAF_INDEXED) || l->subleaf == request[2])) {
+            memcpy(request, l->regs, sizeof(l->regs));
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /* Handle CPUID ecall after an illegal instruction has been caught on the host */
 void ecall_cpuid(gprsgx_t *regs) {
     unsigned int request[4];
@@ -156,7 +183,8 @@ void ecall_cpuid(gprsgx_t *regs) {
     request[0] = (unsigned int)regs->rax;
     request[2] = (unsigned int)regs->rcx;
     if (request[0] == 1) clear_tsc = 1;
-    ocall_cpuid(request);
+    if (!cpuid_cache_lookup(request))
+        ocall_cpuid(request);
     if (clear_tsc) {
         /* clear TSC bit in edx, CPUID_FEAT_EDX_TSC - 5th bit */
         unsigned int mask;
@@ -180,6 +208,34 @@ void ecall_rdtsc(gprsgx_t *regs, uint64_t ts) {
 
 }
 
+/* TSC estimate for internal timestamps such as host call queueing times.
+ * RDTSC is illegal inside SGX1 enclaves, derive the TSC from the monotonic
+ * clock and the calibration provided by the host instead. RDTSC executed by
+ * the application is not affected and still traps to the host (see
+ * ecall_rdtsc). This relies on clock_gettime being served by the vDSO, as a
+ * host call from within the host call path would corrupt the caller's
+ * syscall slot. */
+static tsc_info_t tsc_info;
+static int tsc_enabled = 0;
+
+void enclave_rdtsc_enable(void) {
+    tsc_enabled = tsc_info.cycles_per_ns != 0;
+}
+
+uint64_t enclave_rdtsc(void) {
+    struct timespec ts;
+    uint64_t ns;
+
+    if (!tsc_enabled)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (ns < tsc_info.ns_ref)
+        return tsc_info.tsc_ref;
+    return tsc_info.tsc_ref + (uint64_t) (((unsigned __int128) (ns - tsc_info.ns_ref) * tsc_info.cycles_per_ns) >> 32);
+}
+
 int in_enclave_range(void *addr, size_t len) {
     char *encl_start = (char *) get_enclave_parms()->base;
     char *encl_end = encl_start + get_enclave_parms()->enclave_size;
@@ -222,8 +278,14 @@ enclave_config_t *enclave_config_copy_and_check(enclave_config_t *untrusted) {
     if (in_enclave_range(encl->syscallpage, PAGE_SIZE)) enclave_config_fail();
     if (in_enclave_range(encl->syscallq, sizeof(struct mpmcq))) enclave_config_fail();
     if (in_enclave_range(encl->returnq, sizeof(struct mpmcq))) enclave_config_fail();
+    if (encl->host_call_rings && in_enclave_range(encl->host_call_rings, 2 * encl->num_host_call_rings * sizeof(struct spscq))) enclave_config_fail();
     if (in_enclave_range(encl->disks, sizeof(*encl->disks) * encl->num_disks)) enclave_config_fail();
     if (encl->vvar && in_enclave_range(encl->vvar, PAGE_SIZE)) enclave_config_fail();
+    if (encl->exit_prof && in_enclave_range(encl->exit_prof, sizeof(*encl->exit_prof))) enclave_config_fail();
+    if (encl->boot_prof && in_enclave_range(encl->boot_prof, sizeof(*encl->boot_prof))) enclave_config_fail();
+    if (encl->ethread_park && in_enclave_range(encl->ethread_park, sizeof(*encl->ethread_park))) enclave_config_fail();
+    // Enclave paging is not supported in hardware mode
+    encl->pager_swap = NULL;
 
     // TODO Should the kernel command line arguments actually be trusted at
     // all?
@@ -245,6 +307,18 @@ enclave_config_t *enclave_config_copy_and_check(enclave_config_t *untrusted) {
     if (in_enclave_range(encl->quote_target_info, sizeof(sgx_target_info_t))) enclave_config_fail();
     if (in_enclave_range(encl->report, sizeof(sgx_report_t))) enclave_config_fail();
 
+    // Copy CPUID leaves and TSC calibration into the enclave. Both are
+    // host-provided and as trustworthy as any CPUID exit would be.
+    if (encl->cpuid_cache_len > CPUID_CACHE_MAX_LEAVES) enclave_config_fail();
+    if (encl->cpuid_cache_len) {
+        if (in_enclave_range(encl->cpuid_cache, encl->cpuid_cache_len * sizeof(*encl->cpuid_cache)))
+            enclave_config_fail();
+        memcpy(cpuid_cache, encl->cpuid_cache, encl->cpuid_cache_len * sizeof(*encl->cpuid_cache));
+        cpuid_cache_len = encl->cpuid_cache_len;
+    }
+    encl->cpuid_cache = NULL;
+    tsc_info = encl->tsc_info;
+
 
     // Comments on other fields
     // encl->disks:     Individual disk configurations are checked in startmain
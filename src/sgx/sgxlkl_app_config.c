@@ -97,6 +97,8 @@ static int parse_enclave_disk_config_entry(const char *key, struct json_object *
         strncpy(disk->mnt, mnt_point, SGXLKL_DISK_MNT_MAX_PATH_LEN);
     } else if (!strcmp("key", key)) {
         const char *enc_key = json_object_get_string(value);
+        free(disk->key);
+        disk->key = NULL;
         disk->key_len = hex_to_bytes(enc_key, &disk->key);
         if (disk->key_len < 0)
             err = disk->key_len;
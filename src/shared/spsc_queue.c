@@ -0,0 +1,35 @@
+/*
+ * Copyright 2016, 2017, 2018 Imperial College London
+ */
+
+#include <string.h>
+
+#include "spsc_queue.h"
+
+void newspscq(struct spscq *q) {
+    memset(q, 0, sizeof(*q));
+}
+
+int spsc_enqueue(struct spscq *q, void *data) {
+    size_t tail = q->tail;
+    if (tail - q->head_cache >= SPSCQ_SIZE) {
+        q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (tail - q->head_cache >= SPSCQ_SIZE)
+            return 0;
+    }
+    q->cells[tail & (SPSCQ_SIZE - 1)].data = data;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int spsc_dequeue(struct spscq *q, void **data) {
+    size_t head = q->head;
+    if (head == q->tail_cache) {
+        q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (head == q->tail_cache)
+            return 0;
+    }
+    *data = q->cells[head & (SPSCQ_SIZE - 1)].data;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
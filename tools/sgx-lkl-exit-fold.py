@@ -0,0 +1,98 @@
+#!/usr/bin/python3
+
+# This script converts an enclave exit profile written by sgx-lkl-run (see
+# SGXLKL_EXIT_PROFILE) into folded stacks that can be rendered with
+# flamegraph.pl, e.g.
+#
+#   SGXLKL_EXIT_PROFILE=exits.txt sgx-lkl-run ...
+#   sgx-lkl-exit-fold.py exits.txt build/libsgxlkl.so | flamegraph.pl > exits.svg
+#
+# Each sampled exit becomes a stack of the form
+#   <exit reason>;<host call/sleep/CPUID leaf/signal>;<in-enclave call site>
+# weighted by the number of cycles spent outside the enclave.
+
+import argparse
+import collections
+import subprocess
+import sys
+
+
+def parse_profile(f):
+    base = 0
+    exits = []
+    totals = collections.Counter()
+    counts = collections.Counter()
+    for ln in f:
+        fields = ln.split()
+        if len(fields) == 0:
+            continue
+        if fields[0] == '#':
+            if len(fields) > 2 and fields[1] == 'base':
+                base = int(fields[2], 16)
+            continue
+        if fields[0] == 'total':
+            _, _, reason, count, cycles = fields
+            counts[reason] += int(count)
+            totals[reason] += int(cycles)
+        elif fields[0] == 'exit':
+            _, _, reason, arg, cycles, ret_addr = fields
+            exits.append((reason, int(arg), int(cycles), int(ret_addr, 16)))
+    return base, exits, counts, totals
+
+
+def symbolize(lib, base, addrs):
+    syms = {}
+    addrs = sorted(a for a in addrs if a >= base and a != 0)
+    if not lib or not addrs:
+        return syms
+    # Return addresses point after the call instruction
+    offsets = ['0x{:x}'.format(a - base - 1) for a in addrs]
+    out = subprocess.run(['addr2line', '-f', '-e', lib] + offsets,
+                         stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout.splitlines()
+    for i, a in enumerate(addrs):
+        syms[a] = out[2 * i] if 2 * i < len(out) else '??'
+    return syms
+
+
+def detail(reason, arg):
+    if reason == 'SYSCALL':
+        return 'syscall_{}'.format(arg)
+    if reason == 'SLEEP':
+        return 'sleep_{}ns'.format(arg)
+    if reason == 'CPUID':
+        return 'leaf_0x{:x}'.format(arg)
+    if reason == 'SIGNAL':
+        return 'signal_{}'.format(arg)
+    if reason == 'PARK':
+        return 'parked'
+    return str(arg)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert an SGX-LKL enclave exit profile into folded stacks.')
+    parser.add_argument('profile', help='exit profile written by sgx-lkl-run')
+    parser.add_argument('lib', nargs='?', help='libsgxlkl.so used to resolve in-enclave call sites')
+    parser.add_argument('--summary', action='store_true', help='print per-reason exit totals instead')
+    args = parser.parse_args()
+
+    with open(args.profile) as f:
+        base, exits, counts, totals = parse_profile(f)
+
+    if args.summary:
+        for reason in sorted(counts, key=lambda r: -totals[r]):
+            avg = totals[reason] // counts[reason] if counts[reason] else 0
+            print('{:<10} {:>12} exits {:>16} cycles {:>10} avg'.format(reason, counts[reason], totals[reason], avg))
+        return
+
+    syms = symbolize(args.lib, base, set(e[3] for e in exits))
+    folded = collections.Counter()
+    for reason, arg, cycles, ret_addr in exits:
+        site = syms.get(ret_addr, '0x{:x}'.format(ret_addr - base) if ret_addr else 'unknown')
+        folded['{};{};{}'.format(reason, detail(reason, arg), site)] += cycles
+
+    for stack, cycles in folded.items():
+        sys.stdout.write('{} {}\n'.format(stack, cycles))
+
+
+if __name__ == '__main__':
+    main()